@@ -30,6 +30,8 @@
 #include <OOGL/VertexArrayObject.h>
 
 #include <OOBase/HashTable.h>
+#include <OOBase/String.h>
+#include <OOBase/Vector.h>
 
 #include "Resource.h"
 
@@ -52,6 +54,8 @@ namespace Indigo
 
 		bool load(const ResourceBundle& resource, const char* name);
 		bool load(const ResourceBundle& resource, const unsigned char* buffer, size_t len);
+		bool load_truetype(const ResourceBundle& resource, const char* name, unsigned int pixel_height);
+		bool load_distance_field(const ResourceBundle& resource, const char* name);
 
 		float measure_text(const char* sz, size_t len = -1)  const;
 
@@ -63,9 +67,18 @@ namespace Indigo
 	private:
 		struct Info
 		{
+			Info() : m_line_height(0), m_base_height(0), m_packing(0), m_distance_field(false), m_tex_width(0), m_tex_height(0)
+			{
+				m_padding[0] = m_padding[1] = m_padding[2] = m_padding[3] = 0;
+			}
+
 			OOBase::uint16_t m_line_height;
 			OOBase::uint16_t m_base_height;
 			OOBase::uint32_t m_packing;
+			bool             m_distance_field;
+			OOBase::uint16_t m_tex_width;
+			OOBase::uint16_t m_tex_height;
+			OOBase::uint8_t  m_padding[4]; // up, right, down, left
 
 			struct char_info
 			{
@@ -86,11 +99,26 @@ namespace Indigo
 
 			typedef OOBase::HashTable<OOBase::Pair<OOBase::uint32_t,OOBase::uint32_t>,float> kern_map_t;
 			kern_map_t m_mapKerning;
+
+			// Set when glyphs are rasterized on demand rather than loaded from BMFont pages
+			struct TrueType;
+			OOBase::SharedPtr<TrueType> m_truetype;
+
+			// Set when loaded from a cooked font blob, whose tables are searched in place
+			struct Cooked;
+			OOBase::SharedPtr<Cooked> m_cooked;
+
+			bool find_char(OOBase::uint32_t glyph, struct char_info& ci) const;
+			float kerning(OOBase::uint32_t prev_glyph, OOBase::uint32_t glyph) const;
 		};
 
 		OOBase::SharedPtr<Indigo::Font::Info> m_info;
 		OOBase::SharedPtr<Render::Font> m_render_font;
 
+		bool load_truetype(const OOBase::SharedPtr<const unsigned char>& data, size_t len, unsigned int pixel_height);
+		bool load_cooked(const OOBase::SharedPtr<const unsigned char>& data, size_t len);
+		bool load_bmfont(const ResourceBundle& resource, const unsigned char* data, size_t len, bool distance_field);
+
 		void do_load(OOBase::SharedPtr<Indigo::Image>* pages, size_t page_count, bool* ret_val);
 		void do_unload();
 	};
@@ -98,11 +126,13 @@ namespace Indigo
 	namespace Render
 	{
 		class Text;
+		class TextBlock;
 
 		class Font : public OOBase::NonCopyable
 		{
 			friend class Indigo::Font;
 			friend class Text;
+			friend class TextBlock;
 
 		public:
 			Font(const OOBase::SharedPtr<Indigo::Font::Info>& info);
@@ -112,26 +142,76 @@ namespace Indigo
 			OOBase::uint16_t base_height() const { return m_info->m_base_height; }
 
 		private:
-			typedef OOBase::Table<GLsizei,GLsizei,OOBase::Less<GLsizei>,OOBase::ThreadLocalAllocator> free_list_t;
-			free_list_t m_listFree;
-			GLsizei m_allocated;
+			struct GlyphPage;
+			OOBase::Vector<OOBase::SharedPtr<GlyphPage>,OOBase::ThreadLocalAllocator> m_pages;
+
+			struct RetiredGlyphs
+			{
+				GlyphPage*       m_page;
+				GLsizei          m_start;
+				unsigned int     m_order;
+				OOBase::uint64_t m_frame;
+			};
+			OOBase::Vector<RetiredGlyphs,OOBase::ThreadLocalAllocator> m_listRetired;
+
+			struct GlyphAtlas;
+			OOBase::SharedPtr<GlyphAtlas> m_atlas;
+
+			struct GlyphVertex;
+
+			struct PlacedGlyph
+			{
+				OOBase::uint32_t m_glyph;
+				float            m_x;
+				float            m_y;
+
+				bool operator == (const PlacedGlyph& rhs) const
+				{
+					return (m_glyph == rhs.m_glyph && m_x == rhs.m_x && m_y == rhs.m_y);
+				}
+			};
+
+			// Laid out and uploaded glyphs, shared by every Text showing the same string
+			struct GlyphRun;
+			typedef OOBase::HashTable<size_t,OOBase::SharedPtr<GlyphRun>,OOBase::ThreadLocalAllocator> run_map_t;
+			run_map_t m_mapRuns;
 
 			OOBase::SharedPtr<OOGL::Texture> m_ptrTexture;
-			OOBase::SharedPtr<OOGL::VertexArrayObject> m_ptrVAO;
-			OOBase::SharedPtr<OOGL::BufferObject> m_ptrVertices;
-			OOBase::SharedPtr<OOGL::BufferObject> m_ptrElements;
 			OOBase::SharedPtr<OOGL::Program> m_ptrProgram;
+			OOBase::SharedPtr<OOGL::Program> m_ptrShadowProgram;
+			OOBase::SharedPtr<OOGL::BufferObject> m_ptrElements;
 
 			OOBase::SharedPtr<Indigo::Font::Info> m_info;
 
 			bool load(const OOBase::SharedPtr<Indigo::Image>* pages, size_t page_count);
 
+			OOBase::SharedPtr<GlyphRun> find_run(size_t hash, const char* sz, size_t len);
+			void intern_run(const OOBase::SharedPtr<GlyphRun>& run, size_t hash, const char* sz, size_t len);
+			void unintern_run(GlyphRun& run);
 			bool alloc_text(Text& text, const char* sz, size_t len);
+			bool update_text(Text& text, const char* sz, size_t len);
 			void free_text(Text& text);
 
+			bool layout_text(const char* sz, size_t len, OOBase::Vector<PlacedGlyph,OOBase::ThreadLocalAllocator>& placed, float* width = NULL);
+			bool write_run(GlyphRun& run, const PlacedGlyph* placed, GLsizei first, GLsizei len);
+			bool upload_run(GlyphRun& run, GLsizei from, GLsizei to);
+			bool write_glyphs(GlyphRun& run, unsigned int copy, GLsizei from, GLsizei to);
+			bool move_run(GlyphRun& run, unsigned int copies);
+			void emit_glyphs(GlyphVertex* a, const PlacedGlyph* placed, GLsizei len);
+			void acquire_glyphs(const PlacedGlyph* placed, GLsizei len, OOBase::uint32_t* acquired);
+			void release_glyphs(GlyphRun& run, GLsizei from, GLsizei to);
+			void retire_run(GlyphRun& run);
+
+			bool alloc_glyphs(GLsizei len, GlyphPage*& page, GLsizei& start, unsigned int& order);
+			void reclaim_glyphs();
+			GlyphPage* new_page(unsigned int order);
+			bool alloc_elements();
+
 			bool font_program(OOBase::uint32_t packing);
+			bool shadow_program();
 
-			void draw(OOGL::State& state, const glm::mat4& mvp, const glm::vec4& colour, GLsizei start, GLsizei len);
+			void draw(OOGL::State& state, const glm::mat4& mvp, const glm::vec4& colour, GlyphPage* page, GLsizei start, GLsizei len);
+			bool draw_shadowed(OOGL::State& state, const glm::mat4& mvp, const glm::vec4& colour, const glm::vec4& shadow, const glm::vec2& drop, GlyphPage* page, GLsizei start, GLsizei len);
 		};
 
 		class Text : public OOBase::NonCopyable
@@ -148,10 +228,51 @@ namespace Indigo
 
 			void draw(OOGL::State& state, const glm::mat4& mvp, const glm::vec4& colour, GLsizei start = 0, GLsizei length = -1) const;
 
+			// Draws the text over its drop shadow in a single pass, drop is in line heights.
+			// Returns false if the font cannot, and the caller should draw twice instead
+			bool draw_shadowed(OOGL::State& state, const glm::mat4& mvp, const glm::vec4& colour, const glm::vec4& shadow, const glm::vec2& drop) const;
+
+		private:
+			OOBase::SharedPtr<Font> m_font;
+			OOBase::SharedPtr<Font::GlyphRun> m_run;
+		};
+
+		class TextBlock : public OOBase::NonCopyable
+		{
+		public:
+			enum eAlignment
+			{
+				align_left = 0,
+				align_right,
+				align_centre
+			};
+
+			// Width is in line heights, 0 for no wrapping
+			TextBlock(const OOBase::SharedPtr<Font>& font, float width = 0.f, eAlignment align = align_left);
+			~TextBlock();
+
+			const OOBase::SharedPtr<Font>& font() const { return m_font; }
+
+			bool text(const char* sz, size_t len = -1);
+			bool width(float width);
+			bool alignment(eAlignment align);
+
+			size_t lines() const { return m_lines; }
+
+			void draw(OOGL::State& state, const glm::mat4& mvp, const glm::vec4& colour) const;
+
 		private:
 			OOBase::SharedPtr<Font> m_font;
-			GLsizei m_glyph_start;
-			GLsizei m_glyph_len;
+			OOBase::SharedPtr<Font::GlyphRun> m_run;
+			float m_width;
+			eAlignment m_align;
+			size_t m_lines;
+
+			// Each paragraph caches its layout and line breaks, so edits and resizes only redo what changed
+			struct Paragraph;
+			OOBase::Vector<OOBase::SharedPtr<Paragraph>,OOBase::ThreadLocalAllocator> m_paragraphs;
+
+			bool update(size_t first_paragraph);
 		};
 	}
 }
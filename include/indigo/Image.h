@@ -22,6 +22,7 @@
 #ifndef INDIGO_IMAGE_H_INCLUDED
 #define INDIGO_IMAGE_H_INCLUDED
 
+#include <OOBase/Condition.h>
 #include <OOGL/Texture.h>
 
 #include "Resource.h"
@@ -29,29 +30,85 @@
 namespace Indigo
 {
 	class ResourceBundle;
+	class ImageAtlas;
+
+	namespace Render
+	{
+		class TextureManager;
+	}
 
 	class Image : public OOBase::NonCopyable
 	{
+		friend class ImageAtlas;
+		friend class Render::TextureManager;
+
 	public:
+		enum LoadFlags
+		{
+			eLF_mipmaps = 0x1,     // Build the mip chain while decoding, in linear light
+			eLF_premultiply = 0x2, // Multiply colour by alpha, for GL_ONE, GL_ONE_MINUS_SRC_ALPHA blending
+			eLF_downscale = 0x4    // Shrink as set by downscale(), while decoding
+		};
+
+		// For low memory machines: each level of mip_bias halves images loaded with eLF_downscale,
+		// which are then halved again until neither side is over max_size, if not 0.
+		// size() is still the full size, so layouts don't change
+		static void downscale(unsigned int mip_bias, unsigned int max_size = 0);
+
 		Image();
 		virtual ~Image();
 
 		virtual bool valid() const;
 
-		bool load(const ResourceBundle& resource, const char* name, int components = 0);
+		// Resources may also be KTX or DDS containers of GPU compressed mip chains, which are uploaded
+		// in place without decoding, or raw textures from tools/texcook, whose texels are used in place as the pixels.
+		// flags are LoadFlags, as for load_async(), and are ignored by compressed and raw textures.
+		// Loading from a buffer takes no flags, so NinePatch, which overrides it, keeps pixel exact borders
+		bool load(const ResourceBundle& resource, const char* name, int components = 0, unsigned int flags = 0);
 		virtual bool load(const unsigned char* buffer, size_t len, int components = 0);
 
+		// Reads the image header now and decodes the pixels on a worker thread.
+		// flags are LoadFlags, and only apply to 4 component images
+		bool load_async(const ResourceBundle& resource, const char* name, int components = 0, unsigned int flags = 0);
+		bool ready() const;
+		bool wait() const;
+
 		bool create(const glm::vec4& colour);
 
+		// Frees the decoded pixels once they are uploaded, and decodes them again from the resource when next needed.
+		// Only images loaded from a ResourceBundle can drop their pixels, and only if this is set before loading
+		void discard_pixels(bool discard = true) { m_discard = discard; }
+
 		virtual void unload();
 
-		glm::uvec2 size() const { return glm::uvec2(m_width,m_height); }
+		glm::uvec2 size() const { return m_full_size.x ? m_full_size : glm::uvec2(m_width,m_height); }
 		unsigned int components() const { return m_components; }
 		unsigned int valid_components() const { return m_valid_components; }
+		bool compressed() const { return m_compressed != NULL; }
+
+		// The area of make_texture() holding this image, (u0,v0,u1,v1), which is not the whole texture once packed into an ImageAtlas
+		const glm::vec4& tex_rect() const { return m_tex_rect; }
 
 		glm::vec4 pixel(const glm::uvec2& pos) const;
 
-		OOBase::SharedPtr<OOGL::Texture> make_texture(GLenum internalFormat, bool& cached, GLsizei levels = 0) const;
+		OOBase::SharedPtr<OOGL::Texture> make_texture(GLenum internalFormat, bool& cached, GLsizei levels = 0, bool block = true) const;
+
+		// Returns a single level texture at once, and fills it through a ring of pixel buffers over the following frames
+		OOBase::SharedPtr<OOGL::Texture> stream_texture(GLenum internalFormat, bool& cached) const;
+
+		// The size of mip level 'level' of the decoded pixels, which is smaller than size() if downscaled
+		glm::uvec2 level_size(unsigned int level) const;
+
+		// Returns a texture of rect (x,y,width,height) of mip level 'level', for drawing large images in tiles.
+		// Levels above 0 need the mip chain built by eLF_mipmaps
+		OOBase::SharedPtr<OOGL::Texture> make_tile(GLenum internalFormat, unsigned int level, const glm::uvec4& rect) const;
+
+		// Frees the pixels of the levels finer than 'level', for images with a source to decode them again from.
+		// has_level() is false for them, or for level 0 once discard_pixels() has dropped it, until restore_levels()
+		// has decoded them again on a worker thread, and ready() is false until it has
+		void drop_levels(unsigned int level) const;
+		bool has_level(unsigned int level) const;
+		bool restore_levels() const;
 		
 	protected:
 		unsigned int m_width;
@@ -61,6 +118,76 @@ namespace Indigo
 		void*        m_pixels;
 
 		mutable OOBase::WeakPtr<OOGL::Texture> m_texture;
+
+		// Decodes the pixels again, after they have been discarded.  Runs on a decode thread, so must only read
+		virtual void* reload_pixels(unsigned int& width, unsigned int& height) const;
+		virtual bool reloadable() const;
+		void free_pixels();
+		void* decode_source(unsigned int& width, unsigned int& height) const;
+		void keep_source(const OOBase::SharedPtr<const unsigned char>& buffer, size_t len, int components);
+
+	private:
+		struct AsyncLoad;
+		OOBase::SharedPtr<AsyncLoad> m_async;
+		mutable bool m_streaming;
+
+		bool complete_async() const;
+		void finish_async();
+		static void decode_async(void* param);
+		bool load_pixels(const unsigned char* buffer, size_t len, int components, unsigned int flags);
+		void cancel_stream();
+		void stop_stream();
+
+		struct Compressed;
+		Compressed* m_compressed;
+
+		static bool is_compressed(const unsigned char* buffer, size_t len);
+		bool load_compressed(const OOBase::SharedPtr<const unsigned char>& buffer, size_t len);
+		void free_compressed();
+		OOBase::SharedPtr<OOGL::Texture> make_compressed_texture(bool& cached, GLsizei levels) const;
+
+		OOBase::SharedPtr<Image> m_atlas_page;
+		glm::vec4                m_tex_rect;
+
+		mutable bool m_managed;
+
+		// The raw texture resource m_pixels and m_mips point into, when they are not ours to free
+		OOBase::SharedPtr<const unsigned char> m_mapped;
+
+		OOBase::SharedPtr<const unsigned char> m_source;
+		size_t                                 m_source_len;
+		int                                    m_source_components;
+		bool                                   m_discard;
+		mutable OOBase::Condition::Mutex       m_pixel_lock;
+
+		bool reload_async() const;
+		bool restore_pixels(bool block = true) const;
+		void release_pixels() const;
+		void leave_atlas();
+
+		// Mip levels from m_mip_first down, packed one after another.
+		// m_mip_first is 1 unless drop_levels() has freed finer levels
+		void*        m_mips;
+		unsigned int m_mip_first;
+		unsigned int m_mip_levels;
+		unsigned int m_flags;
+
+		// The size before downscaling, or 0
+		glm::uvec2   m_full_size;
+
+		static void* decode(const unsigned char* buffer, size_t len, int components, unsigned int flags, unsigned int max_width, unsigned int max_height, int& width, int& height, int& valid_components, const char*& error);
+		static void* downscale(void* rgba, int& width, int& height, unsigned int max_width, unsigned int max_height);
+		static void* expand_rgba(const void* rgb, size_t count);
+		static void* decode_raw(const unsigned char* buffer, size_t len, int components, int& width, int& height, int& valid_components, const char*& error);
+		static void premultiply(void* rgba, size_t count);
+		static void* make_mips(const void* rgba, unsigned int width, unsigned int height, unsigned int& levels);
+		void free_mips();
+		OOBase::SharedPtr<OOGL::Texture> make_mipmapped_texture(GLenum internalFormat, GLsizei levels) const;
+
+		void forget_managed();
+		void stop_managed();
+		size_t texture_bytes(GLenum internalFormat, GLsizei levels) const;
+		void track_texture(const OOBase::SharedPtr<OOGL::Texture>& texture, GLenum internalFormat, size_t bytes) const;
 	};
 }
 
@@ -0,0 +1,64 @@
+///////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2015 Rick Taylor
+//
+// This file is part of the Indigo boardgame engine.
+//
+// Indigo is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Indigo is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Indigo.  If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////////
+
+#ifndef INDIGO_IMAGEATLAS_H_INCLUDED
+#define INDIGO_IMAGEATLAS_H_INCLUDED
+
+#include <OOBase/Vector.h>
+
+#include "Image.h"
+
+namespace Indigo
+{
+	// Packs small RGBA images into shared pages, so they all draw from a handful of textures.
+	// After build(), packed images return their page from make_texture() and their area of it from tex_rect()
+	class ImageAtlas : public OOBase::NonCopyable
+	{
+	public:
+		ImageAtlas(unsigned int page_size = 1024);
+
+		bool add(const OOBase::SharedPtr<Image>& image);
+		bool build();
+		void clear();
+
+	private:
+		unsigned int m_page_size;
+
+		typedef OOBase::Vector<OOBase::SharedPtr<Image>,OOBase::ThreadLocalAllocator> image_vector_t;
+		image_vector_t m_images;
+		image_vector_t m_pages;
+
+		struct Placement
+		{
+			OOBase::SharedPtr<Image> m_image;
+			unsigned int             m_x;
+			unsigned int             m_y;
+		};
+
+		// A page drops its pixels once uploaded, and copies them again from its members when next needed
+		class Page;
+
+		bool build_page(const Placement* placements, size_t count, unsigned int height);
+		static void* compose(const Page& page);
+	};
+}
+
+#endif // INDIGO_IMAGEATLAS_H_INCLUDED
@@ -70,9 +70,11 @@ namespace Indigo
 		OOBase::SharedPtr<ResourceBundle> cd_resource(const char* res_name, OOBase::ScopedString& filename);
 		
 		OOBase::SharedPtr<Image> load_image(const OOBase::ScopedString& image_name);
+		OOBase::SharedPtr<Image> load_image(const OOBase::ScopedString& image_name, unsigned int flags);
 		OOBase::SharedPtr<Font> load_font(const OOBase::ScopedString& font_name);
 
 		virtual bool load_top_level(const char*& p, const char* pe, const OOBase::ScopedString& type) = 0;
+		virtual bool on_loaded() { return true; }
 		
 	private:
 		typedef OOBase::HashTable<size_t,OOBase::SharedPtr<Image>,OOBase::ThreadLocalAllocator> image_hash_t;
@@ -33,7 +33,8 @@ namespace Indigo
 		public:
 			Quad();
 
-			void draw(OOGL::State& state, const OOBase::SharedPtr<OOGL::Texture>& texture, const glm::mat4& mvp, const glm::vec4& colour) const;
+			// tex_rect is (u0,v0,u1,v1), for images packed into an atlas
+			void draw(OOGL::State& state, const OOBase::SharedPtr<OOGL::Texture>& texture, const glm::mat4& mvp, const glm::vec4& colour, const glm::vec4& tex_rect = glm::vec4(0.f,0.f,1.f,1.f)) const;
 
 		private:
 			void* const m_factory;
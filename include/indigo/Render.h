@@ -29,6 +29,12 @@ namespace Indigo
 	const OOBase::SharedPtr<Pipe>& render_pipe();
 	const OOBase::SharedPtr<Pipe>& logic_pipe();
 
+	// Count of frames drawn by the render thread
+	OOBase::uint64_t render_frame();
+
+	// True once the GPU has finished every command issued during frame
+	bool render_frame_complete(OOBase::uint64_t frame);
+
 #if !defined(NDEBUG)
 	void assert_render_thread();
 #endif
@@ -0,0 +1,100 @@
+///////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2015 Rick Taylor
+//
+// This file is part of the Indigo boardgame engine.
+//
+// Indigo is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Indigo is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Indigo.  If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////////
+
+#ifndef INDIGO_TEXTUREMANAGER_H_INCLUDED
+#define INDIGO_TEXTUREMANAGER_H_INCLUDED
+
+#include <OOBase/Vector.h>
+#include <OOGL/Texture.h>
+
+namespace Indigo
+{
+	class Image;
+
+	namespace Render
+	{
+		class TextureManager;
+
+		// A texture made from an Image, which the TextureManager may drop while it is not being drawn.
+		// get() makes it again from the Image when needed, and marks it as drawn this frame.
+		// Unless block is set it returns no texture while discarded pixels are decoded again, so skip drawing
+		class ManagedTexture : public OOBase::NonCopyable
+		{
+			friend class TextureManager;
+
+		public:
+			ManagedTexture(const Image* image, GLenum internalFormat, GLsizei levels, GLenum min_filter);
+
+			const OOBase::SharedPtr<OOGL::Texture>& get(bool block = false);
+
+		private:
+			const Image*     m_image;
+			GLenum           m_internal_format;
+			GLsizei          m_levels;
+			GLenum           m_min_filter;
+			OOBase::uint64_t m_last_drawn;
+
+			OOBase::SharedPtr<OOGL::Texture> m_texture;
+		};
+
+		// Tracks the memory of every texture made by Image, and evicts the least recently drawn
+		// ManagedTextures once the total is over budget.  Render thread only
+		class TextureManager : public OOBase::NonCopyable
+		{
+		public:
+			TextureManager();
+
+			static TextureManager& instance();
+
+			// 0 for no limit
+			void budget(size_t bytes) { m_budget = bytes; }
+			size_t budget() const { return m_budget; }
+			size_t resident();
+
+			OOBase::SharedPtr<ManagedTexture> acquire(const Image* image, GLenum internalFormat, GLsizei levels, GLenum min_filter);
+			void forget(const Image* image);
+
+			bool track(const Image* image, const OOBase::SharedPtr<OOGL::Texture>& texture, GLenum internalFormat, unsigned int width, unsigned int height, size_t bytes);
+			void trim();
+
+			// Logs the size of each live texture, and how long since it was drawn
+			void report();
+
+		private:
+			size_t m_budget;
+			size_t m_prune_at;
+
+			struct Entry
+			{
+				OOBase::WeakPtr<OOGL::Texture> m_texture;
+				const Image*                   m_image;
+				GLenum                         m_format;
+				unsigned int                   m_width;
+				unsigned int                   m_height;
+				size_t                         m_bytes;
+			};
+			OOBase::Vector<Entry,OOBase::ThreadLocalAllocator> m_entries;
+			OOBase::Vector<OOBase::WeakPtr<ManagedTexture>,OOBase::ThreadLocalAllocator> m_managed;
+		};
+	}
+}
+
+#endif // INDIGO_TEXTUREMANAGER_H_INCLUDED
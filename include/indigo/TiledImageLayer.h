@@ -0,0 +1,60 @@
+///////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2015 Rick Taylor
+//
+// This file is part of the Indigo boardgame engine.
+//
+// Indigo is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Indigo is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Indigo.  If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////////
+
+#ifndef INDIGO_TILEDIMAGELAYER_H_INCLUDED
+#define INDIGO_TILEDIMAGELAYER_H_INCLUDED
+
+#include "Window.h"
+
+namespace Indigo
+{
+	class Image;
+
+	// Draws a 4 component image too large for one texture, as tiles of tile_size pixels.
+	// Only the tiles of the mip level that suits the window are uploaded, a few each frame,
+	// over a single tile of the whole image, and at most max_tiles are kept once off screen.
+	// The image must be loaded from a resource with Image::eLF_mipmaps, ideally by load_async().
+	// Once the view is drawn, the pixels of the finer levels are freed, so the image holds about
+	// 4/3 of the level in view. Zooming in decodes them again in the background
+	class TiledImageLayer : public Layer
+	{
+	public:
+		TiledImageLayer(const OOBase::SharedPtr<Image>& image, const glm::vec4& colour = glm::vec4(1.f), unsigned int tile_size = 512, unsigned int max_tiles = 64);
+		~TiledImageLayer();
+
+		glm::vec4 colour(const glm::vec4& colour);
+
+		// The area of the image that fills the window, (u0,v0,u1,v1), for panning and zooming
+		glm::vec4 view(const glm::vec4& view);
+
+	private:
+		OOBase::SharedPtr<Image> m_image;
+		glm::vec4 m_colour;
+		glm::vec4 m_view;
+		unsigned int m_tile_size;
+		unsigned int m_max_tiles;
+
+		OOBase::SharedPtr<Render::Layer> create_render_layer(Render::Window* window);
+		void detach();
+	};
+}
+
+#endif // INDIGO_TILEDIMAGELAYER_H_INCLUDED
@@ -47,6 +47,27 @@ namespace Indigo
 		OOBase::uint64_t size(const char* name) const;
 		bool exists(const char* name) const;
 
+		// Inflated entries are kept for the next load, up to a budget in bytes, 0 for none.
+		// The cache belongs to the archive, so every sub_dir() shares it
+		struct CacheStats
+		{
+			size_t           m_budget;
+			size_t           m_bytes;
+			OOBase::uint64_t m_hits;
+			OOBase::uint64_t m_misses;
+		};
+		void cache_budget(size_t bytes);
+		CacheStats cache_stats() const;
+
+		// Loads count entries at once, inflating them in parallel on the decode threads.
+		// results[n] is empty for any entry that is missing or fails to load
+		bool load_many(const char* const* names, size_t count, OOBase::SharedPtr<const char>* results) const;
+
+		// A raw DEFLATE decoder, returning the bytes written to dest or size_t(-1) on error.
+		// Set NULL for the built in decoder.  Set it before loading anything, as loads run on several threads
+		typedef size_t (*inflate_fn)(const unsigned char* src, size_t src_len, unsigned char* dest, size_t dest_len);
+		static void inflater(inflate_fn fn);
+
 	private:
 		OOBase::SharedPtr<detail::ZipFile> m_zip;
 		OOBase::String m_prefix;
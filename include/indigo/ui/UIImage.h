@@ -26,6 +26,7 @@
 
 #include "../Quad.h"
 #include "../Image.h"
+#include "../TextureManager.h"
 
 namespace Indigo
 {
@@ -34,12 +35,13 @@ namespace Indigo
 		class UIImage : public UIDrawable
 		{
 		public:
-			UIImage(const OOBase::SharedPtr<OOGL::Texture>& texture, const glm::vec4& colour = glm::vec4(1.f), bool visible = true, const glm::ivec2& position = glm::ivec2(), const glm::uvec2& size = glm::uvec2());
+			UIImage(const OOBase::SharedPtr<ManagedTexture>& texture, const glm::vec4& colour = glm::vec4(1.f), bool visible = true, const glm::ivec2& position = glm::ivec2(), const glm::uvec2& size = glm::uvec2(), const glm::vec4& tex_rect = glm::vec4(0.f,0.f,1.f,1.f));
 
 		protected:
 			Quad m_quad;
-			OOBase::SharedPtr<OOGL::Texture> m_texture;
+			OOBase::SharedPtr<ManagedTexture> m_texture;
 			glm::vec4 m_colour;
+			glm::vec4 m_tex_rect;
 
 			virtual void on_draw(OOGL::State& glState, const glm::mat4& mvp) const;
 		};
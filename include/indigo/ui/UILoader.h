@@ -23,6 +23,7 @@
 #define INDIGO_UILOADER_H_INCLUDED
 
 #include "../Parser.h"
+#include "../ImageAtlas.h"
 #include "UIButton.h"
 #include "UILayer.h"
 
@@ -54,6 +55,10 @@ namespace Indigo
 		typedef OOBase::HashTable<size_t,OOBase::SharedPtr<NinePatch>,OOBase::ThreadLocalAllocator> ninepatch_hash_t;
 		ninepatch_hash_t m_hash9Patches;
 
+		ImageAtlas m_atlas;
+
+		virtual bool on_loaded();
+
 		bool parse_create_params(const OOBase::ScopedString& arg, const char*& p, const char* pe, UIWidget::CreateParams& params);
 
 		bool load_top_level(const char*& p, const char* pe, const OOBase::ScopedString& type);
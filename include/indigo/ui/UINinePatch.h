@@ -23,6 +23,7 @@
 #define INDIGO_NinePatch_H_INCLUDED
 
 #include "../Image.h"
+#include "../TextureManager.h"
 
 #include "UIWidget.h"
 
@@ -53,11 +54,16 @@ namespace Indigo
 
 		OOBase::SharedPtr<Render::UIDrawable> make_drawable(const glm::vec4& colour = glm::vec4(1.f), bool visible = true, const glm::ivec2& position = glm::ivec2(), const glm::uvec2& size = glm::uvec2()) const;
 
+	protected:
+		virtual void* reload_pixels(unsigned int& width, unsigned int& height) const;
+
 	private:
-		bool pixel_cmp(int x, int y, bool black);
-		bool scan_line(int line, glm::uvec2& span);
-		bool scan_column(int column, glm::uvec2& span);
+		void classify(unsigned int first, unsigned int step, unsigned int count, unsigned char* black) const;
+		bool scan_line(unsigned int line, glm::uvec2& span, unsigned char* black) const;
+		bool scan_column(unsigned int column, glm::uvec2& span, unsigned char* black) const;
 		bool get_bounds();
+		bool load_cached(size_t hash, const OOBase::SharedPtr<const unsigned char>& buffer, size_t len, int components);
+		void* crop(const void* pixels, unsigned int width) const;
 
 		glm::uvec4 m_margins;
 		
@@ -76,15 +82,16 @@ namespace Indigo
 			friend class Indigo::NinePatch;
 
 		public:
-			UINinePatch(const OOBase::SharedPtr<OOGL::Texture>& texture, const glm::vec4& colour, const OOBase::SharedPtr<NinePatch::Info>& info, bool visible = true, const glm::ivec2& position = glm::ivec2(), const glm::uvec2& size = glm::uvec2());
+			UINinePatch(const OOBase::SharedPtr<ManagedTexture>& texture, const glm::vec4& colour, const OOBase::SharedPtr<NinePatch::Info>& info, bool visible = true, const glm::ivec2& position = glm::ivec2(), const glm::uvec2& size = glm::uvec2(), const glm::vec4& tex_rect = glm::vec4(0.f,0.f,1.f,1.f));
 			virtual ~UINinePatch();
 
 			virtual void size(const glm::uvec2& size);
 
 		private:
 			void* const m_factory;
-			OOBase::SharedPtr<OOGL::Texture> m_texture;
+			OOBase::SharedPtr<ManagedTexture> m_texture;
 			glm::vec4  m_colour;
+			glm::vec4  m_tex_rect;
 			GLsizei    m_patch;
 			GLsizeiptr m_firsts[3];
 			GLsizei    m_counts[3];
@@ -72,7 +72,10 @@ namespace
 		{ "3d_colour.vert", IDR_3D_COLOUR_VS, RT_RCDATA, NULL, NULL, 0 },
 		{ "colour_blend.frag", IDR_COLOUR_BLEND_FS, RT_RCDATA, NULL, NULL, 0 },
 		{ "font_red_blend.frag", IDR_FONT_RED_BLEND_FS, RT_RCDATA, NULL, NULL, 0 },
-		{ "colour.frag", IDR_COLOUR_FS, RT_RCDATA, NULL, NULL, 0 }
+		{ "colour.frag", IDR_COLOUR_FS, RT_RCDATA, NULL, NULL, 0 },
+		{ "font_sdf_blend.frag", IDR_FONT_SDF_BLEND_FS, RT_RCDATA, NULL, NULL, 0 },
+		{ "font_shadow_blend.frag", IDR_FONT_SHADOW_BLEND_FS, RT_RCDATA, NULL, NULL, 0 },
+		{ "2d_textured_rect.vert", IDR_2D_TEX_RECT_VS, RT_RCDATA, NULL, NULL, 0 }
 	};
 
 	const RES* find_resource(const char* name)
@@ -104,6 +107,9 @@ namespace
 	#include "./resources/font_red_blend.frag.h"
 	#include "./resources/colour_blend.frag.h"
 	#include "./resources/colour.frag.h"
+	#include "./resources/font_sdf_blend.frag.h"
+	#include "./resources/font_shadow_blend.frag.h"
+	#include "./resources/2d_textured_rect.vert.h"
 
 	struct RES
 	{
@@ -117,7 +123,10 @@ namespace
 		{ "3d_colour.vert", s_3d_colour_vert, sizeof(s_3d_colour_vert) },
 		{ "font_red_blend.frag", s_font_red_blend_frag, sizeof(s_font_red_blend_frag) },
 		{ "colour_blend.frag", s_colour_blend_frag, sizeof(s_colour_blend_frag) },
-		{ "colour.frag", s_colour_frag, sizeof(s_colour_frag) }
+		{ "colour.frag", s_colour_frag, sizeof(s_colour_frag) },
+		{ "font_sdf_blend.frag", s_font_sdf_blend_frag, sizeof(s_font_sdf_blend_frag) },
+		{ "font_shadow_blend.frag", s_font_shadow_blend_frag, sizeof(s_font_shadow_blend_frag) },
+		{ "2d_textured_rect.vert", s_2d_textured_rect_vert, sizeof(s_2d_textured_rect_vert) }
 	};
 
 	const RES* find_resource(const char* name)
@@ -0,0 +1,13 @@
+#version 120
+
+uniform sampler2D texture0;
+
+varying vec4 pass_Colour;
+varying vec2 pass_TexCoord;
+
+void main()
+{
+	float dist = texture2D(texture0,pass_TexCoord).r;
+	float edge = fwidth(dist) * 0.7;
+	gl_FragColor = vec4(pass_Colour.rgb,smoothstep(0.5 - edge,0.5 + edge,dist) * pass_Colour.a);
+}
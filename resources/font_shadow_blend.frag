@@ -0,0 +1,17 @@
+#version 120
+
+uniform sampler2D texture0;
+uniform vec4 in_Shadow;
+uniform vec2 in_Drop;
+
+varying vec4 pass_Colour;
+varying vec2 pass_TexCoord;
+
+void main()
+{
+	float text = texture2D(texture0,pass_TexCoord).r * pass_Colour.a;
+	float shadow = texture2D(texture0,pass_TexCoord - in_Drop).r * in_Shadow.a * (1.0 - text);
+	float alpha = text + shadow;
+	vec3 colour = (alpha > 0.0) ? (pass_Colour.rgb * text + in_Shadow.rgb * shadow) / alpha : pass_Colour.rgb;
+	gl_FragColor = vec4(colour,alpha);
+}
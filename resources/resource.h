@@ -7,6 +7,9 @@
 #define IDR_3D_COLOUR_VS                103
 #define IDR_FONT_RED_BLEND_FS           104
 #define IDR_COLOUR_FS                   105
+#define IDR_FONT_SDF_BLEND_FS           106
+#define IDR_FONT_SHADOW_BLEND_FS        107
+#define IDR_2D_TEX_RECT_VS              108
 
 // Next default values for new objects
 // 
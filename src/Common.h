@@ -56,4 +56,28 @@
 
 #include <stdlib.h>
 
+namespace OOGL
+{
+	class Texture;
+}
+
+namespace Indigo
+{
+	// Internal functions shared between translation units
+	namespace detail
+	{
+		// UTF8.cpp
+		bool drawable_glyph(OOBase::uint32_t glyph);
+		OOBase::uint32_t utf8_decode(const unsigned char*& sz, const unsigned char* end);
+		size_t utf8_to_glyphs(const char* s, size_t s_len, OOBase::uint32_t* glyphs, GLsizei& drawable);
+
+		// Inflate.cpp
+		size_t inflate(const unsigned char* src, size_t src_len, unsigned char* dest, size_t dest_len);
+
+		// Image.cpp
+		bool run_on_decode_pool(void (*callback)(void* p), void* param);
+		bool texture_streaming(const OOGL::Texture* texture);
+	}
+}
+
 #endif // INDIGO_COMMON_H_INCLUDED
@@ -0,0 +1,579 @@
+///////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2015 Rick Taylor
+//
+// This file is part of the Indigo boardgame engine.
+//
+// Indigo is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Indigo is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Indigo.  If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////////
+
+#include "../include/indigo/Image.h"
+#include "../include/indigo/Render.h"
+
+#include "Common.h"
+
+#include <OOGL/Window.h>
+
+#if !defined(GL_COMPRESSED_RGB_S3TC_DXT1_EXT)
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT  0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
+#define GL_COMPRESSED_RGBA_S3TC_DXT3_EXT 0x83F2
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+#if !defined(GL_COMPRESSED_RGBA_BPTC_UNORM)
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+
+#if !defined(GL_COMPRESSED_RGB8_ETC2)
+#define GL_COMPRESSED_RGB8_ETC2                     0x9274
+#define GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2 0x9276
+#define GL_COMPRESSED_RGBA8_ETC2_EAC                0x9278
+#endif
+
+struct Indigo::Image::Compressed
+{
+	static const unsigned int max_levels = 16;
+
+	OOBase::SharedPtr<const unsigned char> m_buffer;
+	GLenum               m_format;
+	unsigned int         m_levels;
+	const unsigned char* m_level_data[max_levels];
+	GLsizei              m_level_size[max_levels];
+};
+
+namespace
+{
+	const unsigned char ktx_magic[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+	const size_t ktx_header_size = 64;
+	const size_t dds_header_size = 128;
+	const size_t dds_dx10_header_size = 148;
+
+	// Raw textures cooked by tools/texcook.c, all little-endian:
+	//   0  char[4]  "ITEX"
+	//   4  uint32   version (1)
+	//   8  uint32   width
+	//  12  uint32   height
+	//  16  uint32   GL internal format
+	//  20  uint32   GL pixel format
+	//  24  uint32   GL pixel type (GL_UNSIGNED_BYTE)
+	//  28  uint32   mip level count
+	//  32  uint32   flags (reserved)
+	//  36  uint32   offset of the first level
+	// Levels follow largest first, each tightly packed with no row padding
+	const size_t raw_header_size = 40;
+	const OOBase::uint32_t raw_version = 1;
+
+	OOBase::uint32_t read_u32(const unsigned char* p)
+	{
+		return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<OOBase::uint32_t>(p[3]) << 24);
+	}
+
+	bool compressed_layout(GLenum format, unsigned int& block_bytes, unsigned int& components)
+	{
+		switch (format)
+		{
+		case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_RGB8_ETC2:
+			block_bytes = 8;
+			components = 3;
+			return true;
+
+		case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2:
+			block_bytes = 8;
+			components = 4;
+			return true;
+
+		case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+		case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+		case GL_COMPRESSED_RGBA_BPTC_UNORM:
+		case GL_COMPRESSED_RGBA8_ETC2_EAC:
+			block_bytes = 16;
+			components = 4;
+			return true;
+
+		default:
+			return false;
+		}
+	}
+
+	unsigned int raw_components(GLenum format)
+	{
+		switch (format)
+		{
+		case GL_RED:
+			return 1;
+
+		case GL_RG:
+			return 2;
+
+		case GL_RGB:
+			return 3;
+
+		case GL_RGBA:
+			return 4;
+
+		default:
+			return 0;
+		}
+	}
+
+	const char* raw_header(const unsigned char* data, size_t len, unsigned int& width, unsigned int& height, unsigned int& components, size_t& offset)
+	{
+		if (len < raw_header_size || memcmp(data,"ITEX",4) != 0)
+			return "Not a raw texture";
+
+		if (read_u32(data + 4) != raw_version)
+			return "Unsupported raw texture version";
+
+		width = read_u32(data + 8);
+		height = read_u32(data + 12);
+		components = raw_components(read_u32(data + 20));
+		if (!components || read_u32(data + 24) != GL_UNSIGNED_BYTE)
+			return "Unsupported raw texture format";
+
+		offset = read_u32(data + 36);
+		if (offset < raw_header_size || offset > len)
+			return "Truncated raw texture";
+
+		return NULL;
+	}
+
+	bool compressed_supported(GLenum format)
+	{
+		switch (format)
+		{
+		case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+		case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+			return glfwExtensionSupported("GL_EXT_texture_compression_s3tc") == GL_TRUE;
+
+		case GL_COMPRESSED_RGBA_BPTC_UNORM:
+			return glfwExtensionSupported("GL_ARB_texture_compression_bptc") == GL_TRUE;
+
+		case GL_COMPRESSED_RGB8_ETC2:
+		case GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2:
+		case GL_COMPRESSED_RGBA8_ETC2_EAC:
+			return glfwExtensionSupported("GL_ARB_ES3_compatibility") == GL_TRUE;
+
+		default:
+			return false;
+		}
+	}
+
+	GLenum dds_format(const unsigned char* buffer, size_t len, size_t& offset)
+	{
+		// DDPF_FOURCC
+		if (!(read_u32(buffer + 80) & 0x4))
+			return 0;
+
+		offset = dds_header_size;
+		const unsigned char* fourcc = buffer + 84;
+		if (memcmp(fourcc,"DXT1",4) == 0)
+			return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+		if (memcmp(fourcc,"DXT3",4) == 0)
+			return GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+		if (memcmp(fourcc,"DXT5",4) == 0)
+			return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+		if (memcmp(fourcc,"DX10",4) != 0 || len < dds_dx10_header_size)
+			return 0;
+
+		offset = dds_dx10_header_size;
+		switch (read_u32(buffer + dds_header_size))
+		{
+		case 70: // DXGI_FORMAT_BC1_TYPELESS
+		case 71: // DXGI_FORMAT_BC1_UNORM
+			return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+
+		case 73: // DXGI_FORMAT_BC2_TYPELESS
+		case 74: // DXGI_FORMAT_BC2_UNORM
+			return GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+
+		case 76: // DXGI_FORMAT_BC3_TYPELESS
+		case 77: // DXGI_FORMAT_BC3_UNORM
+			return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+
+		case 97: // DXGI_FORMAT_BC7_TYPELESS
+		case 98: // DXGI_FORMAT_BC7_UNORM
+			return GL_COMPRESSED_RGBA_BPTC_UNORM;
+
+		default:
+			return 0;
+		}
+	}
+
+	void decode_bc_colour(const unsigned char* block, unsigned char* dest, size_t stride, bool dxt1)
+	{
+		unsigned int c[2] = { block[0] | (block[1] << 8u), block[2] | (block[3] << 8u) };
+
+		unsigned char palette[4][4];
+		for (int i = 0;i < 2;++i)
+		{
+			palette[i][0] = static_cast<unsigned char>(((c[i] >> 11) & 0x1F) * 255 / 31);
+			palette[i][1] = static_cast<unsigned char>(((c[i] >> 5) & 0x3F) * 255 / 63);
+			palette[i][2] = static_cast<unsigned char>((c[i] & 0x1F) * 255 / 31);
+			palette[i][3] = 0xFF;
+		}
+
+		for (int j = 0;j < 3;++j)
+		{
+			if (!dxt1 || c[0] > c[1])
+			{
+				palette[2][j] = static_cast<unsigned char>((2 * palette[0][j] + palette[1][j]) / 3);
+				palette[3][j] = static_cast<unsigned char>((palette[0][j] + 2 * palette[1][j]) / 3);
+			}
+			else
+			{
+				palette[2][j] = static_cast<unsigned char>((palette[0][j] + palette[1][j]) / 2);
+				palette[3][j] = 0;
+			}
+		}
+		palette[2][3] = 0xFF;
+		palette[3][3] = (!dxt1 || c[0] > c[1]) ? 0xFF : 0;
+
+		OOBase::uint32_t indices = read_u32(block + 4);
+		for (int y = 0;y < 4;++y)
+		{
+			for (int x = 0;x < 4;++x, indices >>= 2)
+				memcpy(dest + y * stride + x * 4,palette[indices & 3],4);
+		}
+	}
+
+	void decode_bc_alpha(const unsigned char* block, unsigned char* dest, size_t stride, bool dxt5)
+	{
+		if (!dxt5)
+		{
+			// Explicit 4 bit alpha
+			for (int y = 0;y < 4;++y)
+			{
+				for (int x = 0;x < 4;++x)
+				{
+					unsigned int a = (block[y * 2 + x / 2] >> ((x & 1) * 4)) & 0xF;
+					dest[y * stride + x * 4 + 3] = static_cast<unsigned char>(a * 17);
+				}
+			}
+			return;
+		}
+
+		unsigned char alpha[8] = { block[0], block[1] };
+		if (alpha[0] > alpha[1])
+		{
+			for (int i = 1;i < 7;++i)
+				alpha[i + 1] = static_cast<unsigned char>(((7 - i) * alpha[0] + i * alpha[1]) / 7);
+		}
+		else
+		{
+			for (int i = 1;i < 5;++i)
+				alpha[i + 1] = static_cast<unsigned char>(((5 - i) * alpha[0] + i * alpha[1]) / 5);
+			alpha[6] = 0;
+			alpha[7] = 0xFF;
+		}
+
+		OOBase::uint64_t indices = 0;
+		for (int i = 5;i >= 0;--i)
+			indices = (indices << 8) | block[2 + i];
+
+		for (int y = 0;y < 4;++y)
+		{
+			for (int x = 0;x < 4;++x, indices >>= 3)
+				dest[y * stride + x * 4 + 3] = alpha[indices & 7];
+		}
+	}
+
+	// Software fallback for drivers without S3TC, decodes to RGBA
+	bool decode_bc(GLenum format, const unsigned char* src, unsigned int width, unsigned int height, unsigned char* dest)
+	{
+		bool dxt1 = (format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT);
+		if (!dxt1 && format != GL_COMPRESSED_RGBA_S3TC_DXT3_EXT && format != GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+			return false;
+
+		size_t stride = width * 4;
+		unsigned char block[16 * 4];
+		for (unsigned int by = 0;by < height;by += 4)
+		{
+			for (unsigned int bx = 0;bx < width;bx += 4)
+			{
+				if (dxt1)
+				{
+					decode_bc_colour(src,block,16,true);
+					src += 8;
+				}
+				else
+				{
+					decode_bc_colour(src + 8,block,16,false);
+					decode_bc_alpha(src,block,16,format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT);
+					src += 16;
+				}
+
+				// Clip partial blocks at the right and bottom edges
+				for (unsigned int y = 0;y < 4 && by + y < height;++y)
+				{
+					unsigned int w = (width - bx < 4 ? width - bx : 4);
+					memcpy(dest + (by + y) * stride + bx * 4,block + y * 16,w * 4);
+				}
+			}
+		}
+		return true;
+	}
+}
+
+bool Indigo::Image::is_compressed(const unsigned char* buffer, size_t len)
+{
+	return (len >= ktx_header_size && memcmp(buffer,ktx_magic,sizeof(ktx_magic)) == 0) ||
+			(len >= dds_header_size && memcmp(buffer,"DDS ",4) == 0) ||
+			(len >= raw_header_size && memcmp(buffer,"ITEX",4) == 0);
+}
+
+bool Indigo::Image::load_compressed(const OOBase::SharedPtr<const unsigned char>& buffer, size_t len)
+{
+	unload();
+
+	const unsigned char* data = buffer.get();
+	const unsigned char* end = data + len;
+	unsigned int width = 0;
+	unsigned int height = 0;
+	unsigned int levels = 0;
+	GLenum format = 0;
+	const unsigned char* p = NULL;
+	bool ktx = (memcmp(data,ktx_magic,sizeof(ktx_magic)) == 0);
+	bool raw = (memcmp(data,"ITEX",4) == 0);
+
+	unsigned int block_bytes = 0;
+	unsigned int components = 0;
+
+	if (raw)
+	{
+		size_t offset = 0;
+		const char* error = raw_header(data,len,width,height,components,offset);
+		if (error)
+			LOG_ERROR_RETURN(("Failed to load image: %s",error),false);
+
+		levels = read_u32(data + 28);
+		p = data + offset;
+	}
+	else if (ktx)
+	{
+		if (read_u32(data + 12) != 0x04030201)
+			LOG_ERROR_RETURN(("Failed to load image: Byte swapped KTX files are not supported"),false);
+
+		// glType, depth, array elements, faces
+		if (read_u32(data + 16) != 0 || read_u32(data + 44) > 1 || read_u32(data + 48) != 0 || read_u32(data + 52) != 1)
+			LOG_ERROR_RETURN(("Failed to load image: Only compressed 2D KTX textures are supported"),false);
+
+		format = read_u32(data + 28);
+		width = read_u32(data + 36);
+		height = read_u32(data + 40);
+		levels = read_u32(data + 56);
+
+		OOBase::uint32_t kv_len = read_u32(data + 60);
+		if (kv_len > len - ktx_header_size)
+			LOG_ERROR_RETURN(("Failed to load image: Truncated KTX file"),false);
+		p = data + ktx_header_size + kv_len;
+	}
+	else
+	{
+		size_t offset = 0;
+		format = dds_format(data,len,offset);
+		height = read_u32(data + 12);
+		width = read_u32(data + 16);
+		levels = (read_u32(data + 8) & 0x20000) ? read_u32(data + 28) : 1;
+		p = data + offset;
+	}
+
+	if (!raw && !compressed_layout(format,block_bytes,components))
+		LOG_ERROR_RETURN(("Failed to load image: Unsupported compressed format 0x%X",format),false);
+
+	if (!width || !height)
+		LOG_ERROR_RETURN(("Failed to load image: Invalid dimensions"),false);
+
+	if (!levels)
+		levels = 1;
+	if (levels > Compressed::max_levels)
+		levels = Compressed::max_levels;
+
+	Compressed* c = OOBase::ThreadLocalAllocator::allocate_new<Compressed>();
+	if (!c)
+		LOG_ERROR_RETURN(("Failed to allocate: %s",OOBase::system_error_text()),false);
+
+	c->m_buffer = buffer;
+	c->m_format = format;
+	c->m_levels = 0;
+
+	for (unsigned int level = 0;level < levels;++level)
+	{
+		unsigned int w = (width >> level) ? (width >> level) : 1;
+		unsigned int h = (height >> level) ? (height >> level) : 1;
+		size_t size = raw ? w * h * components : ((w + 3) / 4) * ((h + 3) / 4) * block_bytes;
+
+		if (ktx)
+		{
+			if (end - p < 4)
+				break;
+			size_t image_size = read_u32(p);
+			p += 4;
+			if (image_size < size)
+				break;
+			size = image_size;
+		}
+
+		if (static_cast<size_t>(end - p) < size)
+			break;
+
+		c->m_level_data[level] = p;
+		c->m_level_size[level] = static_cast<GLsizei>(size);
+		++c->m_levels;
+
+		p += (ktx ? (size + 3) & ~size_t(3) : size);
+	}
+
+	if (!c->m_levels)
+	{
+		OOBase::ThreadLocalAllocator::delete_free(c);
+		LOG_ERROR_RETURN(("Failed to load image: Truncated compressed image"),false);
+	}
+
+	if (raw)
+	{
+		// Raw texels are the image's pixels, used in place, so they can be sampled, atlased and tiled like any other
+		m_pixels = const_cast<unsigned char*>(c->m_level_data[0]);
+		if (components == 4 && c->m_levels > 1)
+		{
+			m_mips = const_cast<unsigned char*>(c->m_level_data[1]);
+			m_mip_levels = c->m_levels - 1;
+		}
+		m_mapped = buffer;
+
+		OOBase::ThreadLocalAllocator::delete_free(c);
+	}
+	else
+		m_compressed = c;
+
+	m_width = width;
+	m_height = height;
+	m_components = components;
+	m_valid_components = components;
+
+	return true;
+}
+
+void* Indigo::Image::decode_raw(const unsigned char* buffer, size_t len, int components, int& width, int& height, int& valid_components, const char*& error)
+{
+	// Copies level 0, for loaders that need pixels of their own, such as NinePatch
+	unsigned int w = 0, h = 0, c = 0;
+	size_t offset = 0;
+	error = raw_header(buffer,len,w,h,c,offset);
+	if (error)
+		return NULL;
+
+	if (components && static_cast<unsigned int>(components) != c)
+	{
+		error = "Raw textures can't be converted to other component counts";
+		return NULL;
+	}
+
+	size_t size = static_cast<size_t>(w) * h * c;
+	if (!size || len - offset < size)
+	{
+		error = "Truncated raw texture";
+		return NULL;
+	}
+
+	void* p = OOBase::CrtAllocator::allocate(size,16);
+	if (!p)
+	{
+		error = "Out of memory";
+		return NULL;
+	}
+
+	memcpy(p,buffer + offset,size);
+	width = w;
+	height = h;
+	valid_components = c;
+	return p;
+}
+
+void Indigo::Image::free_compressed()
+{
+	if (m_compressed)
+	{
+		OOBase::ThreadLocalAllocator::delete_free(m_compressed);
+		m_compressed = NULL;
+	}
+}
+
+OOBase::SharedPtr<OOGL::Texture> Indigo::Image::make_compressed_texture(bool& cached, GLsizei levels) const
+{
+	ASSERT_RENDER_THREAD();
+
+	OOBase::SharedPtr<OOGL::Texture> tex;
+	if (cached)
+	{
+		tex = m_texture.lock();
+		if (tex)
+			return tex;
+
+		cached = false;
+	}
+
+	if (!compressed_supported(m_compressed->m_format))
+	{
+		OOBase::ScopedArrayPtr<unsigned char,OOBase::ThreadLocalAllocator> pixels;
+		if (!pixels.resize(m_width * m_height * 4))
+			LOG_ERROR_RETURN(("Failed to allocate: %s",OOBase::system_error_text()),tex);
+
+		if (!decode_bc(m_compressed->m_format,m_compressed->m_level_data[0],m_width,m_height,pixels.get()))
+			LOG_ERROR_RETURN(("Compressed texture format 0x%X is not supported by the driver",m_compressed->m_format),tex);
+
+		LOG_WARNING(("Compressed textures are not supported by the driver, decoding in software"));
+
+		tex = OOBase::allocate_shared<OOGL::Texture,OOBase::ThreadLocalAllocator>(GL_TEXTURE_2D,levels,GL_RGBA8,m_width,m_height,GL_RGBA,GL_UNSIGNED_BYTE,static_cast<const void*>(pixels.get()));
+		if (!tex)
+			LOG_ERROR_RETURN(("Failed to allocate texture"),tex);
+
+		track_texture(tex,GL_RGBA8,texture_bytes(GL_RGBA8,levels));
+		m_texture = tex;
+		return tex;
+	}
+
+	GLsizei count = static_cast<GLsizei>(m_compressed->m_levels);
+	if (levels > 0 && levels < count)
+		count = levels;
+
+	tex = OOBase::allocate_shared<OOGL::Texture,OOBase::ThreadLocalAllocator>(GL_TEXTURE_2D);
+	if (!tex)
+		LOG_ERROR_RETURN(("Failed to allocate texture"),tex);
+
+	OOGL::State::get_current()->bind(0,tex);
+
+	size_t bytes = 0;
+	for (GLsizei level = 0;level < count;++level)
+	{
+		bytes += m_compressed->m_level_size[level];
+
+		GLsizei w = (m_width >> level) ? (m_width >> level) : 1;
+		GLsizei h = (m_height >> level) ? (m_height >> level) : 1;
+		glCompressedTexImage2D(GL_TEXTURE_2D,level,m_compressed->m_format,w,h,0,m_compressed->m_level_size[level],m_compressed->m_level_data[level]);
+	}
+
+	// Only the levels we have, so a short chain is still complete
+	tex->parameter(GL_TEXTURE_BASE_LEVEL,0);
+	tex->parameter(GL_TEXTURE_MAX_LEVEL,count - 1);
+
+	track_texture(tex,m_compressed->m_format,bytes);
+	m_texture = tex;
+	return tex;
+}
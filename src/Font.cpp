@@ -26,6 +26,25 @@
 
 #include "Common.h"
 
+extern "C"
+{
+	static void* wrap_tt_malloc(size_t sz)
+	{
+		return OOBase::ThreadLocalAllocator::allocate(sz);
+	}
+
+	static void wrap_tt_free(void* p)
+	{
+		OOBase::ThreadLocalAllocator::free(p);
+	}
+
+	#define STBTT_malloc(x,u)  ((void)(u),wrap_tt_malloc(x))
+	#define STBTT_free(x,u)    ((void)(u),wrap_tt_free(x))
+
+	#define STB_TRUETYPE_IMPLEMENTATION
+	#include "../3rdparty/stb/stb_truetype.h"
+}
+
 namespace
 {
 	OOBase::uint32_t read_uint32(const unsigned char*& data)
@@ -57,161 +76,792 @@ namespace
 		return static_cast<OOBase::int16_t>(read_uint16(data));
 	}
 
-	const char utf8_data[256] =
-	{
-		// Key:
-		//  0 = Invalid first byte
-		//  1 = Single byte
-		//  2 = 2 byte sequence
-		//  3 = 3 byte sequence
-		//  4 = 4 byte sequence
-
-		// -1 = Continuation byte
-		// -2 = Overlong 2 byte sequence
-		// -3 = 3 byte overlong check (0x80..0x9F) as next byte fail
-		// -4 = 3 byte reserved check (0xA0..0xBF) as next byte fail
-		// -5 = 4 byte overlong check (0x80..0x8F) as next byte fail
-		// -6 = 4 byte reserved check (0x90..0xBF) as next byte fail
-
-		 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 0x00..0x0F
-		 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 0x10..0x1F
-		 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 0x20..0x2F
-		 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 0x30..0x3F
-		 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 0x40..0x4F
-		 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 0x50..0x5F
-		 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 0x60..0x6F
-		 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 0x70..0x7F
-		-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,  // 0x80..0x8F
-		-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,  // 0x90..0x9F
-		-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,  // 0xA0..0xAF
-		-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,  // 0xB0..0xBF
-		-2,-2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,  // 0xC0..0xCF
-		 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,  // 0xD0..0xDF
-		-3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,-4, 3, 3,  // 0xE0..0xEF
-		-5, 4, 4, 4,-6, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0   // 0xF0..0xFF
+	const unsigned int vertices_per_glyph = 4;
+	const unsigned int elements_per_glyph = 6;
+
+	// Glyph pages start at 256 glyphs and double up to 16K glyphs each, the most
+	// that can be addressed by the shared 16-bit element buffer
+	const unsigned int min_page_order = 8;
+	const unsigned int max_page_order = 14;
+	const unsigned int max_glyph_order = max_page_order;
+
+	// Copies of a changing run's glyphs, so one can be rewritten while the GPU may still be drawing the others
+	const unsigned int max_run_copies = 3;
+	const OOBase::uint64_t never_drawn = OOBase::uint64_t(-1);
+
+	const OOBase::uint32_t no_atlas_glyph = OOBase::uint32_t(-1);
+
+	unsigned int glyph_order(GLsizei len)
+	{
+		unsigned int order = 0;
+		while ((GLsizei(1) << order) < len)
+			++order;
+		return order;
+	}
+
+	const unsigned int truetype_default_height = 32;
+
+	// Clear texels around each TrueType glyph's quad, so short drop shadows fit inside it
+	const unsigned int truetype_padding = 2;
+
+	// Dynamic glyph atlas for TrueType fonts
+	const unsigned int atlas_size = 1024;
+	const size_t atlas_max_shelves = atlas_size / 4;
+
+	// Cooked font blobs are written by tools/fontcook.c, version 1 blobs have no padding field
+	const OOBase::uint32_t cooked_version = 2;
+
+	struct cooked_header
+	{
+		char             magic[4];
+		OOBase::uint32_t version;
+		OOBase::uint16_t line_height;
+		OOBase::uint16_t base_height;
+		OOBase::uint32_t packing;
+		OOBase::uint32_t flags;
+		OOBase::uint32_t char_count;
+		OOBase::uint32_t char_offset;
+		OOBase::uint32_t kern_count;
+		OOBase::uint32_t kern_offset;
+		OOBase::uint32_t tex_width;
+		OOBase::uint32_t tex_height;
+		OOBase::uint32_t pixel_offset;
+		OOBase::uint8_t  padding[4];
+	};
+
+	struct cooked_char
+	{
+		OOBase::uint32_t id;
+		OOBase::uint16_t u0;
+		OOBase::uint16_t v0;
+		OOBase::uint16_t u1;
+		OOBase::uint16_t v1;
+		float left;
+		float top;
+		float right;
+		float bottom;
+		float xadvance;
+	};
+
+	struct cooked_kern
+	{
+		OOBase::uint32_t first;
+		OOBase::uint32_t second;
+		float amount;
 	};
 
-	const OOBase::uint32_t utf_subst_val = 0xFFFD;
+	bool is_cooked(const unsigned char* data, size_t len)
+	{
+		return (len >= offsetof(cooked_header,padding) && memcmp(data,"IFNT",4) == 0);
+	}
+
+	bool is_truetype(const unsigned char* data, size_t len)
+	{
+		static const unsigned char ttf_version[4] = { 0, 1, 0, 0 };
+		return (len >= 4 && (memcmp(data,ttf_version,4) == 0 || memcmp(data,"true",4) == 0 || memcmp(data,"OTTO",4) == 0 || memcmp(data,"ttcf",4) == 0));
+	}
+}
+
+struct Indigo::Font::Info::TrueType
+{
+	OOBase::SharedPtr<const unsigned char> m_data;
+	stbtt_fontinfo m_font;
+	float m_scale;
+	float m_ascent;
+
+	int glyph_index(OOBase::uint32_t codepoint) const
+	{
+		int g = stbtt_FindGlyphIndex(&m_font,static_cast<int>(codepoint));
+		if (!g)
+			g = stbtt_FindGlyphIndex(&m_font,'?');
+		return g;
+	}
+};
+
+struct Indigo::Font::Info::Cooked
+{
+	OOBase::SharedPtr<const unsigned char> m_data;
+	const cooked_header* m_header;
+	const cooked_char* m_chars;
+	const cooked_kern* m_kerns;
+	const unsigned char* m_pixels;
+
+	const cooked_char* find(OOBase::uint32_t id) const
+	{
+		const cooked_char* c = m_chars;
+		size_t count = m_header->char_count;
+		while (count)
+		{
+			size_t half = count / 2;
+			if (c[half].id < id)
+			{
+				c += half + 1;
+				count -= half + 1;
+			}
+			else
+				count = half;
+		}
+		return (c < m_chars + m_header->char_count && c->id == id ? c : NULL);
+	}
+};
+
+bool Indigo::Font::Info::find_char(OOBase::uint32_t glyph, struct char_info& ci) const
+{
+	if (m_cooked)
+	{
+		const cooked_char* c = m_cooked->find(glyph);
+		if (!c)
+			c = m_cooked->find('?');
+		if (!c)
+			return false;
+
+		ci.u0 = c->u0;
+		ci.v0 = c->v0;
+		ci.u1 = c->u1;
+		ci.v1 = c->v1;
+		ci.left = c->left;
+		ci.top = c->top;
+		ci.right = c->right;
+		ci.bottom = c->bottom;
+		ci.xadvance = c->xadvance;
+		ci.page = 0;
+		ci.channel = 0;
+		return true;
+	}
 
-	GLsizei utf8_to_glyphs(const char* s, size_t s_len, OOBase::Vector<OOBase::uint32_t,OOBase::ThreadLocalAllocator>& glyphs)
+	if (m_truetype)
 	{
-		GLsizei drawable = 0;
-		const unsigned char* sz = reinterpret_cast<const unsigned char*>(s);
-		const unsigned char* end = sz + s_len;
+		int g = m_truetype->glyph_index(glyph);
 
-		while (sz < end)
+		int advance, lsb, x0, y0, x1, y1;
+		stbtt_GetGlyphHMetrics(&m_truetype->m_font,g,&advance,&lsb);
+		stbtt_GetGlyphBitmapBox(&m_truetype->m_font,g,m_truetype->m_scale,m_truetype->m_scale,&x0,&y0,&x1,&y1);
+		if (x1 > x0 && y1 > y0)
 		{
-			// Default to substitution value
-			OOBase::uint32_t wide_val = utf_subst_val;
-			int l = 0;
+			x0 -= truetype_padding;
+			y0 -= truetype_padding;
+			x1 += truetype_padding;
+			y1 += truetype_padding;
+		}
+
+		float line_height = m_line_height;
+		ci.u0 = ci.v0 = ci.u1 = ci.v1 = 0;
+		ci.left = x0 / line_height;
+		ci.top = (line_height - (m_truetype->m_ascent + y0)) / line_height;
+		ci.right = x1 / line_height;
+		ci.bottom = (line_height - (m_truetype->m_ascent + y1)) / line_height;
+		ci.xadvance = advance * m_truetype->m_scale / line_height;
+		ci.page = 0;
+		ci.channel = 0;
+		return true;
+	}
+
+	char_map_t::const_iterator i = m_mapCharInfo.find(glyph);
+	if (!i)
+		i = m_mapCharInfo.find(static_cast<OOBase::uint8_t>('?'));
+	if (!i)
+		return false;
 
-			unsigned char c = *sz++;
-			switch (utf8_data[c])
+	ci = i->second;
+	return true;
+}
+
+float Indigo::Font::Info::kerning(OOBase::uint32_t prev_glyph, OOBase::uint32_t glyph) const
+{
+	if (m_cooked)
+	{
+		const cooked_kern* k = m_cooked->m_kerns;
+		size_t count = m_cooked->m_header->kern_count;
+		while (count)
+		{
+			size_t half = count / 2;
+			if (k[half].first < prev_glyph || (k[half].first == prev_glyph && k[half].second < glyph))
 			{
-				case 1:
-					wide_val = c;
-					break;
-
-				case 2:
-					wide_val = (c & 0x1F);
-					l = 1;
-					break;
-
-				case -2:
-					++sz;
-					break;
-
-				case 3:
-					wide_val = (c & 0x0F);
-					l = 2;
-					break;
-
-				case -3:
-					if (*sz >= 0x80 && *sz <= 0x9F)
-						sz += 2;
-					else
-					{
-						wide_val = (c & 0x0F);
-						l = 2;
-					}
-					break;
-
-				case 4:
-					wide_val = (c & 0x07);
-					l = 3;
-					break;
-
-				case -4:
-					if (*sz >= 0xA0 && *sz <= 0xBF)
-						sz += 2;
-					else
-					{
-						wide_val = (c & 0x0F);
-						l = 2;
-					}
-					break;
-
-				case -5:
-					if (*sz >= 0x80 && *sz <= 0x8F)
-						sz += 3;
-					else
-					{
-						wide_val = (c & 0x07);
-						l = 3;
-					}
-					break;
-
-				case -6:
-					if (*sz >= 0x90 && *sz <= 0xBF)
-						sz += 3;
-					else
-					{
-						wide_val = (c & 0x07);
-						l = 3;
-					}
-					break;
-
-				default:
-					break;
+				k += half + 1;
+				count -= half + 1;
 			}
+			else
+				count = half;
+		}
+		return (k < m_cooked->m_kerns + m_cooked->m_header->kern_count && k->first == prev_glyph && k->second == glyph ? k->amount : 0.f);
+	}
+
+	if (m_truetype)
+		return stbtt_GetGlyphKernAdvance(&m_truetype->m_font,m_truetype->glyph_index(prev_glyph),m_truetype->glyph_index(glyph)) * m_truetype->m_scale / m_line_height;
+
+	kern_map_t::const_iterator k = m_mapKerning.find(OOBase::Pair<OOBase::uint32_t,OOBase::uint32_t>(prev_glyph,glyph));
+	return (k ? k->second : 0.f);
+}
+
+struct Indigo::Render::Font::GlyphVertex
+{
+	GLfloat x;
+	GLfloat y;
+	GLushort u;
+	GLushort v;
+};
+
+struct Indigo::Render::Font::GlyphRun
+{
+	GlyphRun() : m_page(NULL), m_start(0), m_len(0), m_order(0), m_refcount(0), m_copies(1), m_copy(0), m_hash(0)
+	{}
 
-			while (l-- > 0)
+	GlyphPage*   m_page;
+	GLsizei      m_start;
+	GLsizei      m_len;
+	unsigned int m_order;
+	size_t       m_refcount;
+
+	// A run that has changed keeps copies of its glyphs in its range, and rewrites
+	// one the GPU has finished with, so an update never waits on a draw or reallocates
+	unsigned int m_copies;
+	unsigned int m_copy;
+
+	struct Copy
+	{
+		OOBase::uint64_t m_retired;
+
+		// The glyphs changed since this copy was written
+		GLsizei m_dirty_first;
+		GLsizei m_dirty_last;
+
+		void dirty(GLsizei from, GLsizei to)
+		{
+			if (m_dirty_first >= m_dirty_last)
 			{
-				c = *sz++;
-				if (utf8_data[c] != -1)
-				{
-					wide_val = utf_subst_val;
-					sz += l;
-					break;
-				}
+				m_dirty_first = from;
+				m_dirty_last = to;
+			}
+			else
+			{
+				if (from < m_dirty_first)
+					m_dirty_first = from;
+				if (to > m_dirty_last)
+					m_dirty_last = to;
+			}
+		}
+	};
+	Copy m_copy_info[max_run_copies];
+
+	GLsizei copy_size() const { return (GLsizei(1) << m_order) / static_cast<GLsizei>(m_copies); }
+	GLsizei first() const { return m_start + static_cast<GLsizei>(m_copy) * copy_size(); }
+
+	// Empty if the run is not interned
+	OOBase::String m_key;
+	size_t         m_hash;
+
+	// The glyphs drawn, and the atlas glyph each holds, or no_atlas_glyph
+	OOBase::Vector<PlacedGlyph,OOBase::ThreadLocalAllocator> m_glyphs;
+	OOBase::Vector<OOBase::uint32_t,OOBase::ThreadLocalAllocator> m_atlas_glyphs;
+};
+
+struct Indigo::Render::Font::GlyphPage
+{
+	GlyphPage(unsigned int order) : m_order(order)
+	{}
+
+	OOBase::SharedPtr<OOGL::VertexArrayObject> m_ptrVAO;
+	OOBase::SharedPtr<OOGL::BufferObject> m_ptrVertices;
+
+	// Binary buddy allocator, one free list per power-of-two size class
+	const unsigned int m_order;
+	typedef OOBase::Vector<GLsizei,OOBase::ThreadLocalAllocator> free_list_t;
+	free_list_t m_listFree[max_glyph_order + 1];
+
+	GLsizei alloc(unsigned int order);
+	void free(GLsizei start, unsigned int order);
+};
+
+GLsizei Indigo::Render::Font::GlyphPage::alloc(unsigned int order)
+{
+	unsigned int o = order;
+	while (o <= m_order && m_listFree[o].empty())
+		++o;
+
+	if (o > m_order)
+		return -1;
+
+	GLsizei start = *m_listFree[o].back();
+	m_listFree[o].pop_back();
+
+	// Split down to the requested size class
+	while (o > order)
+	{
+		--o;
+		if (!m_listFree[o].push_back(start + (GLsizei(1) << o)))
+			LOG_WARNING(("Failed to insert glyph range into free list: %s",OOBase::system_error_text()));
+	}
+
+	return start;
+}
+
+void Indigo::Render::Font::GlyphPage::free(GLsizei start, unsigned int order)
+{
+	// Merge with free buddies
+	while (order < m_order)
+	{
+		free_list_t::iterator i = m_listFree[order].find(start ^ (GLsizei(1) << order));
+		if (!i)
+			break;
+
+		m_listFree[order].erase(i);
+		start &= ~(GLsizei(1) << order);
+		++order;
+	}
+
+	if (!m_listFree[order].push_back(start))
+		LOG_WARNING(("Failed to insert glyph range into free list: %s",OOBase::system_error_text()));
+}
+
+struct Indigo::Render::Font::GlyphAtlas
+{
+	GlyphAtlas(const OOBase::SharedPtr<Indigo::Font::Info::TrueType>& truetype, const OOBase::SharedPtr<OOGL::Texture>& texture) :
+		m_truetype(truetype), m_texture(texture), m_shelf_count(0)
+	{}
+
+	OOBase::SharedPtr<Indigo::Font::Info::TrueType> m_truetype;
+	OOBase::SharedPtr<OOGL::Texture> m_texture;
+
+	struct Span
+	{
+		unsigned int m_x;
+		unsigned int m_width;
+	};
+
+	// A line of atlas texels, used from the start, with the gaps left by frees
+	struct Spans
+	{
+		Spans() : m_end(0)
+		{}
+
+		unsigned int m_end;
+		OOBase::Vector<Span,OOBase::ThreadLocalAllocator> m_free;
 
-				wide_val <<= 6;
-				wide_val |= (c & 0x3F);
+		bool find(unsigned int width, unsigned int& x, unsigned int& waste) const;
+		void take(unsigned int x, unsigned int width);
+		void give(unsigned int x, unsigned int width);
+	};
+
+	// Shelves are cut from the rows of the atlas, and give their rows back once emptied
+	struct Shelf
+	{
+		Shelf() : m_y(0), m_height(0)
+		{}
+
+		unsigned int m_y;
+		unsigned int m_height;
+		Spans m_spans;
+		OOBase::Vector<int,OOBase::ThreadLocalAllocator> m_glyphs;
+	};
+	Shelf m_shelves[atlas_max_shelves];
+	size_t m_shelf_count;
+	Spans m_rows;
+
+	struct Glyph
+	{
+		OOBase::uint16_t u0;
+		OOBase::uint16_t v0;
+		OOBase::uint16_t u1;
+		OOBase::uint16_t v1;
+		size_t m_shelf;
+		unsigned int m_x;
+		unsigned int m_width;
+		unsigned int m_refcount;
+		OOBase::uint64_t m_released;
+	};
+	typedef OOBase::HashTable<int,Glyph,OOBase::ThreadLocalAllocator> glyph_map_t;
+	glyph_map_t m_mapGlyphs;
+
+	bool acquire(OOBase::uint32_t codepoint, struct Indigo::Font::Info::char_info& ci);
+	void release(OOBase::uint32_t codepoint);
+	bool lookup(OOBase::uint32_t codepoint, struct Indigo::Font::Info::char_info& ci) const;
+
+	bool pack(unsigned int width, unsigned int height, size_t& shelf, unsigned int& x, unsigned int& y);
+	void unpack(size_t shelf, unsigned int x, unsigned int width);
+	bool find(unsigned int width, unsigned int height, size_t& shelf, unsigned int& x) const;
+	bool new_shelf(unsigned int height, size_t& shelf);
+	void free_shelf(Shelf& shelf);
+	bool evict(unsigned int width, unsigned int height, size_t& shelf, unsigned int& x);
+	bool evict_from(size_t shelf, unsigned int width, unsigned int& x);
+	bool reclaim(unsigned int height, size_t& shelf);
+	void remove(int key);
+
+	bool evictable(const Glyph& glyph) const
+	{
+		// No text uses it, and the GPU has finished any frame that drew it
+		return (!glyph.m_refcount && render_frame_complete(glyph.m_released));
+	}
+};
+
+bool Indigo::Render::Font::GlyphAtlas::Spans::find(unsigned int width, unsigned int& x, unsigned int& waste) const
+{
+	// The tightest gap left by a free, else the free end
+	bool found = false;
+	for (OOBase::Vector<Span,OOBase::ThreadLocalAllocator>::const_iterator i=m_free.begin();i;++i)
+	{
+		if (i->m_width >= width && (!found || i->m_width - width < waste))
+		{
+			x = i->m_x;
+			waste = i->m_width - width;
+			found = true;
+		}
+	}
+
+	if (!found && atlas_size - m_end >= width)
+	{
+		x = m_end;
+		waste = 0;
+		found = true;
+	}
+	return found;
+}
+
+void Indigo::Render::Font::GlyphAtlas::Spans::take(unsigned int x, unsigned int width)
+{
+	if (x == m_end)
+	{
+		m_end += width;
+		return;
+	}
+
+	for (OOBase::Vector<Span,OOBase::ThreadLocalAllocator>::iterator i=m_free.begin();i;++i)
+	{
+		if (i->m_x == x)
+		{
+			if (i->m_width == width)
+				m_free.erase(i);
+			else
+			{
+				i->m_x += width;
+				i->m_width -= width;
 			}
+			break;
+		}
+	}
+}
+
+void Indigo::Render::Font::GlyphAtlas::Spans::give(unsigned int x, unsigned int width)
+{
+	// Merge with the neighbouring gaps, and with the free end
+	for (OOBase::Vector<Span,OOBase::ThreadLocalAllocator>::iterator i=m_free.begin();i;)
+	{
+		if (i->m_x + i->m_width == x)
+		{
+			x = i->m_x;
+			width += i->m_width;
+			i = m_free.erase(i);
+		}
+		else if (x + width == i->m_x)
+		{
+			width += i->m_width;
+			i = m_free.erase(i);
+		}
+		else
+			++i;
+	}
+
+	if (x + width == m_end)
+		m_end = x;
+	else
+	{
+		Span span = { x, width };
+		if (!m_free.push_back(span))
+			LOG_WARNING(("Failed to free glyph atlas space: %s",OOBase::system_error_text()));
+	}
+}
+
+bool Indigo::Render::Font::GlyphAtlas::acquire(OOBase::uint32_t codepoint, struct Indigo::Font::Info::char_info& ci)
+{
+	static const unsigned int ushort_max = 0xFFFF;
 
-			if (!glyphs.push_back(wide_val))
-				break;
+	int g = m_truetype->glyph_index(codepoint);
+	glyph_map_t::iterator i = m_mapGlyphs.find(g);
+	if (!i)
+	{
+		int x0, y0, x1, y1;
+		stbtt_GetGlyphBitmapBox(&m_truetype->m_font,g,m_truetype->m_scale,m_truetype->m_scale,&x0,&y0,&x1,&y1);
+		if (x1 <= x0 || y1 <= y0)
+			return true;
+
+		// Pad by a texel each side so linear filtering doesn't bleed between glyphs, plus the
+		// quad padding, plus as much again outside the quad for shadows sampled from beyond it
+		const unsigned int border = 2 * truetype_padding + 1;
+		unsigned int width = (x1 - x0) + 2 * border;
+		unsigned int height = (y1 - y0) + 2 * border;
+
+		size_t shelf;
+		unsigned int x, y;
+		if (!pack(width,height,shelf,x,y))
+			LOG_ERROR_RETURN(("Glyph atlas full, U+%04X will be drawn blank until other text is freed",codepoint),false);
+
+		OOBase::ScopedArrayPtr<unsigned char,OOBase::ThreadLocalAllocator,1024> pixels;
+		if (!pixels.resize(width * height))
+		{
+			unpack(shelf,x,width);
+			LOG_ERROR_RETURN(("Failed to allocate glyph bitmap: %s",OOBase::system_error_text()),false);
+		}
 
-			if (wide_val > 31 && wide_val != 127 && (wide_val < 128 || wide_val > 159))
-				++drawable;
+		memset(pixels.get(),0,width * height);
+		stbtt_MakeGlyphBitmap(&m_truetype->m_font,pixels.get() + border * width + border,width - 2 * border,height - 2 * border,width,m_truetype->m_scale,m_truetype->m_scale,g);
+
+		// Upload just this glyph's rectangle
+		glPixelStorei(GL_UNPACK_ALIGNMENT,1);
+		m_texture->sub_image(0,x,y,width,height,GL_RED,GL_UNSIGNED_BYTE,pixels.get());
+		glPixelStorei(GL_UNPACK_ALIGNMENT,4);
+
+		Glyph glyph;
+		const unsigned int inset = truetype_padding + 1;
+		glyph.u0 = static_cast<OOBase::uint16_t>(static_cast<float>(x + inset) / atlas_size * ushort_max);
+		glyph.v0 = static_cast<OOBase::uint16_t>(static_cast<float>(y + inset) / atlas_size * ushort_max);
+		glyph.u1 = static_cast<OOBase::uint16_t>(static_cast<float>(x + width - inset) / atlas_size * ushort_max);
+		glyph.v1 = static_cast<OOBase::uint16_t>(static_cast<float>(y + height - inset) / atlas_size * ushort_max);
+		glyph.m_shelf = shelf;
+		glyph.m_x = x;
+		glyph.m_width = width;
+		glyph.m_refcount = 0;
+		glyph.m_released = 0;
+
+		if (!m_shelves[shelf].m_glyphs.push_back(g))
+		{
+			unpack(shelf,x,width);
+			LOG_ERROR_RETURN(("Failed to insert glyph into atlas: %s",OOBase::system_error_text()),false);
 		}
 
-		return drawable;
+		i = m_mapGlyphs.insert(g,glyph);
+		if (!i)
+		{
+			m_shelves[shelf].m_glyphs.pop_back();
+			unpack(shelf,x,width);
+			LOG_ERROR_RETURN(("Failed to insert glyph into atlas: %s",OOBase::system_error_text()),false);
+		}
 	}
 
-	struct vertex_data
+	++i->second.m_refcount;
+
+	ci.u0 = i->second.u0;
+	ci.v0 = i->second.v0;
+	ci.u1 = i->second.u1;
+	ci.v1 = i->second.v1;
+	return true;
+}
+
+bool Indigo::Render::Font::GlyphAtlas::lookup(OOBase::uint32_t codepoint, struct Indigo::Font::Info::char_info& ci) const
+{
+	glyph_map_t::const_iterator i = m_mapGlyphs.find(m_truetype->glyph_index(codepoint));
+	if (!i)
+		return false;
+
+	ci.u0 = i->second.u0;
+	ci.v0 = i->second.v0;
+	ci.u1 = i->second.u1;
+	ci.v1 = i->second.v1;
+	return true;
+}
+
+void Indigo::Render::Font::GlyphAtlas::release(OOBase::uint32_t codepoint)
+{
+	glyph_map_t::iterator i = m_mapGlyphs.find(m_truetype->glyph_index(codepoint));
+	if (i && i->second.m_refcount && --i->second.m_refcount == 0)
+		i->second.m_released = render_frame();
+}
+
+bool Indigo::Render::Font::GlyphAtlas::find(unsigned int width, unsigned int height, size_t& shelf, unsigned int& x) const
+{
+	// Best fit by height, then by width, amongst the shelves with room
+	shelf = atlas_max_shelves;
+	unsigned int best_waste = 0;
+	for (size_t s = 0;s < m_shelf_count;++s)
 	{
-		GLfloat x;
-		GLfloat y;
-		GLushort u;
-		GLushort v;
-	};
+		unsigned int sx, waste;
+		if (m_shelves[s].m_height >= height && m_shelves[s].m_spans.find(width,sx,waste) &&
+				(shelf == atlas_max_shelves || m_shelves[s].m_height < m_shelves[shelf].m_height ||
+				(m_shelves[s].m_height == m_shelves[shelf].m_height && waste < best_waste)))
+		{
+			shelf = s;
+			x = sx;
+			best_waste = waste;
+		}
+	}
+	return (shelf != atlas_max_shelves);
+}
 
-	const unsigned int vertices_per_glyph = 4;
-	const unsigned int elements_per_glyph = 6;
+bool Indigo::Render::Font::GlyphAtlas::pack(unsigned int width, unsigned int height, size_t& shelf, unsigned int& x, unsigned int& y)
+{
+	if (width > atlas_size || height > atlas_size)
+		return false;
+
+	if (!find(width,height,shelf,x))
+	{
+		unsigned int shelf_height = (height + 3) & ~3u;
+		if (new_shelf(shelf_height,shelf))
+			x = 0;
+		else if (!evict(width,height,shelf,x))
+		{
+			if (!reclaim(shelf_height,shelf))
+				return false;
+			x = 0;
+		}
+	}
+
+	m_shelves[shelf].m_spans.take(x,width);
+	y = m_shelves[shelf].m_y;
+	return true;
+}
+
+void Indigo::Render::Font::GlyphAtlas::unpack(size_t shelf, unsigned int x, unsigned int width)
+{
+	m_shelves[shelf].m_spans.give(x,width);
+	if (m_shelves[shelf].m_glyphs.empty())
+		free_shelf(m_shelves[shelf]);
 }
 
-Indigo::Render::Font::Font(const OOBase::SharedPtr<Indigo::Font::Info>& info) : m_allocated(0), m_info(info)
+bool Indigo::Render::Font::GlyphAtlas::new_shelf(unsigned int height, size_t& shelf)
+{
+	unsigned int y, waste;
+	if (!m_rows.find(height,y,waste))
+		return false;
+
+	// Reuse the slot of a shelf that has given its rows back
+	size_t s = 0;
+	while (s < m_shelf_count && m_shelves[s].m_height)
+		++s;
+	if (s == atlas_max_shelves)
+		return false;
+	if (s == m_shelf_count)
+		++m_shelf_count;
+
+	m_rows.take(y,height);
+	m_shelves[s].m_y = y;
+	m_shelves[s].m_height = height;
+	shelf = s;
+	return true;
+}
+
+void Indigo::Render::Font::GlyphAtlas::free_shelf(Shelf& shelf)
+{
+	m_rows.give(shelf.m_y,shelf.m_height);
+	shelf.m_height = 0;
+	shelf.m_spans.m_end = 0;
+	shelf.m_spans.m_free.clear();
+}
+
+void Indigo::Render::Font::GlyphAtlas::remove(int key)
+{
+	glyph_map_t::iterator i = m_mapGlyphs.find(key);
+	if (i)
+	{
+		Shelf& shelf = m_shelves[i->second.m_shelf];
+		shelf.m_spans.give(i->second.m_x,i->second.m_width);
+
+		OOBase::Vector<int,OOBase::ThreadLocalAllocator>::iterator j = shelf.m_glyphs.find(key);
+		if (j)
+			shelf.m_glyphs.erase(j);
+
+		m_mapGlyphs.remove(key);
+	}
+}
+
+bool Indigo::Render::Font::GlyphAtlas::evict(unsigned int width, unsigned int height, size_t& shelf, unsigned int& x)
+{
+	// Try the shelves tall enough for the glyph, shortest first
+	bool tried[atlas_max_shelves] = {false};
+	for (;;)
+	{
+		size_t best = atlas_max_shelves;
+		for (size_t s = 0;s < m_shelf_count;++s)
+		{
+			if (!tried[s] && m_shelves[s].m_height >= height && (best == atlas_max_shelves || m_shelves[s].m_height < m_shelves[best].m_height))
+				best = s;
+		}
+
+		if (best == atlas_max_shelves)
+			return false;
+
+		tried[best] = true;
+		if (evict_from(best,width,x))
+		{
+			shelf = best;
+			return true;
+		}
+	}
+}
+
+bool Indigo::Render::Font::GlyphAtlas::evict_from(size_t shelf, unsigned int width, unsigned int& x)
+{
+	// Evict this shelf's unused glyphs, least recently released first, until a gap fits the width
+	OOBase::Vector<int,OOBase::ThreadLocalAllocator>& glyphs = m_shelves[shelf].m_glyphs;
+	unsigned int waste;
+	while (!m_shelves[shelf].m_spans.find(width,x,waste))
+	{
+		const Glyph* oldest = NULL;
+		int oldest_key = 0;
+		for (OOBase::Vector<int,OOBase::ThreadLocalAllocator>::iterator i=glyphs.begin();i;++i)
+		{
+			glyph_map_t::iterator g = m_mapGlyphs.find(*i);
+			if (g && evictable(g->second) && (!oldest || g->second.m_released < oldest->m_released))
+			{
+				oldest = &g->second;
+				oldest_key = *i;
+			}
+		}
+
+		if (!oldest)
+			return false;
+
+		remove(oldest_key);
+	}
+	return true;
+}
+
+bool Indigo::Render::Font::GlyphAtlas::reclaim(unsigned int height, size_t& shelf)
+{
+	// No shelf is tall enough, so empty whole shelves nothing uses, least recently used first,
+	// and give their rows back until a new shelf fits
+	while (!new_shelf(height,shelf))
+	{
+		size_t best = atlas_max_shelves;
+		OOBase::uint64_t best_released = 0;
+		for (size_t s = 0;s < m_shelf_count;++s)
+		{
+			if (!m_shelves[s].m_height)
+				continue;
+
+			bool unused = true;
+			OOBase::uint64_t released = 0;
+			for (OOBase::Vector<int,OOBase::ThreadLocalAllocator>::iterator i=m_shelves[s].m_glyphs.begin();unused && i;++i)
+			{
+				glyph_map_t::iterator g = m_mapGlyphs.find(*i);
+				if (g)
+				{
+					unused = evictable(g->second);
+					if (g->second.m_released > released)
+						released = g->second.m_released;
+				}
+			}
+
+			if (unused && (best == atlas_max_shelves || released < best_released))
+			{
+				best = s;
+				best_released = released;
+			}
+		}
+
+		if (best == atlas_max_shelves)
+			return false;
+
+		OOBase::Vector<int,OOBase::ThreadLocalAllocator>& glyphs = m_shelves[best].m_glyphs;
+		while (!glyphs.empty())
+		{
+			m_mapGlyphs.remove(*glyphs.back());
+			glyphs.pop_back();
+		}
+
+		free_shelf(m_shelves[best]);
+	}
+	return true;
+}
+
+Indigo::Render::Font::Font(const OOBase::SharedPtr<Indigo::Font::Info>& info) : m_info(info)
 {
 	ASSERT_RENDER_THREAD();
 }
@@ -223,6 +873,41 @@ Indigo::Render::Font::~Font()
 
 bool Indigo::Render::Font::load(const OOBase::SharedPtr<Indigo::Image>* pages, size_t page_count)
 {
+	if (m_info->m_truetype)
+	{
+		m_ptrTexture = OOBase::allocate_shared<OOGL::Texture,OOBase::ThreadLocalAllocator>(GL_TEXTURE_2D,1,GL_R8,atlas_size,atlas_size,GL_RED,GL_UNSIGNED_BYTE,static_cast<const void*>(NULL));
+		if (!m_ptrTexture)
+			LOG_ERROR_RETURN(("Failed to allocate glyph atlas texture"),false);
+
+		m_ptrTexture->parameter(GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+		m_ptrTexture->parameter(GL_TEXTURE_MIN_FILTER,GL_LINEAR);
+		m_ptrTexture->parameter(GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
+		m_ptrTexture->parameter(GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
+
+		m_atlas = OOBase::allocate_shared<GlyphAtlas,OOBase::ThreadLocalAllocator>(m_info->m_truetype,m_ptrTexture);
+		if (!m_atlas)
+			LOG_ERROR_RETURN(("Failed to allocate glyph atlas: %s",OOBase::system_error_text()),false);
+
+		return true;
+	}
+
+	if (m_info->m_cooked)
+	{
+		const Indigo::Font::Info::Cooked* cooked = m_info->m_cooked.get();
+
+		glPixelStorei(GL_UNPACK_ALIGNMENT,1);
+		m_ptrTexture = OOBase::allocate_shared<OOGL::Texture,OOBase::ThreadLocalAllocator>(GL_TEXTURE_2D,1,GL_R8,cooked->m_header->tex_width,cooked->m_header->tex_height,GL_RED,GL_UNSIGNED_BYTE,static_cast<const void*>(cooked->m_pixels));
+		glPixelStorei(GL_UNPACK_ALIGNMENT,4);
+		if (!m_ptrTexture)
+			LOG_ERROR_RETURN(("Failed to load font texture"),false);
+
+		m_ptrTexture->parameter(GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+		m_ptrTexture->parameter(GL_TEXTURE_MIN_FILTER,GL_LINEAR);
+		m_ptrTexture->parameter(GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
+		m_ptrTexture->parameter(GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
+		return true;
+	}
+
 	bool cached = true;
 	if (page_count > 1)
 	{
@@ -258,9 +943,18 @@ bool Indigo::Render::Font::font_program(OOBase::uint32_t packing)
 		{
 			OOBase::SharedPtr<OOGL::Shader> shaders[2];
 			shaders[0] = Indigo::ShaderPool::add_shader("2d_textured_colour.vert",GL_VERTEX_SHADER,Indigo::static_resources());
-			shaders[1] = Indigo::ShaderPool::add_shader("font_red_blend.frag",GL_FRAGMENT_SHADER,Indigo::static_resources());
-			if (shaders[0] && shaders[1])
-				m_ptrProgram = Indigo::ShaderPool::add_program("Font_8bit",shaders,2);
+			if (m_info->m_distance_field)
+			{
+				shaders[1] = Indigo::ShaderPool::add_shader("font_sdf_blend.frag",GL_FRAGMENT_SHADER,Indigo::static_resources());
+				if (shaders[0] && shaders[1])
+					m_ptrProgram = Indigo::ShaderPool::add_program("Font_8bit_SDF",shaders,2);
+			}
+			else
+			{
+				shaders[1] = Indigo::ShaderPool::add_shader("font_red_blend.frag",GL_FRAGMENT_SHADER,Indigo::static_resources());
+				if (shaders[0] && shaders[1])
+					m_ptrProgram = Indigo::ShaderPool::add_program("Font_8bit",shaders,2);
+			}
 		}
 		break;
 
@@ -270,200 +964,604 @@ bool Indigo::Render::Font::font_program(OOBase::uint32_t packing)
 	return m_ptrProgram;
 }
 
+bool Indigo::Render::Font::alloc_elements()
+{
+	// Every glyph is the same 0,1,2,2,1,3 quad, so one static element buffer serves every page.
+	// The second half lists the glyphs again last to first, for draw_shadowed
+	const size_t glyphs = size_t(1) << max_page_order;
+
+	OOBase::ScopedArrayPtr<GLushort,OOBase::ThreadLocalAllocator> elements;
+	if (!elements.resize(2 * glyphs * elements_per_glyph))
+		LOG_ERROR_RETURN(("Failed to allocate element buffer: %s",OOBase::system_error_text()),false);
+
+	GLushort* e = elements.get();
+	for (size_t i = 0;i < 2 * glyphs;++i)
+	{
+		GLushort idx = static_cast<GLushort>((i < glyphs ? i : 2 * glyphs - 1 - i) * vertices_per_glyph);
+		e[0] = idx + 0;
+		e[1] = idx + 1;
+		e[2] = idx + 2;
+		e[3] = idx + 2;
+		e[4] = idx + 1;
+		e[5] = idx + 3;
+		e += elements_per_glyph;
+	}
+
+	m_ptrElements = OOBase::allocate_shared<OOGL::BufferObject,OOBase::ThreadLocalAllocator>(GL_ELEMENT_ARRAY_BUFFER,GL_STATIC_DRAW,2 * glyphs * elements_per_glyph * sizeof(GLushort),elements.get());
+	if (!m_ptrElements)
+		LOG_ERROR_RETURN(("Failed to allocate VBO: %s",OOBase::system_error_text(ERROR_OUTOFMEMORY)),false);
+
+	return true;
+}
+
+Indigo::Render::Font::GlyphPage* Indigo::Render::Font::new_page(unsigned int order)
+{
+	if (!m_ptrProgram && !font_program(m_info->m_packing))
+		return NULL;
+
+	if (!m_ptrElements && !alloc_elements())
+		return NULL;
+
+	OOBase::SharedPtr<GlyphPage> page = OOBase::allocate_shared<GlyphPage,OOBase::ThreadLocalAllocator>(order);
+	if (!page)
+		LOG_ERROR_RETURN(("Failed to allocate glyph page: %s",OOBase::system_error_text()),NULL);
+
+	GLsizei glyphs = GLsizei(1) << order;
+	page->m_ptrVAO = OOBase::allocate_shared<OOGL::VertexArrayObject,OOBase::ThreadLocalAllocator>();
+	page->m_ptrVertices = OOBase::allocate_shared<OOGL::BufferObject,OOBase::ThreadLocalAllocator>(GL_ARRAY_BUFFER,GL_DYNAMIC_DRAW,glyphs * vertices_per_glyph * sizeof(GlyphVertex));
+	if (!page->m_ptrVAO || !page->m_ptrVertices)
+		LOG_ERROR_RETURN(("Failed to allocate VBO: %s",OOBase::system_error_text(ERROR_OUTOFMEMORY)),NULL);
+
+	if (!page->m_listFree[order].push_back(0) || !m_pages.push_back(page))
+		LOG_ERROR_RETURN(("Failed to insert glyph page: %s",OOBase::system_error_text()),NULL);
+
+	page->m_ptrVAO->bind();
+
+	GLint a = m_ptrProgram->attribute_location("in_Position");
+	page->m_ptrVAO->attribute(a,page->m_ptrVertices,2,GL_FLOAT,false,sizeof(GlyphVertex),offsetof(GlyphVertex,x));
+	page->m_ptrVAO->enable_attribute(a);
+
+	a = m_ptrProgram->attribute_location("in_TexCoord");
+	page->m_ptrVAO->attribute(a,page->m_ptrVertices,2,GL_UNSIGNED_SHORT,true,sizeof(GlyphVertex),offsetof(GlyphVertex,u));
+	page->m_ptrVAO->enable_attribute(a);
+
+	page->m_ptrVAO->element_array(m_ptrElements);
+
+	page->m_ptrVAO->unbind();
+
+	return page.get();
+}
+
+void Indigo::Render::Font::reclaim_glyphs()
+{
+	for (OOBase::Vector<RetiredGlyphs,OOBase::ThreadLocalAllocator>::iterator i=m_listRetired.begin();i;)
+	{
+		// Held back until the GPU has finished the frame it was retired in, so it can be rewritten unsynchronized
+		if (render_frame_complete(i->m_frame))
+		{
+			i->m_page->free(i->m_start,i->m_order);
+			i = m_listRetired.erase(i);
+		}
+		else
+			++i;
+	}
+}
+
+bool Indigo::Render::Font::alloc_glyphs(GLsizei len, GlyphPage*& page, GLsizei& start, unsigned int& order)
+{
+	order = glyph_order(len);
+	if (order > max_glyph_order)
+		LOG_ERROR_RETURN(("Text too long: %d glyphs",len),false);
+
+	reclaim_glyphs();
+
+	for (OOBase::Vector<OOBase::SharedPtr<GlyphPage>,OOBase::ThreadLocalAllocator>::iterator i=m_pages.begin();i;++i)
+	{
+		start = (*i)->alloc(order);
+		if (start != -1)
+		{
+			page = i->get();
+			return true;
+		}
+	}
+
+	// Grow geometrically by adding a new page, the existing pages are never copied
+	unsigned int page_order = min_page_order;
+	if (!m_pages.empty())
+		page_order = (*m_pages.back())->m_order + 1;
+	if (page_order > max_page_order)
+		page_order = max_page_order;
+	if (page_order < order)
+		page_order = order;
+
+	page = new_page(page_order);
+	if (!page)
+		return false;
+
+	start = page->alloc(order);
+	return (start != -1);
+}
+
+bool Indigo::Render::Font::layout_text(const char* sz, size_t s_len, OOBase::Vector<PlacedGlyph,OOBase::ThreadLocalAllocator>& placed, float* width)
+{
+	OOBase::ScopedArrayPtr<OOBase::uint32_t,OOBase::ThreadLocalAllocator,256> glyphs;
+	if (!glyphs.resize(s_len))
+		LOG_ERROR_RETURN(("Failed to allocate glyph buffer: %s",OOBase::system_error_text()),false);
+
+	GLsizei len = 0;
+	size_t count = detail::utf8_to_glyphs(sz,s_len,glyphs.get(),len);
+
+	OOBase::uint32_t prev_glyph = OOBase::uint32_t(-1);
+	const OOBase::uint32_t* start = glyphs.get();
+	const OOBase::uint32_t* end = start + count;
+	float length = 0.0f;
+
+	while (start < end)
+	{
+		OOBase::uint32_t glyph = *start++;
+		if (detail::drawable_glyph(glyph))
+		{
+			if (prev_glyph != OOBase::uint32_t(-1))
+				length += m_info->kerning(prev_glyph,glyph);
+			prev_glyph = glyph;
+
+			PlacedGlyph g = { glyph, length, 0.f };
+			if (!placed.push_back(g))
+				LOG_ERROR_RETURN(("Failed to allocate glyph buffer: %s",OOBase::system_error_text()),false);
+
+			struct Indigo::Font::Info::char_info ci = {0};
+			if (m_info->find_char(glyph,ci))
+				length += ci.xadvance;
+		}
+		else
+		{
+			prev_glyph = OOBase::uint32_t(-1);
+		}
+	}
+
+	if (width)
+		*width = length;
+
+	return true;
+}
+
+void Indigo::Render::Font::acquire_glyphs(const PlacedGlyph* placed, GLsizei len, OOBase::uint32_t* acquired)
+{
+	for (GLsizei i = 0;i < len;++i)
+	{
+		struct Indigo::Font::Info::char_info ci = {0};
+		acquired[i] = (m_atlas->acquire(placed[i].m_glyph,ci) ? placed[i].m_glyph : no_atlas_glyph);
+	}
+}
+
+void Indigo::Render::Font::release_glyphs(GlyphRun& run, GLsizei from, GLsizei to)
+{
+	const OOBase::uint32_t* acquired = run.m_atlas_glyphs.data();
+	GLsizei count = static_cast<GLsizei>(run.m_atlas_glyphs.size());
+	for (GLsizei i = from;i < to && i < count;++i)
+	{
+		if (acquired[i] != no_atlas_glyph)
+			m_atlas->release(acquired[i]);
+	}
+}
+
+void Indigo::Render::Font::emit_glyphs(GlyphVertex* a, const PlacedGlyph* placed, GLsizei len)
+{
+	for (GLsizei i = 0;i < len;++i)
+	{
+		struct Indigo::Font::Info::char_info ci = {0};
+		m_info->find_char(placed[i].m_glyph,ci);
+		if (m_atlas)
+			m_atlas->lookup(placed[i].m_glyph,ci);
+
+		a[0].x = placed[i].m_x + ci.left;
+		a[0].y = placed[i].m_y + ci.top;
+		a[1].x = a[0].x;
+		a[1].y = placed[i].m_y + ci.bottom;
+		a[2].x = placed[i].m_x + ci.right;
+		a[2].y = a[0].y;
+		a[3].x = a[2].x;
+		a[3].y = a[1].y;
+
+		a[0].u = ci.u0;
+		a[0].v = ci.v0;
+		a[1].u = a[0].u;
+		a[1].v = ci.v1;
+		a[2].u = ci.u1;
+		a[2].v = a[0].v;
+		a[3].u = a[2].u;
+		a[3].v = a[1].v;
+
+		a += vertices_per_glyph;
+	}
+}
+
+OOBase::SharedPtr<Indigo::Render::Font::GlyphRun> Indigo::Render::Font::find_run(size_t hash, const char* sz, size_t s_len)
+{
+	// The hash only picks the candidate, the bytes decide
+	run_map_t::iterator i = m_mapRuns.find(hash);
+	if (!i || i->second->m_key.length() != s_len || memcmp(i->second->m_key.c_str(),sz,s_len) != 0)
+		return OOBase::SharedPtr<GlyphRun>();
+
+	return i->second;
+}
+
+void Indigo::Render::Font::intern_run(const OOBase::SharedPtr<GlyphRun>& run, size_t hash, const char* sz, size_t s_len)
+{
+	// A different string with the same hash keeps the slot, and this run goes unshared
+	if (!s_len || m_mapRuns.exists(hash))
+		return;
+
+	if (!run->m_key.assign(sz,s_len) || !m_mapRuns.insert(hash,run))
+	{
+		LOG_WARNING(("Failed to intern glyph run: %s",OOBase::system_error_text()));
+		run->m_key.clear();
+		return;
+	}
+	run->m_hash = hash;
+}
+
+void Indigo::Render::Font::unintern_run(GlyphRun& run)
+{
+	if (!run.m_key.empty())
+	{
+		m_mapRuns.remove(run.m_hash);
+		run.m_key.clear();
+	}
+}
+
 bool Indigo::Render::Font::alloc_text(Text& text, const char* sz, size_t s_len)
 {
-	text.m_glyph_len = 0;
-	text.m_glyph_start = 0;
+	text.m_run.reset();
 
-	OOBase::Vector<OOBase::uint32_t,OOBase::ThreadLocalAllocator> glyphs;
-	GLsizei len = utf8_to_glyphs(sz,s_len,glyphs);
-	if (!len)
+	// Identical strings share one run
+	size_t hash = OOBase::Hash<const char*>::hash(sz,s_len);
+	OOBase::SharedPtr<GlyphRun> run = find_run(hash,sz,s_len);
+	if (run)
+	{
+		++run->m_refcount;
+		text.m_run = run;
 		return true;
+	}
 
-	bool found = false;
-	for (free_list_t::iterator i=m_listFree.begin(); i; ++i)
+	run = OOBase::allocate_shared<GlyphRun,OOBase::ThreadLocalAllocator>();
+	if (!run)
+		LOG_ERROR_RETURN(("Failed to allocate glyph run: %s",OOBase::system_error_text()),false);
+
+	OOBase::Vector<PlacedGlyph,OOBase::ThreadLocalAllocator> placed;
+	if (!layout_text(sz,s_len,placed))
+		return false;
+
+	if (!write_run(*run,placed.data(),0,static_cast<GLsizei>(placed.size())))
+		return false;
+
+	intern_run(run,hash,sz,s_len);
+
+	run->m_refcount = 1;
+	text.m_run = run;
+	return true;
+}
+
+bool Indigo::Render::Font::update_text(Text& text, const char* sz, size_t s_len)
+{
+	GlyphRun* run = text.m_run.get();
+	if (!run)
+		return false;
+
+	if (run->m_key.length() == s_len && memcmp(run->m_key.c_str(),sz,s_len) == 0)
+		return true;
+
+	// Show the run already holding the new string, if there is one
+	size_t hash = OOBase::Hash<const char*>::hash(sz,s_len);
+	OOBase::SharedPtr<GlyphRun> other = find_run(hash,sz,s_len);
+	if (other)
+	{
+		free_text(text);
+		++other->m_refcount;
+		text.m_run = other;
+		return true;
+	}
+
+	// Only a run nobody else shares can be updated
+	if (run->m_refcount != 1 || !run->m_page)
+		return false;
+
+	OOBase::Vector<PlacedGlyph,OOBase::ThreadLocalAllocator> placed;
+	if (!layout_text(sz,s_len,placed) || placed.empty())
+		return false;
+
+	if (!write_run(*run,placed.data(),0,static_cast<GLsizei>(placed.size())))
+		return false;
+
+	// Re-intern under the new string
+	unintern_run(*run);
+	intern_run(text.m_run,hash,sz,s_len);
+	return true;
+}
+
+bool Indigo::Render::Font::write_run(GlyphRun& run, const PlacedGlyph* placed, GLsizei first, GLsizei len)
+{
+	// placed holds the glyphs from first to len, those before first are unchanged: narrow that
+	// down to the glyphs that really changed or moved
+	const PlacedGlyph* old = run.m_glyphs.data();
+	GLsizei old_len = static_cast<GLsizei>(run.m_glyphs.size());
+
+	GLsizei from = first;
+	while (from < len && from < old_len && placed[from - first] == old[from])
+		++from;
+
+	GLsizei to = len;
+	if (len == old_len)
 	{
-		if (i->second == len)
+		while (to > from && placed[to - 1 - first] == old[to - 1])
+			--to;
+	}
+
+	if (m_atlas)
+	{
+		// Take the new glyphs before letting go of the old, so glyphs common to both stay cached
+		OOBase::ScopedArrayPtr<OOBase::uint32_t,OOBase::ThreadLocalAllocator,256> acquired;
+		if (!acquired.resize(to > from ? to - from : 1))
+			LOG_ERROR_RETURN(("Failed to allocate glyph buffer: %s",OOBase::system_error_text()),false);
+
+		acquire_glyphs(placed + (from - first),to - from,acquired.get());
+		release_glyphs(run,from,len == old_len ? to : old_len);
+
+		while (static_cast<GLsizei>(run.m_atlas_glyphs.size()) > len)
+			run.m_atlas_glyphs.pop_back();
+
+		for (GLsizei i = from;i < to;++i)
 		{
-			text.m_glyph_start = i->first;
-			m_listFree.erase(i);
-			found = true;
-			break;
+			if (i < old_len)
+				run.m_atlas_glyphs.data()[i] = acquired[i - from];
+			else if (!run.m_atlas_glyphs.push_back(acquired[i - from]))
+			{
+				for (;i < to;++i)
+				{
+					if (acquired[i - from] != no_atlas_glyph)
+						m_atlas->release(acquired[i - from]);
+				}
+				retire_run(run);
+				LOG_ERROR_RETURN(("Failed to record atlas glyphs: %s",OOBase::system_error_text()),false);
+			}
 		}
-		else if (i->second > len)
+	}
+
+	while (static_cast<GLsizei>(run.m_glyphs.size()) > len)
+		run.m_glyphs.pop_back();
+
+	for (GLsizei i = from;i < to;++i)
+	{
+		if (i < old_len)
+			run.m_glyphs.data()[i] = placed[i - first];
+		else if (!run.m_glyphs.push_back(placed[i - first]))
 		{
-			text.m_glyph_start = i->first;
-			i->first += len;
-			i->second -= len;
-			found = true;
-			break;
+			retire_run(run);
+			LOG_ERROR_RETURN(("Failed to allocate glyph buffer: %s",OOBase::system_error_text()),false);
 		}
 	}
 
-	if (!found)
+	if (run.m_page)
+		run.m_len = len;
+
+	// On failure, start again from nothing next time
+	if (from < to && !upload_run(run,from,to))
+	{
+		retire_run(run);
+		return false;
+	}
+	return true;
+}
+
+bool Indigo::Render::Font::upload_run(GlyphRun& run, GLsizei from, GLsizei to)
+{
+	GLsizei len = static_cast<GLsizei>(run.m_glyphs.size());
+	if (!run.m_page || run.m_copies == 1 || len > run.copy_size())
 	{
-		if (!m_ptrProgram && !font_program(m_info->m_packing))
+		// New runs start with one copy, and get more once they change
+		unsigned int copies = 1;
+		if (run.m_page && len * GLsizei(max_run_copies) <= (GLsizei(1) << max_glyph_order))
+			copies = max_run_copies;
+
+		return move_run(run,copies);
+	}
+
+	// Bring a copy the GPU has finished with up to date, and draw that instead
+	for (unsigned int c = 1;c < run.m_copies;++c)
+	{
+		unsigned int n = (run.m_copy + c) % run.m_copies;
+		GlyphRun::Copy& copy = run.m_copy_info[n];
+		if (copy.m_retired != never_drawn && !render_frame_complete(copy.m_retired))
+			continue;
+
+		copy.dirty(from,to);
+		if (copy.m_dirty_last > len)
+			copy.m_dirty_last = len;
+
+		if (copy.m_dirty_first < copy.m_dirty_last && !write_glyphs(run,n,copy.m_dirty_first,copy.m_dirty_last))
 			return false;
 
-		if (!m_ptrVAO)
+		copy.m_dirty_first = copy.m_dirty_last = 0;
+
+		// The others now lack this change
+		for (unsigned int m = 0;m < run.m_copies;++m)
 		{
-			m_ptrVAO = OOBase::allocate_shared<OOGL::VertexArrayObject,OOBase::ThreadLocalAllocator>();
-			if (!m_ptrVAO)
-				LOG_ERROR_RETURN(("Failed to allocate VAO: %s",OOBase::system_error_text(ERROR_OUTOFMEMORY)),false);
+			if (m != n)
+				run.m_copy_info[m].dirty(from,to);
 		}
-		m_ptrVAO->bind();
-		
-		GLsizei new_size = 32;
-		while (new_size < m_allocated + len)
-			new_size *= 2;
 
-		OOBase::SharedPtr<OOGL::BufferObject> ptrNewVertices = OOBase::allocate_shared<OOGL::BufferObject,OOBase::ThreadLocalAllocator>(GL_ARRAY_BUFFER,GL_DYNAMIC_DRAW,new_size * vertices_per_glyph * sizeof(vertex_data));
-		OOBase::SharedPtr<OOGL::BufferObject> ptrNewElements = OOBase::allocate_shared<OOGL::BufferObject,OOBase::ThreadLocalAllocator>(GL_ELEMENT_ARRAY_BUFFER,GL_DYNAMIC_DRAW,new_size * elements_per_glyph * sizeof(GLuint));
-		if (!ptrNewVertices || !ptrNewElements)
-			LOG_ERROR_RETURN(("Failed to allocate VBO: %s",OOBase::system_error_text(ERROR_OUTOFMEMORY)),false);
+		run.m_copy_info[run.m_copy].m_retired = render_frame();
+		run.m_copy = n;
+		run.m_len = len;
+		return true;
+	}
+
+	// The GPU is behind on every copy
+	return move_run(run,run.m_copies);
+}
+
+bool Indigo::Render::Font::write_glyphs(GlyphRun& run, unsigned int copy, GLsizei from, GLsizei to)
+{
+	// Only ever a range the GPU is done with, or has never drawn
+	const GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+
+	GLsizei start = run.m_start + static_cast<GLsizei>(copy) * run.copy_size() + from;
+	OOBase::SharedPtr<GlyphVertex> attribs = run.m_page->m_ptrVertices->auto_map<GlyphVertex>(access,start * vertices_per_glyph * sizeof(GlyphVertex),(to - from) * vertices_per_glyph * sizeof(GlyphVertex));
+	if (!attribs)
+		LOG_ERROR_RETURN(("Failed to map glyph vertices"),false);
+
+	emit_glyphs(attribs.get(),run.m_glyphs.data() + from,to - from);
+	return true;
+}
+
+bool Indigo::Render::Font::move_run(GlyphRun& run, unsigned int copies)
+{
+	// The old range may still be queued for drawing, so never write it: fill a fresh range,
+	// and retire the old one until the GPU is done with it
+	GLsizei len = static_cast<GLsizei>(run.m_glyphs.size());
+	GlyphPage* page = NULL;
+	GLsizei start = 0;
+	unsigned int order = 0;
+	if (len && !alloc_glyphs(len * static_cast<GLsizei>(copies),page,start,order))
+		return false;
+
+	if (run.m_page)
+	{
+		RetiredGlyphs r = { run.m_page, run.m_start, run.m_order, render_frame() };
+		if (!m_listRetired.push_back(r))
+			LOG_WARNING(("Failed to retire glyph range: %s",OOBase::system_error_text()));
+	}
+
+	run.m_page = page;
+	run.m_start = start;
+	run.m_order = order;
+	run.m_len = len;
+	run.m_copies = copies;
+	run.m_copy = 0;
+	for (unsigned int c = 0;c < copies;++c)
+	{
+		run.m_copy_info[c].m_retired = never_drawn;
+		run.m_copy_info[c].m_dirty_first = 0;
+		run.m_copy_info[c].m_dirty_last = (c ? len : 0);
+	}
+
+	if (len && !write_glyphs(run,0,0,len))
+	{
+		// Never drawn, so it can go straight back
+		page->free(start,order);
+		run.m_page = NULL;
+		run.m_len = 0;
+		return false;
+	}
+	return true;
+}
+
+void Indigo::Render::Font::free_text(Text& text)
+{
+	if (text.m_run)
+	{
+		if (--text.m_run->m_refcount == 0)
+		{
+			unintern_run(*text.m_run);
+			retire_run(*text.m_run);
+		}
+		text.m_run.reset();
+	}
+}
 
-		if (m_ptrVertices)
-			ptrNewVertices->copy(0,m_ptrVertices,0,m_allocated * vertices_per_glyph * sizeof(vertex_data));
+void Indigo::Render::Font::retire_run(GlyphRun& run)
+{
+	if (m_atlas)
+		release_glyphs(run,0,static_cast<GLsizei>(run.m_atlas_glyphs.size()));
 
-		if (m_ptrElements)
-			ptrNewElements->copy(0,m_ptrElements,0,m_allocated * elements_per_glyph * sizeof(GLuint));
+	run.m_glyphs.clear();
+	run.m_atlas_glyphs.clear();
 
-		m_ptrVertices.swap(ptrNewVertices);
-		m_ptrElements.swap(ptrNewElements);
+	if (run.m_page)
+	{
+		RetiredGlyphs r = { run.m_page, run.m_start, run.m_order, render_frame() };
+		if (!m_listRetired.push_back(r))
+			LOG_WARNING(("Failed to retire glyph range: %s",OOBase::system_error_text()));
 
-		free_list_t::iterator last = m_listFree.back();
-		if (last)
-			last->second += new_size - m_allocated;
-		else
-			last = m_listFree.insert(m_allocated,new_size - m_allocated);
-		m_allocated = new_size;
+		run.m_page = NULL;
+	}
+	run.m_len = 0;
+}
 
-		text.m_glyph_start = last->first;
-		last->first += len;
-		last->second -= len;
+void Indigo::Render::Font::draw(OOGL::State& state, const glm::mat4& mvp, const glm::vec4& colour, GlyphPage* page, GLsizei start, GLsizei len)
+{
+	if (page && len && colour.a > 0.f && m_ptrProgram && m_ptrTexture)
+	{
+		state.use(m_ptrProgram);
+		state.bind(0,m_ptrTexture);
 
-		GLint a = m_ptrProgram->attribute_location("in_Position");
-		m_ptrVAO->attribute(a,m_ptrVertices,2,GL_FLOAT,false,sizeof(vertex_data),offsetof(vertex_data,x));
-		m_ptrVAO->enable_attribute(a);
+		m_ptrProgram->uniform("in_Colour",colour);
+		m_ptrProgram->uniform("MVP",mvp);
 
-		a = m_ptrProgram->attribute_location("in_TexCoord");
-		m_ptrVAO->attribute(a,m_ptrVertices,2,GL_UNSIGNED_SHORT,true,sizeof(vertex_data),offsetof(vertex_data,u));
-		m_ptrVAO->enable_attribute(a);
-		
-		m_ptrVAO->element_array(m_ptrElements);
+		GLuint idx = start * vertices_per_glyph;
 
-		m_ptrVAO->unbind();
+		page->m_ptrVAO->draw_elements(GL_TRIANGLES,idx,idx + len * vertices_per_glyph - 1,elements_per_glyph * len,GL_UNSIGNED_SHORT,start * elements_per_glyph * sizeof(GLushort));
 	}
+}
 
-	OOBase::SharedPtr<vertex_data> attribs = m_ptrVertices->auto_map<vertex_data>(GL_MAP_WRITE_BIT,text.m_glyph_start * vertices_per_glyph * sizeof(vertex_data),len * vertices_per_glyph * sizeof(vertex_data));
-	vertex_data* a = attribs.get();
-	OOBase::SharedPtr<GLuint> ei = m_ptrElements->auto_map<GLuint>(GL_MAP_WRITE_BIT,text.m_glyph_start * elements_per_glyph * sizeof(GLuint),len * elements_per_glyph * sizeof(GLuint));
-	GLuint* e = ei.get();
-	GLuint idx = text.m_glyph_start * vertices_per_glyph;
+bool Indigo::Render::Font::shadow_program()
+{
+	if (m_info->m_packing != 0x04040400 || m_info->m_distance_field || !m_ptrProgram)
+		return false;
 
-	OOBase::uint32_t prev_glyph = OOBase::uint32_t(-1);
-	const OOBase::uint32_t* start = glyphs.data();
-	const OOBase::uint32_t* end = start + len;
-	float length = 0.0f;
-	text.m_glyph_len = len;
+	OOBase::SharedPtr<OOGL::Shader> shaders[2];
+	shaders[0] = Indigo::ShaderPool::add_shader("2d_textured_colour.vert",GL_VERTEX_SHADER,Indigo::static_resources());
+	shaders[1] = Indigo::ShaderPool::add_shader("font_shadow_blend.frag",GL_FRAGMENT_SHADER,Indigo::static_resources());
+	if (shaders[0] && shaders[1])
+		m_ptrShadowProgram = Indigo::ShaderPool::add_program("Font_8bit_Shadow",shaders,2);
 
-	while (start < end)
+	// The glyph VAOs were bound using the plain program's attribute locations
+	if (m_ptrShadowProgram && (m_ptrShadowProgram->attribute_location("in_Position") != m_ptrProgram->attribute_location("in_Position") ||
+			m_ptrShadowProgram->attribute_location("in_TexCoord") != m_ptrProgram->attribute_location("in_TexCoord")))
 	{
-		OOBase::uint32_t glyph = *start++;
-		if (glyph > 31 && glyph != 127 && (glyph < 128 || glyph > 159))
-		{
-			if (prev_glyph != OOBase::uint32_t(-1))
-			{
-				Indigo::Font::Info::kern_map_t::iterator k = m_info->m_mapKerning.find(OOBase::Pair<OOBase::uint32_t,OOBase::uint32_t>(prev_glyph,glyph));
-				if (k)
-					length += k->second;
-			}
-			prev_glyph = glyph;
-
-			Indigo::Font::Info::char_map_t::iterator i = m_info->m_mapCharInfo.find(glyph);
-			if (!i)
-				i = m_info->m_mapCharInfo.find(static_cast<OOBase::uint8_t>('?'));
-
-			a[0].x = length + i->second.left;
-			a[0].y = i->second.top;
-			a[1].x = a[0].x;
-			a[1].y = i->second.bottom;
-			a[2].x = length + i->second.right;
-			a[2].y = a[0].y;
-			a[3].x = a[2].x;
-			a[3].y = a[1].y;
-
-			a[0].u = i->second.u0;
-			a[0].v = i->second.v0;
-			a[1].u = a[0].u;
-			a[1].v = i->second.v1;
-			a[2].u = i->second.u1;
-			a[2].v = a[0].v;
-			a[3].u = a[2].u;
-			a[3].v = a[1].v;
-
-			e[0] = idx + 0;
-			e[1] = idx + 1;
-			e[2] = idx + 2;
-			e[3] = idx + 2;
-			e[4] = idx + 1;
-			e[5] = idx + 3;
-
-			a += vertices_per_glyph;
-			e += elements_per_glyph;
-			idx += vertices_per_glyph;
-
-			length += i->second.xadvance;
-		}
-		else
-		{
-			prev_glyph = OOBase::uint32_t(-1);
-		}
+		m_ptrShadowProgram.reset();
 	}
 
-	return true;
+	return m_ptrShadowProgram;
 }
 
-void Indigo::Render::Font::free_text(Text& text)
+bool Indigo::Render::Font::draw_shadowed(OOGL::State& state, const glm::mat4& mvp, const glm::vec4& colour, const glm::vec4& shadow, const glm::vec2& drop, GlyphPage* page, GLsizei start, GLsizei len)
 {
-	free_list_t::iterator i = m_listFree.insert(text.m_glyph_start,text.m_glyph_len);
-	if (i)
-	{
-		while (i != m_listFree.begin())
-		{
-			free_list_t::iterator j = i+1;
-			if (j && j->first == i->first + i->second)
-			{
-				// Merge i with j
-				i->second += j->second;
-				m_listFree.erase(j);
-			}
-			else
-			{
-				--i;
-			}
-		}
-	}
-}
+	// The shadow is sampled from within each glyph's own quad, so the drop must fit in the glyph padding
+	glm::vec2 drop_px = drop * static_cast<float>(m_info->m_line_height);
+	float pad_y = (m_info->m_padding[0] < m_info->m_padding[2] ? m_info->m_padding[0] : m_info->m_padding[2]);
+	float pad_x = (m_info->m_padding[1] < m_info->m_padding[3] ? m_info->m_padding[1] : m_info->m_padding[3]);
+	if (fabs(drop_px.x) > pad_x || fabs(drop_px.y) > pad_y || !m_info->m_tex_width || !m_info->m_tex_height)
+		return false;
 
-void Indigo::Render::Font::draw(OOGL::State& state, const glm::mat4& mvp, const glm::vec4& colour, GLsizei start, GLsizei len)
-{
-	if (len && colour.a > 0.f && m_ptrProgram && m_ptrTexture)
+	if (!m_ptrShadowProgram && !shadow_program())
+		return false;
+
+	if (page && len && (colour.a > 0.f || shadow.a > 0.f) && m_ptrTexture)
 	{
-		state.use(m_ptrProgram);
+		state.use(m_ptrShadowProgram);
 		state.bind(0,m_ptrTexture);
 
-		m_ptrProgram->uniform("in_Colour",colour);
-		m_ptrProgram->uniform("MVP",mvp);
+		m_ptrShadowProgram->uniform("in_Colour",colour);
+		m_ptrShadowProgram->uniform("in_Shadow",shadow);
+		m_ptrShadowProgram->uniform("in_Drop",glm::vec2(drop_px.x / m_info->m_tex_width,-drop_px.y / m_info->m_tex_height));
+		m_ptrShadowProgram->uniform("MVP",mvp);
+
+		// Padded quads overlap their neighbours, and each quad draws its own shadow, so a shadow
+		// dropped back along the line must be drawn before the glyph it falls on: draw last to first
+		GLsizei first = start;
+		if (drop_px.x < 0.f)
+			first = (GLsizei(2) << max_page_order) - start - len;
 
 		GLuint idx = start * vertices_per_glyph;
 
-		m_ptrVAO->draw_elements(GL_TRIANGLES,idx,idx+3,elements_per_glyph * len,GL_UNSIGNED_INT,start * elements_per_glyph * sizeof(GLuint));
+		page->m_ptrVAO->draw_elements(GL_TRIANGLES,idx,idx + len * vertices_per_glyph - 1,elements_per_glyph * len,GL_UNSIGNED_SHORT,first * elements_per_glyph * sizeof(GLushort));
 	}
+	return true;
 }
 
 Indigo::Render::Text::Text(const OOBase::SharedPtr<Font>& font, const char* sz, size_t len) :
-		m_font(font), m_glyph_start(0), m_glyph_len(0)
+		m_font(font)
 {
 	if (len == size_t(-1))
 		len = (sz ? strlen(sz) : 0);
@@ -481,10 +1579,11 @@ void Indigo::Render::Text::text(const char* sz, size_t len)
 	if (len == size_t(-1))
 		len = (sz ? strlen(sz) : 0);
 
-	m_font->free_text(*this);
+	// Update the existing run, rather than look up or lay out a new one
+	if (len && m_font->update_text(*this,sz,len))
+		return;
 
-	m_glyph_start = 0;
-	m_glyph_len = 0;
+	m_font->free_text(*this);
 
 	if (len)
 		m_font->alloc_text(*this,sz,len);
@@ -492,16 +1591,20 @@ void Indigo::Render::Text::text(const char* sz, size_t len)
 
 void Indigo::Render::Text::draw(OOGL::State& state, const glm::mat4& mvp, const glm::vec4& colour, GLsizei start, GLsizei length) const
 {
-	if (start > m_glyph_len)
-		start = m_glyph_len;
+	if (!m_run)
+		return;
+
+	GLsizei glyph_len = m_run->m_len;
+	if (start > glyph_len)
+		start = glyph_len;
 
 	if (length == -1)
-		length = m_glyph_len - start;
+		length = glyph_len - start;
 
-	if (start + length > m_glyph_len)
-		length = m_glyph_len - start;
+	if (start + length > glyph_len)
+		length = glyph_len - start;
 
-	m_font->draw(state,mvp,colour,m_glyph_start + start,length);
+	m_font->draw(state,mvp,colour,m_run->m_page,m_run->first() + start,length);
 }
 
 Indigo::Font::Font()
@@ -522,7 +1625,134 @@ bool Indigo::Font::load(const ResourceBundle& resource, const char* name)
 	if (!buffer)
 		return false;
 
-	return load(resource,buffer.get(),resource.size(name));
+	size_t len = static_cast<size_t>(resource.size(name));
+	if (is_cooked(buffer.get(),len))
+		return load_cooked(buffer,len);
+
+	if (is_truetype(buffer.get(),len))
+		return load_truetype(buffer,len,truetype_default_height);
+
+	return load(resource,buffer.get(),len);
+}
+
+bool Indigo::Font::load_truetype(const ResourceBundle& resource, const char* name, unsigned int pixel_height)
+{
+	OOBase::SharedPtr<const unsigned char> buffer = resource.load<unsigned char>(name);
+	if (!buffer)
+		return false;
+
+	return load_truetype(buffer,static_cast<size_t>(resource.size(name)),pixel_height);
+}
+
+bool Indigo::Font::load_truetype(const OOBase::SharedPtr<const unsigned char>& data, size_t len, unsigned int pixel_height)
+{
+	if (m_render_font)
+		LOG_ERROR_RETURN(("Font already loaded"),false);
+
+	if (!is_truetype(data.get(),len))
+		LOG_ERROR_RETURN(("Failed to load font data: Format not recognised"),false);
+
+	if (!pixel_height)
+		pixel_height = truetype_default_height;
+
+	m_info = OOBase::allocate_shared<Info>();
+	if (!m_info)
+		LOG_ERROR_RETURN(("Failed to allocate information block: %s",OOBase::system_error_text()),false);
+
+	OOBase::SharedPtr<Info::TrueType> truetype = OOBase::allocate_shared<Info::TrueType>();
+	if (!truetype)
+		LOG_ERROR_RETURN(("Failed to allocate information block: %s",OOBase::system_error_text()),false);
+
+	truetype->m_data = data;
+	if (!stbtt_InitFont(&truetype->m_font,data.get(),stbtt_GetFontOffsetForIndex(data.get(),0)))
+		LOG_ERROR_RETURN(("Failed to load font data: Invalid TrueType font"),false);
+
+	int ascent, descent, line_gap;
+	stbtt_GetFontVMetrics(&truetype->m_font,&ascent,&descent,&line_gap);
+
+	truetype->m_scale = stbtt_ScaleForPixelHeight(&truetype->m_font,static_cast<float>(pixel_height));
+	truetype->m_ascent = ascent * truetype->m_scale;
+
+	m_info->m_line_height = static_cast<OOBase::uint16_t>(ceil((ascent - descent + line_gap) * truetype->m_scale));
+	m_info->m_base_height = static_cast<OOBase::uint16_t>(ceil(truetype->m_ascent));
+	m_info->m_packing = 0x04040400;
+	m_info->m_tex_width = atlas_size;
+	m_info->m_tex_height = atlas_size;
+	m_info->m_padding[0] = m_info->m_padding[1] = m_info->m_padding[2] = m_info->m_padding[3] = truetype_padding;
+	m_info->m_truetype = truetype;
+
+	OOBase::Logger::log(OOBase::Logger::Information,"Loading TrueType font: %upx",pixel_height);
+
+	bool ret = false;
+	return render_pipe()->call(OOBase::make_delegate<OOBase::ThreadLocalAllocator>(this,&Indigo::Font::do_load),static_cast<OOBase::SharedPtr<Image>*>(NULL),size_t(0),&ret) && ret;
+}
+
+bool Indigo::Font::load_cooked(const OOBase::SharedPtr<const unsigned char>& data, size_t len)
+{
+	if (m_render_font)
+		LOG_ERROR_RETURN(("Font already loaded"),false);
+
+#if (OOBASE_BYTE_ORDER == OOBASE_BIG_ENDIAN)
+	LOG_ERROR_RETURN(("Cooked fonts are little-endian only"),false);
+#else
+	OOBase::SharedPtr<const unsigned char> blob = data;
+	if (reinterpret_cast<size_t>(blob.get()) & 3)
+	{
+		// Stored zip entries can start at any offset, the tables need 4 byte alignment
+		void* p = OOBase::CrtAllocator::allocate(len,16);
+		if (!p)
+			LOG_ERROR_RETURN(("Failed to allocate: %s",OOBase::system_error_text()),false);
+
+		memcpy(p,data.get(),len);
+		blob = OOBase::const_pointer_cast<const unsigned char>(OOBase::make_shared<unsigned char>(static_cast<unsigned char*>(p)));
+		if (!blob)
+		{
+			OOBase::CrtAllocator::free(p);
+			LOG_ERROR_RETURN(("Failed to allocate: %s",OOBase::system_error_text()),false);
+		}
+	}
+
+	const cooked_header* header = reinterpret_cast<const cooked_header*>(blob.get());
+	if (header->version < 1 || header->version > cooked_version)
+		LOG_ERROR_RETURN(("Failed to load font data: Unsupported cooked font version %u",header->version),false);
+
+	if (!header->line_height || (header->version >= 2 && len < sizeof(cooked_header)) ||
+			(header->char_offset & 3) || OOBase::uint64_t(header->char_offset) + OOBase::uint64_t(header->char_count) * sizeof(cooked_char) > len ||
+			(header->kern_offset & 3) || OOBase::uint64_t(header->kern_offset) + OOBase::uint64_t(header->kern_count) * sizeof(cooked_kern) > len ||
+			OOBase::uint64_t(header->pixel_offset) + OOBase::uint64_t(header->tex_width) * header->tex_height > len)
+	{
+		LOG_ERROR_RETURN(("Failed to load font data: Corrupt cooked font"),false);
+	}
+
+	m_info = OOBase::allocate_shared<Info>();
+	if (!m_info)
+		LOG_ERROR_RETURN(("Failed to allocate information block: %s",OOBase::system_error_text()),false);
+
+	OOBase::SharedPtr<Info::Cooked> cooked = OOBase::allocate_shared<Info::Cooked>();
+	if (!cooked)
+		LOG_ERROR_RETURN(("Failed to allocate information block: %s",OOBase::system_error_text()),false);
+
+	cooked->m_data = blob;
+	cooked->m_header = header;
+	cooked->m_chars = reinterpret_cast<const cooked_char*>(blob.get() + header->char_offset);
+	cooked->m_kerns = reinterpret_cast<const cooked_kern*>(blob.get() + header->kern_offset);
+	cooked->m_pixels = blob.get() + header->pixel_offset;
+
+	m_info->m_line_height = header->line_height;
+	m_info->m_base_height = header->base_height;
+	m_info->m_packing = header->packing;
+	m_info->m_tex_width = static_cast<OOBase::uint16_t>(header->tex_width);
+	m_info->m_tex_height = static_cast<OOBase::uint16_t>(header->tex_height);
+	m_info->m_distance_field = (header->flags & 1) != 0;
+	m_info->m_cooked = cooked;
+	if (header->version >= 2)
+		memcpy(m_info->m_padding,header->padding,4);
+
+	OOBase::Logger::log(OOBase::Logger::Information,"Loading cooked font: %u glyphs",header->char_count);
+
+	bool ret = false;
+	return render_pipe()->call(OOBase::make_delegate<OOBase::ThreadLocalAllocator>(this,&Indigo::Font::do_load),static_cast<OOBase::SharedPtr<Image>*>(NULL),size_t(0),&ret) && ret;
+#endif
 }
 
 bool Indigo::Font::load(const ResourceBundle& resource, const unsigned char* data, size_t len)
@@ -530,13 +1760,53 @@ bool Indigo::Font::load(const ResourceBundle& resource, const unsigned char* dat
 	if (m_render_font)
 		LOG_ERROR_RETURN(("Font already loaded"),false);
 
+	if (is_truetype(data,len) || is_cooked(data,len))
+	{
+		// stb_truetype and cooked fonts read the font data in place, so keep a copy
+		void* p = OOBase::CrtAllocator::allocate(len,16);
+		if (!p)
+			LOG_ERROR_RETURN(("Failed to allocate: %s",OOBase::system_error_text()),false);
+
+		memcpy(p,data,len);
+		OOBase::SharedPtr<const unsigned char> copy = OOBase::const_pointer_cast<const unsigned char>(OOBase::make_shared<unsigned char>(static_cast<unsigned char*>(p)));
+		if (!copy)
+		{
+			OOBase::CrtAllocator::free(p);
+			LOG_ERROR_RETURN(("Failed to allocate: %s",OOBase::system_error_text()),false);
+		}
+
+		if (is_cooked(data,len))
+			return load_cooked(copy,len);
+
+		return load_truetype(copy,len,truetype_default_height);
+	}
+
+	return load_bmfont(resource,data,len,false);
+}
+
+bool Indigo::Font::load_distance_field(const ResourceBundle& resource, const char* name)
+{
+	OOBase::SharedPtr<const unsigned char> buffer = resource.load<unsigned char>(name);
+	if (!buffer)
+		return false;
+
+	if (m_render_font)
+		LOG_ERROR_RETURN(("Font already loaded"),false);
+
+	return load_bmfont(resource,buffer.get(),static_cast<size_t>(resource.size(name)),true);
+}
+
+bool Indigo::Font::load_bmfont(const ResourceBundle& resource, const unsigned char* data, size_t len, bool distance_field)
+{
 	// BMF\0x3
-	if (data[0] != 66 || data[1] != 77 || data[2] != 70 || data[3] != 3)
+	if (len < 4 || data[0] != 66 || data[1] != 77 || data[2] != 70 || data[3] != 3)
 		LOG_ERROR_RETURN(("Failed to load font data: Format not recognised"),false);
 
 	m_info = OOBase::allocate_shared<Info>();
 	if (!m_info)
 		LOG_ERROR_RETURN(("Failed to allocate information block: %s",OOBase::system_error_text()),false);
+
+	m_info->m_distance_field = distance_field;
 	
 	const unsigned char* end = data + len;
 	float tex_width, tex_height, line_height;
@@ -554,6 +1824,13 @@ bool Indigo::Font::load(const ResourceBundle& resource, const unsigned char* dat
 		case 1:
 			{
 				OOBase::int16_t size = read_int16(data);
+
+				// Reserved bit 5 of bitField marks a signed distance field atlas
+				if (data[0] & 0x20)
+					m_info->m_distance_field = true;
+
+				memcpy(m_info->m_padding,data + 5,4);
+
 				if (size >= 0)
 					OOBase::Logger::log(OOBase::Logger::Information,"Loading font: %s %dpx",data + 12,size);
 				else
@@ -567,8 +1844,10 @@ bool Indigo::Font::load(const ResourceBundle& resource, const unsigned char* dat
 			m_info->m_line_height = read_uint16(data);
 			line_height = m_info->m_line_height;
 			m_info->m_base_height = read_uint16(data);
-			tex_width = read_uint16(data);
-			tex_height = read_uint16(data);
+			m_info->m_tex_width = read_uint16(data);
+			tex_width = m_info->m_tex_width;
+			m_info->m_tex_height = read_uint16(data);
+			tex_height = m_info->m_tex_height;
 			pages = read_uint16(data);
 			if (*data++ == 0x80)
 			{
@@ -693,32 +1972,30 @@ float Indigo::Font::measure_text(const char* sz, size_t s_len) const
 	if (s_len == size_t(-1))
 		s_len = strlen(sz);
 
-	OOBase::Vector<OOBase::uint32_t,OOBase::ThreadLocalAllocator> glyphs;
-	GLsizei len = utf8_to_glyphs(sz,s_len,glyphs);
+	OOBase::ScopedArrayPtr<OOBase::uint32_t,OOBase::ThreadLocalAllocator,256> glyphs;
+	if (!glyphs.resize(s_len))
+		LOG_ERROR_RETURN(("Failed to allocate glyph buffer: %s",OOBase::system_error_text()),result);
+
+	GLsizei len = 0;
+	size_t count = detail::utf8_to_glyphs(sz,s_len,glyphs.get(),len);
 	if (len)
 	{
 		OOBase::uint32_t prev_glyph = OOBase::uint32_t(-1);
-		const OOBase::uint32_t* start = glyphs.data();
-		const OOBase::uint32_t* end = start + len;
+		const OOBase::uint32_t* start = glyphs.get();
+		const OOBase::uint32_t* end = start + count;
 
 		while (start < end)
 		{
 			OOBase::uint32_t glyph = *start++;
-			if (glyph > 31 && glyph != 127 && (glyph < 128 || glyph > 159))
+			if (detail::drawable_glyph(glyph))
 			{
 				if (prev_glyph != OOBase::uint32_t(-1))
-				{
-					Info::kern_map_t::iterator k = m_info->m_mapKerning.find(OOBase::Pair<OOBase::uint32_t,OOBase::uint32_t>(prev_glyph,glyph));
-					if (k)
-						result += k->second;
-				}
+					result += m_info->kerning(prev_glyph,glyph);
 				prev_glyph = glyph;
 
-				Info::char_map_t::iterator i = m_info->m_mapCharInfo.find(glyph);
-				if (!i)
-					i = m_info->m_mapCharInfo.find(static_cast<OOBase::uint8_t>('?'));
-
-				result += i->second.xadvance;
+				struct Info::char_info ci = {0};
+				if (m_info->find_char(glyph,ci))
+					result += ci.xadvance;
 			}
 			else
 			{
@@ -729,3 +2006,294 @@ float Indigo::Font::measure_text(const char* sz, size_t s_len) const
 
 	return result;
 }
+
+bool Indigo::Render::Text::draw_shadowed(OOGL::State& state, const glm::mat4& mvp, const glm::vec4& colour, const glm::vec4& shadow, const glm::vec2& drop) const
+{
+	if (!m_run)
+		return true;
+
+	return m_font->draw_shadowed(state,mvp,colour,shadow,drop,m_run->m_page,m_run->first(),m_run->m_len);
+}
+
+struct Indigo::Render::TextBlock::Paragraph
+{
+	OOBase::String m_text;
+
+	// Laid out as one unwrapped line
+	OOBase::Vector<Font::PlacedGlyph,OOBase::ThreadLocalAllocator> m_glyphs;
+	float m_width;
+
+	// Index of the first glyph of every line after the first
+	OOBase::Vector<GLsizei,OOBase::ThreadLocalAllocator> m_breaks;
+	float m_wrap_width;
+
+	bool wrap(float width);
+	float line_width(GLsizei start, GLsizei end) const;
+};
+
+bool Indigo::Render::TextBlock::Paragraph::wrap(float width)
+{
+	// Returns true if the line breaks changed
+	bool fits = (width <= 0.f || m_width <= width);
+	bool fitted = (m_wrap_width <= 0.f || m_width <= m_wrap_width);
+	m_wrap_width = width;
+	if (fits && fitted)
+		return false;
+
+	OOBase::Vector<GLsizei,OOBase::ThreadLocalAllocator> breaks;
+	if (!fits)
+	{
+		const Font::PlacedGlyph* g = m_glyphs.data();
+		GLsizei len = static_cast<GLsizei>(m_glyphs.size());
+		GLsizei line_start = 0;
+		GLsizei last_space = -1;
+		for (GLsizei i = 0;i < len;++i)
+		{
+			// Spaces may overhang the right edge
+			if (g[i].m_glyph == ' ')
+			{
+				last_space = i;
+				continue;
+			}
+
+			float right = (i + 1 < len ? g[i+1].m_x : m_width);
+			if (right - g[line_start].m_x > width && i > line_start)
+			{
+				line_start = (last_space > line_start ? last_space + 1 : i);
+				last_space = -1;
+				if (!breaks.push_back(line_start))
+					LOG_ERROR_RETURN(("Failed to allocate line breaks: %s",OOBase::system_error_text()),true);
+			}
+		}
+	}
+
+	bool changed = (breaks.size() != m_breaks.size());
+	if (!changed && !breaks.empty())
+		changed = (memcmp(breaks.data(),m_breaks.data(),breaks.size() * sizeof(GLsizei)) != 0);
+
+	if (changed)
+	{
+		m_breaks.clear();
+		for (OOBase::Vector<GLsizei,OOBase::ThreadLocalAllocator>::iterator i=breaks.begin();i;++i)
+			m_breaks.push_back(*i);
+	}
+	return changed;
+}
+
+float Indigo::Render::TextBlock::Paragraph::line_width(GLsizei start, GLsizei end) const
+{
+	const Font::PlacedGlyph* g = m_glyphs.data();
+	GLsizei len = static_cast<GLsizei>(m_glyphs.size());
+
+	// Trailing spaces don't count towards alignment
+	while (end > start && g[end-1].m_glyph == ' ')
+		--end;
+
+	if (end == start)
+		return 0.f;
+
+	return (end < len ? g[end].m_x : m_width) - g[start].m_x;
+}
+
+Indigo::Render::TextBlock::TextBlock(const OOBase::SharedPtr<Font>& font, float width, eAlignment align) :
+		m_font(font),
+		m_width(width),
+		m_align(align),
+		m_lines(0)
+{
+	m_run = OOBase::allocate_shared<Font::GlyphRun,OOBase::ThreadLocalAllocator>();
+	if (!m_run)
+		LOG_ERROR(("Failed to allocate glyph run: %s",OOBase::system_error_text()));
+}
+
+Indigo::Render::TextBlock::~TextBlock()
+{
+	if (m_run)
+		m_font->retire_run(*m_run);
+}
+
+bool Indigo::Render::TextBlock::text(const char* sz, size_t len)
+{
+	if (len == size_t(-1))
+		len = (sz ? strlen(sz) : 0);
+
+	// Split into paragraphs at hard line breaks
+	OOBase::Vector<OOBase::Pair<const char*,size_t>,OOBase::ThreadLocalAllocator> strings;
+	for (const char* p = sz, *end = sz + len;p <= end && len;)
+	{
+		const char* nl = static_cast<const char*>(memchr(p,'\n',end - p));
+		if (!nl)
+			nl = end;
+
+		if (!strings.push_back(OOBase::Pair<const char*,size_t>(p,nl - p)))
+			LOG_ERROR_RETURN(("Failed to split text: %s",OOBase::system_error_text()),false);
+
+		p = nl + 1;
+	}
+
+	// Keep the paragraphs common to the start and end of the old text
+	size_t old_count = m_paragraphs.size();
+	size_t new_count = strings.size();
+	const OOBase::Pair<const char*,size_t>* str = strings.data();
+	OOBase::SharedPtr<Paragraph>* old = m_paragraphs.data();
+
+	size_t prefix = 0;
+	while (prefix < old_count && prefix < new_count &&
+			old[prefix]->m_text.length() == str[prefix].second && memcmp(old[prefix]->m_text.c_str(),str[prefix].first,str[prefix].second) == 0)
+	{
+		++prefix;
+	}
+
+	size_t suffix = 0;
+	while (suffix < old_count - prefix && suffix < new_count - prefix &&
+			old[old_count-1-suffix]->m_text.length() == str[new_count-1-suffix].second &&
+			memcmp(old[old_count-1-suffix]->m_text.c_str(),str[new_count-1-suffix].first,str[new_count-1-suffix].second) == 0)
+	{
+		++suffix;
+	}
+
+	if (prefix == old_count && prefix == new_count)
+		return true;
+
+	OOBase::Vector<OOBase::SharedPtr<Paragraph>,OOBase::ThreadLocalAllocator> paragraphs;
+	for (size_t i = 0;i < prefix;++i)
+	{
+		if (!paragraphs.push_back(old[i]))
+			LOG_ERROR_RETURN(("Failed to allocate paragraphs: %s",OOBase::system_error_text()),false);
+	}
+
+	for (size_t i = prefix;i < new_count - suffix;++i)
+	{
+		OOBase::SharedPtr<Paragraph> para = OOBase::allocate_shared<Paragraph,OOBase::ThreadLocalAllocator>();
+		if (!para)
+			LOG_ERROR_RETURN(("Failed to allocate paragraph: %s",OOBase::system_error_text()),false);
+
+		para->m_width = 0.f;
+		para->m_wrap_width = 0.f;
+		if (!para->m_text.assign(str[i].first,str[i].second) || !m_font->layout_text(str[i].first,str[i].second,para->m_glyphs,&para->m_width))
+			LOG_ERROR_RETURN(("Failed to lay out paragraph: %s",OOBase::system_error_text()),false);
+
+		para->m_wrap_width = 0.f;
+		para->wrap(m_width);
+
+		if (!paragraphs.push_back(para))
+			LOG_ERROR_RETURN(("Failed to allocate paragraphs: %s",OOBase::system_error_text()),false);
+	}
+
+	for (size_t i = old_count - suffix;i < old_count;++i)
+	{
+		if (!paragraphs.push_back(old[i]))
+			LOG_ERROR_RETURN(("Failed to allocate paragraphs: %s",OOBase::system_error_text()),false);
+	}
+
+	m_paragraphs.clear();
+	for (OOBase::Vector<OOBase::SharedPtr<Paragraph>,OOBase::ThreadLocalAllocator>::iterator i=paragraphs.begin();i;++i)
+		m_paragraphs.push_back(*i);
+
+	return update(prefix);
+}
+
+bool Indigo::Render::TextBlock::width(float width)
+{
+	if (width == m_width)
+		return true;
+
+	m_width = width;
+
+	size_t first = m_paragraphs.size();
+	size_t p = 0;
+	for (OOBase::Vector<OOBase::SharedPtr<Paragraph>,OOBase::ThreadLocalAllocator>::iterator i=m_paragraphs.begin();i;++i,++p)
+	{
+		if ((*i)->wrap(width) && first == m_paragraphs.size())
+			first = p;
+	}
+
+	// Anything but left alignment depends on the width of every line
+	return update(m_align == align_left ? first : 0);
+}
+
+bool Indigo::Render::TextBlock::alignment(eAlignment align)
+{
+	if (align == m_align)
+		return true;
+
+	m_align = align;
+	return update(0);
+}
+
+bool Indigo::Render::TextBlock::update(size_t first_paragraph)
+{
+	if (!m_run)
+		return false;
+
+	// The paragraphs before first_paragraph, and their lines, are unchanged
+	GLsizei first_glyph = 0;
+	GLsizei total = 0;
+	size_t line = 0;
+	size_t p = 0;
+	for (OOBase::Vector<OOBase::SharedPtr<Paragraph>,OOBase::ThreadLocalAllocator>::iterator i=m_paragraphs.begin();i;++i,++p)
+	{
+		GLsizei len = static_cast<GLsizei>((*i)->m_glyphs.size());
+		if (p < first_paragraph)
+		{
+			first_glyph += len;
+			line += (*i)->m_breaks.size() + 1;
+		}
+		total += len;
+	}
+
+	// After a failed write the run has nothing left to keep
+	if (first_glyph > static_cast<GLsizei>(m_run->m_glyphs.size()))
+		return update(0);
+
+	OOBase::ScopedArrayPtr<Font::PlacedGlyph,OOBase::ThreadLocalAllocator,256> placed;
+	if (!placed.resize(total > first_glyph ? total - first_glyph : 1))
+		LOG_ERROR_RETURN(("Failed to allocate glyph buffer: %s",OOBase::system_error_text()),false);
+
+	// Lines stack downwards from the first, which sits where a single line Text would
+	Font::PlacedGlyph* out = placed.get();
+	p = 0;
+	for (OOBase::Vector<OOBase::SharedPtr<Paragraph>,OOBase::ThreadLocalAllocator>::iterator i=m_paragraphs.begin();i;++i,++p)
+	{
+		if (p < first_paragraph)
+			continue;
+
+		const Paragraph& para = **i;
+		const Font::PlacedGlyph* g = para.m_glyphs.data();
+		GLsizei len = static_cast<GLsizei>(para.m_glyphs.size());
+
+		const GLsizei* breaks = para.m_breaks.data();
+		size_t break_count = para.m_breaks.size();
+		for (size_t b = 0;b <= break_count;++b,++line)
+		{
+			GLsizei start = (b == 0 ? 0 : breaks[b-1]);
+			GLsizei end = (b == break_count ? len : breaks[b]);
+
+			float offset = 0.f;
+			if (m_align != align_left && m_width > 0.f)
+			{
+				offset = m_width - para.line_width(start,end);
+				if (m_align == align_centre)
+					offset *= 0.5f;
+			}
+
+			for (GLsizei j = start;j < end;++j)
+			{
+				out->m_glyph = g[j].m_glyph;
+				out->m_x = g[j].m_x - g[start].m_x + offset;
+				out->m_y = -static_cast<float>(line);
+				++out;
+			}
+		}
+	}
+	m_lines = line;
+
+	// Only the glyphs from first_glyph on are compared, and only those that differ are written
+	return m_font->write_run(*m_run,placed.get(),first_glyph,total);
+}
+
+void Indigo::Render::TextBlock::draw(OOGL::State& state, const glm::mat4& mvp, const glm::vec4& colour) const
+{
+	if (m_run)
+		m_font->draw(state,mvp,colour,m_run->m_page,m_run->first(),m_run->m_len);
+}
@@ -21,24 +21,34 @@
 
 #include "../include/indigo/Image.h"
 #include "../include/indigo/Render.h"
+#include "../include/indigo/TextureManager.h"
 
 #include "Common.h"
 
+#include <OOGL/StateFns.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
 extern "C"
 {
+	// Pixels may be decoded on a worker thread and freed on another, so use the CRT heap
 	static void* wrap_malloc(size_t sz)
 	{
-		return OOBase::ThreadLocalAllocator::allocate(sz);
+		return OOBase::CrtAllocator::allocate(sz,16);
 	}
 
 	static void* wrap_realloc(void* p, size_t sz)
 	{
-		return OOBase::ThreadLocalAllocator::reallocate(p,sz);
+		return OOBase::CrtAllocator::reallocate(p,sz,16);
 	}
 
 	static void wrap_free(void* p)
 	{
-		OOBase::ThreadLocalAllocator::free(p);
+		OOBase::CrtAllocator::free(p);
 	}
 
 	#define STBI_MALLOC(sz)    wrap_malloc(sz)
@@ -51,12 +61,388 @@ extern "C"
 	#include "../3rdparty/stb/stb_image.h"
 }
 
+namespace
+{
+	class DecodePool
+	{
+	public:
+		typedef void (*callback_t)(void* p);
+
+		DecodePool();
+
+		~DecodePool();
+
+		bool enqueue(callback_t callback, void* param);
+
+	private:
+		static const size_t max_threads = 16;
+		size_t m_thread_count;
+
+		OOBase::Condition::Mutex m_lock;
+		OOBase::Condition        m_cond;
+		bool                     m_quit;
+
+		struct Item
+		{
+			Item() : m_callback(NULL), m_param(NULL)
+			{}
+
+			Item(callback_t c, void* p) : m_callback(c), m_param(p)
+			{}
+
+			callback_t m_callback;
+			void*      m_param;
+		};
+
+		OOBase::Queue<Item,OOBase::CrtAllocator> m_queue;
+		OOBase::SharedPtr<OOBase::Thread> m_threads[max_threads];
+
+		static int run(void* param);
+	};
+
+	typedef OOBase::Singleton<DecodePool> DECODE_POOL;
+
+	unsigned int s_mip_bias = 0;
+	unsigned int s_max_size = 0;
+
+	glm::uvec2 downscaled_size(unsigned int width, unsigned int height)
+	{
+		for (unsigned int bias = 0;bias < s_mip_bias || (s_max_size && (width > s_max_size || height > s_max_size));++bias)
+		{
+			if (width == 1 && height == 1)
+				break;
+
+			width = (width > 1 ? width / 2 : 1);
+			height = (height > 1 ? height / 2 : 1);
+		}
+		return glm::uvec2(width,height);
+	}
+}
+
+DecodePool::DecodePool() : m_thread_count(1), m_quit(false)
+{
+	// Leave a core for the logic and render threads
+#if defined(_WIN32)
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	long cores = static_cast<long>(si.dwNumberOfProcessors);
+#else
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	if (cores > 2)
+		m_thread_count = static_cast<size_t>(cores - 1);
+	if (m_thread_count > max_threads)
+		m_thread_count = max_threads;
+}
+
+DecodePool::~DecodePool()
+{
+	OOBase::Guard<OOBase::Condition::Mutex> guard(m_lock);
+	m_quit = true;
+	m_cond.broadcast();
+	guard.release();
+
+	for (size_t i = 0;i < m_thread_count;++i)
+	{
+		if (m_threads[i])
+			m_threads[i]->join();
+	}
+}
+
+bool DecodePool::enqueue(callback_t callback, void* param)
+{
+	OOBase::Guard<OOBase::Condition::Mutex> guard(m_lock);
+
+	if (!m_queue.push(Item(callback,param)))
+		LOG_ERROR_RETURN(("Failed to enqueue decode: %s",OOBase::system_error_text()),false);
+
+	// Threads are started lazily, and a pool that failed to start any falls back to the caller
+	bool started = false;
+	for (size_t i = 0;i < m_thread_count;++i)
+	{
+		if (!m_threads[i])
+		{
+			int err = 0;
+			m_threads[i] = OOBase::Thread::run(&run,this,err);
+			if (!m_threads[i])
+				LOG_WARNING(("Failed to start decode thread: %s",OOBase::system_error_text(err)));
+		}
+		if (m_threads[i])
+			started = true;
+	}
+
+	if (!started)
+	{
+		Item item;
+		m_queue.pop(&item);
+		return false;
+	}
+
+	m_cond.signal();
+	return true;
+}
+
+int DecodePool::run(void* param)
+{
+	DecodePool* pool = static_cast<DecodePool*>(param);
+
+	OOBase::Guard<OOBase::Condition::Mutex> guard(pool->m_lock);
+	for (;;)
+	{
+		Item item;
+		while (!pool->m_queue.pop(&item))
+		{
+			if (pool->m_quit)
+				return 0;
+
+			pool->m_cond.wait(pool->m_lock);
+		}
+
+		guard.release();
+
+		(*item.m_callback)(item.m_param);
+
+		guard.acquire();
+	}
+}
+
+namespace
+{
+	class TextureStreamer
+	{
+	public:
+		TextureStreamer() : m_next_slot(0)
+		{}
+
+		~TextureStreamer();
+
+		bool add(const void* owner, const OOBase::SharedPtr<OOGL::Texture>& texture, const unsigned char* pixels, GLenum format, GLsizei width, GLsizei height, size_t stride);
+		void cancel(const void* owner);
+		bool pending(const OOGL::Texture* texture) const;
+		void pump();
+
+	private:
+		static const size_t ring_size = 3;
+		static const size_t slot_size = 4 * 1024 * 1024;
+
+		struct Slot
+		{
+			Slot() : m_size(0), m_fence(0)
+			{}
+
+			OOBase::SharedPtr<OOGL::BufferObject> m_buffer;
+			size_t m_size;
+			GLsync m_fence;
+		};
+
+		struct Job
+		{
+			const void*                     m_owner;
+			OOBase::WeakPtr<OOGL::Texture>  m_texture;
+			const unsigned char*            m_pixels;
+			GLenum                          m_format;
+			GLsizei                         m_width;
+			GLsizei                         m_height;
+			size_t                          m_stride;
+			GLsizei                         m_next_row;
+		};
+
+		Slot m_slots[ring_size];
+		size_t m_next_slot;
+		OOBase::Vector<Job,OOBase::ThreadLocalAllocator> m_jobs;
+
+		bool slot_free(Slot& slot);
+	};
+
+	typedef OOGL::ContextSingleton<TextureStreamer> TEXTURE_STREAMER;
+}
+
+namespace Indigo
+{
+	void pump_texture_streams();
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	for (size_t i = 0;i < ring_size;++i)
+	{
+		if (m_slots[i].m_fence)
+			OOGL::StateFns::get_current()->glDeleteSync(m_slots[i].m_fence);
+	}
+}
+
+bool TextureStreamer::add(const void* owner, const OOBase::SharedPtr<OOGL::Texture>& texture, const unsigned char* pixels, GLenum format, GLsizei width, GLsizei height, size_t stride)
+{
+	Job job;
+	job.m_owner = owner;
+	job.m_texture = texture;
+	job.m_pixels = pixels;
+	job.m_format = format;
+	job.m_width = width;
+	job.m_height = height;
+	job.m_stride = stride;
+	job.m_next_row = 0;
+
+	if (!m_jobs.push_back(job))
+		LOG_ERROR_RETURN(("Failed to queue texture upload: %s",OOBase::system_error_text()),false);
+
+	return true;
+}
+
+void TextureStreamer::cancel(const void* owner)
+{
+	for (OOBase::Vector<Job,OOBase::ThreadLocalAllocator>::iterator i=m_jobs.begin();i;)
+	{
+		if (i->m_owner == owner)
+			i = m_jobs.erase(i);
+		else
+			++i;
+	}
+}
+
+bool TextureStreamer::pending(const OOGL::Texture* texture) const
+{
+	for (OOBase::Vector<Job,OOBase::ThreadLocalAllocator>::const_iterator i=m_jobs.begin();i;++i)
+	{
+		if (i->m_texture.lock().get() == texture)
+			return true;
+	}
+	return false;
+}
+
+bool TextureStreamer::slot_free(Slot& slot)
+{
+	if (slot.m_fence)
+	{
+		GLenum r = OOGL::StateFns::get_current()->glClientWaitSync(slot.m_fence,0,0);
+		if (r != GL_ALREADY_SIGNALED && r != GL_CONDITION_SATISFIED)
+			return false;
+
+		OOGL::StateFns::get_current()->glDeleteSync(slot.m_fence);
+		slot.m_fence = 0;
+	}
+	return true;
+}
+
+void TextureStreamer::pump()
+{
+	// At most one chunk per free slot each frame, so the driver never waits on a buffer still in flight
+	for (size_t n = 0;n < ring_size && !m_jobs.empty();++n)
+	{
+		Slot& slot = m_slots[m_next_slot];
+		if (!slot_free(slot))
+			break;
+
+		Job& job = *m_jobs.begin();
+		OOBase::SharedPtr<OOGL::Texture> texture = job.m_texture.lock();
+		if (!texture)
+		{
+			m_jobs.erase(m_jobs.begin());
+			continue;
+		}
+
+		size_t rows = slot_size / job.m_stride;
+		if (!rows)
+			rows = 1;
+		if (rows > static_cast<size_t>(job.m_height - job.m_next_row))
+			rows = job.m_height - job.m_next_row;
+
+		size_t bytes = rows * job.m_stride;
+		if (!slot.m_buffer || slot.m_size < bytes)
+		{
+			slot.m_size = (bytes > slot_size ? bytes : slot_size);
+			slot.m_buffer = OOBase::allocate_shared<OOGL::BufferObject,OOBase::ThreadLocalAllocator>(GL_PIXEL_UNPACK_BUFFER,GL_STREAM_DRAW,slot.m_size);
+			if (!slot.m_buffer)
+			{
+				slot.m_size = 0;
+				LOG_ERROR(("Failed to allocate pixel buffer: %s",OOBase::system_error_text()));
+				break;
+			}
+		}
+
+		{
+			OOBase::SharedPtr<unsigned char> dest = slot.m_buffer->auto_map<unsigned char>(GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT,0,bytes);
+			if (!dest)
+			{
+				LOG_ERROR(("Failed to map pixel buffer"));
+				break;
+			}
+
+			memcpy(dest.get(),job.m_pixels + job.m_next_row * job.m_stride,bytes);
+		}
+
+		slot.m_buffer->bind();
+		glPixelStorei(GL_UNPACK_ALIGNMENT,1);
+		texture->sub_image(0,0,job.m_next_row,job.m_width,static_cast<GLsizei>(rows),job.m_format,GL_UNSIGNED_BYTE,NULL);
+		glPixelStorei(GL_UNPACK_ALIGNMENT,4);
+		slot.m_buffer->unbind();
+
+		slot.m_fence = OOGL::StateFns::get_current()->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE,0);
+		m_next_slot = (m_next_slot + 1) % ring_size;
+
+		job.m_next_row += static_cast<GLsizei>(rows);
+		if (job.m_next_row >= job.m_height)
+			m_jobs.erase(m_jobs.begin());
+	}
+}
+
+void Indigo::pump_texture_streams()
+{
+	ASSERT_RENDER_THREAD();
+
+	TEXTURE_STREAMER::instance().pump();
+}
+
+bool Indigo::detail::texture_streaming(const OOGL::Texture* texture)
+{
+	// Streamed textures are allocated without data, so are not drawn until this is false
+	ASSERT_RENDER_THREAD();
+
+	return TEXTURE_STREAMER::instance().pending(texture);
+}
+
+bool Indigo::detail::run_on_decode_pool(void (*callback)(void* p), void* param)
+{
+	// For other loaders that want the same worker threads, false if none could start
+	return DECODE_POOL::instance().enqueue(callback,param);
+}
+
+struct Indigo::Image::AsyncLoad
+{
+	// Set when decoding again, through reload_pixels(), rather than from m_buffer
+	const Image*  m_image;
+
+	OOBase::SharedPtr<const unsigned char> m_buffer;
+	size_t        m_len;
+	int           m_components;
+	unsigned int  m_flags;
+	unsigned int  m_max_width;
+	unsigned int  m_max_height;
+	void*         m_pixels;
+	void*         m_mips;
+	unsigned int  m_mip_levels;
+	const char*   m_error;
+	OOBase::Event m_done;
+};
+
 Indigo::Image::Image() :
 		m_width(0),
 		m_height(0),
 		m_components(0),
 		m_valid_components(0),
-		m_pixels(NULL)
+		m_pixels(NULL),
+		m_streaming(false),
+		m_compressed(NULL),
+		m_tex_rect(0.f,0.f,1.f,1.f),
+		m_managed(false),
+		m_source_len(0),
+		m_source_components(0),
+		m_discard(false),
+		m_mips(NULL),
+		m_mip_first(1),
+		m_mip_levels(0),
+		m_flags(0),
+		m_full_size(0)
 {
 }
 
@@ -67,23 +453,389 @@ Indigo::Image::~Image()
 
 bool Indigo::Image::valid() const
 {
-	return m_pixels && m_width && m_height && m_valid_components;
+	OOBase::Guard<OOBase::Condition::Mutex> guard(m_pixel_lock);
+	return (m_pixels || m_async || m_compressed || reloadable()) && m_width && m_height && m_valid_components;
 }
 
-bool Indigo::Image::load(const ResourceBundle& resource, const char* name, int components)
+bool Indigo::Image::load_async(const ResourceBundle& resource, const char* name, int components, unsigned int flags)
 {
+	unload();
+
 	OOBase::SharedPtr<const unsigned char> buffer = resource.load<unsigned char>(name);
 	if (!buffer)
 		return false;
 
-	return this->load(buffer.get(),resource.size(name),components);
+	size_t len = resource.size(name);
+	if (is_compressed(buffer.get(),len))
+		return load_compressed(buffer,len);
+
+	int x,y,c = 0;
+	if (!stbi_info_from_memory(buffer.get(),(int)len,&x,&y,&c))
+		LOG_ERROR_RETURN(("Failed to load image: %s",stbi_failure_reason()),false);
+
+	// Shared, as the load may be completed on either the logic or the render thread
+	OOBase::SharedPtr<AsyncLoad> job = OOBase::allocate_shared<AsyncLoad,OOBase::CrtAllocator>();
+	if (!job)
+		LOG_ERROR_RETURN(("Failed to allocate: %s",OOBase::system_error_text()),false);
+
+	job->m_image = NULL;
+	job->m_buffer = buffer;
+	job->m_len = len;
+	job->m_components = components;
+	job->m_flags = flags;
+	job->m_max_width = 0;
+	job->m_max_height = 0;
+	job->m_pixels = NULL;
+	job->m_mips = NULL;
+	job->m_mip_levels = 0;
+	job->m_error = NULL;
+
+	glm::uvec2 full_size(x,y);
+	if ((flags & eLF_downscale) && (components == 4 || (!components && c == 4)))
+	{
+		glm::uvec2 sz = downscaled_size(x,y);
+		if (sz != full_size)
+		{
+			job->m_max_width = x = sz.x;
+			job->m_max_height = y = sz.y;
+			m_full_size = full_size;
+		}
+	}
+
+	// Without a worker, decode here and complete as normal
+	if (!DECODE_POOL::instance().enqueue(&decode_async,job.get()))
+		decode_async(job.get());
+
+	OOBase::Guard<OOBase::Condition::Mutex> guard(m_pixel_lock);
+	m_async = job;
+	m_flags = flags;
+	m_width = x;
+	m_height = y;
+	m_valid_components = c;
+
+	if (!components)
+		m_components = c;
+	else
+		m_components = components;
+
+	keep_source(buffer,len,components);
+	return true;
 }
 
-bool Indigo::Image::load(const unsigned char* buffer, size_t len, int components)
+void Indigo::Image::decode_async(void* param)
+{
+	AsyncLoad* job = static_cast<AsyncLoad*>(param);
+
+	int x,y,c = 0;
+	if (job->m_image)
+	{
+		unsigned int width = 0, height = 0;
+		job->m_pixels = job->m_image->reload_pixels(width,height);
+		if (!job->m_pixels)
+			job->m_error = "Failed to decode again";
+
+		x = width;
+		y = height;
+		c = job->m_image->m_valid_components;
+	}
+	else
+		job->m_pixels = decode(job->m_buffer.get(),job->m_len,job->m_components,job->m_flags,job->m_max_width,job->m_max_height,x,y,c,job->m_error);
+
+	if (job->m_pixels && (job->m_flags & eLF_mipmaps) && (job->m_components == 4 || (!job->m_components && c == 4)))
+		job->m_mips = make_mips(job->m_pixels,x,y,job->m_mip_levels);
+
+	job->m_done.set();
+}
+
+bool Indigo::Image::ready() const
+{
+	OOBase::Guard<OOBase::Condition::Mutex> guard(m_pixel_lock);
+	return !m_async || m_async->m_done.is_set();
+}
+
+bool Indigo::Image::wait() const
 {
+	// Only waits: the result is taken by whichever thread next uses the pixels, under m_pixel_lock
+	OOBase::Guard<OOBase::Condition::Mutex> guard(m_pixel_lock);
+	OOBase::SharedPtr<AsyncLoad> job = m_async;
+	if (!job)
+		return m_pixels != NULL || m_compressed != NULL || reloadable();
+
+	guard.release();
+
+	job->m_done.wait();
+	return job->m_pixels != NULL;
+}
+
+bool Indigo::Image::complete_async() const
+{
+	// Called with m_pixel_lock held
+	if (!m_async)
+		return m_pixels != NULL || m_compressed != NULL || reloadable();
+
+	m_async->m_done.wait();
+
+	// restore_levels() decodes the whole chain again, replacing what drop_levels() kept
+	Image* self = const_cast<Image*>(this);
+	self->free_pixels();
+	self->m_pixels = m_async->m_pixels;
+	self->m_mips = m_async->m_mips;
+	self->m_mip_levels = m_async->m_mip_levels;
+	if (!m_pixels)
+	{
+		LOG_ERROR(("Failed to load image: %s",m_async->m_error ? m_async->m_error : "unknown error"));
+
+		self->m_source.reset();
+		self->m_full_size = glm::uvec2(0);
+		self->m_width = 0;
+		self->m_height = 0;
+		self->m_components = 0;
+		self->m_valid_components = 0;
+	}
+	else if (!m_discard && !(m_flags & eLF_mipmaps))
+		self->m_source.reset();
+
+	self->m_async.reset();
+
+	return m_pixels != NULL;
+}
+
+void Indigo::Image::finish_async()
+{
+	// Wait unlocked, so the render thread isn't held on m_pixel_lock for the whole decode
+	wait();
+
+	OOBase::Guard<OOBase::Condition::Mutex> guard(m_pixel_lock);
+	complete_async();
+}
+
+void Indigo::Image::downscale(unsigned int mip_bias, unsigned int max_size)
+{
+	s_mip_bias = mip_bias;
+	s_max_size = max_size;
+}
+
+void* Indigo::Image::decode(const unsigned char* buffer, size_t len, int components, unsigned int flags, unsigned int max_width, unsigned int max_height, int& width, int& height, int& valid_components, const char*& error)
+{
+	// Raw textures from tools/texcook are copied as they are, ignoring flags
+	if (len >= 4 && memcmp(buffer,"ITEX",4) == 0)
+		return decode_raw(buffer,len,components,width,height,valid_components,error);
+
+	// We widen RGB to RGBA faster than stb does
+	int req_components = components;
+	if (components == 4 && stbi_info_from_memory(buffer,(int)len,&width,&height,&valid_components) && valid_components == 3)
+		req_components = 3;
+
+	void* p = stbi_load_from_memory(buffer,(int)len,&width,&height,&valid_components,req_components);
+	if (!p)
+	{
+		error = stbi_failure_reason();
+		return NULL;
+	}
+
+	if (req_components != components)
+	{
+		void* rgba = expand_rgba(p,static_cast<size_t>(width) * height);
+		stbi_image_free(p);
+		if (!rgba)
+		{
+			error = "Out of memory";
+			return NULL;
+		}
+		p = rgba;
+	}
+
+	if ((flags & eLF_downscale) && max_width && (components == 4 || (!components && valid_components == 4)))
+	{
+		p = downscale(p,width,height,max_width,max_height);
+		if (!p)
+		{
+			error = "Out of memory";
+			return NULL;
+		}
+	}
+
+	if ((flags & eLF_premultiply) && (components == 4 || (!components && valid_components == 4)))
+		premultiply(p,static_cast<size_t>(width) * height);
+
+	return p;
+}
+
+void Indigo::Image::free_mips()
+{
+	if (m_mips)
+	{
+		if (!m_mapped)
+			OOBase::CrtAllocator::free(m_mips);
+		m_mips = NULL;
+		m_mip_first = 1;
+		m_mip_levels = 0;
+	}
+}
+
+void Indigo::Image::free_pixels()
+{
+	// Raw textures are used in place, so their pixels and mips belong to the resource
+	free_mips();
+
+	if (m_mapped)
+		m_mapped.reset();
+	else if (m_pixels)
+		stbi_image_free(m_pixels);
+
+	m_pixels = NULL;
+}
+
+bool Indigo::Image::load(const ResourceBundle& resource, const char* name, int components, unsigned int flags)
+{
+	OOBase::SharedPtr<const unsigned char> buffer = resource.load<unsigned char>(name);
+	if (!buffer)
+		return false;
+
+	size_t len = resource.size(name);
+	if (is_compressed(buffer.get(),len))
+		return load_compressed(buffer,len);
+
+	// Subclasses override the unflagged load
+	if (!(flags ? load_pixels(buffer.get(),len,components,flags) : this->load(buffer.get(),len,components)))
+		return false;
+
+	keep_source(buffer,len,components);
+	return true;
+}
+
+void Indigo::Image::keep_source(const OOBase::SharedPtr<const unsigned char>& buffer, size_t len, int components)
+{
+	// The encoded image is far smaller than the pixels, and lets us drop them after upload, or decode
+	// dropped levels again.  Otherwise it is only needed until the pixels are first decoded
+	if (m_pixels && !m_discard && !(m_flags & eLF_mipmaps))
+		return;
+
+	m_source = buffer;
+	m_source_len = len;
+	m_source_components = components;
+}
+
+void* Indigo::Image::decode_source(unsigned int& width, unsigned int& height) const
+{
+	int x,y,c = 0;
+	const char* error = NULL;
+	void* p = decode(m_source.get(),m_source_len,m_source_components,m_flags,m_width,m_height,x,y,c,error);
+	if (!p)
+		LOG_ERROR_RETURN(("Failed to reload image: %s",error),p);
+
+	width = x;
+	height = y;
+	return p;
+}
+
+void* Indigo::Image::reload_pixels(unsigned int& width, unsigned int& height) const
+{
+	void* p = decode_source(width,height);
+	if (p && (width != m_width || height != m_height))
+	{
+		stbi_image_free(p);
+		LOG_ERROR_RETURN(("Failed to reload image: Image has changed size"),NULL);
+	}
+	return p;
+}
+
+bool Indigo::Image::reload_async() const
+{
+	// Called with m_pixel_lock held.  The mip chain is built with the pixels, on the decode thread,
+	// and anything drop_levels() kept is replaced when the job completes
+	OOBase::SharedPtr<AsyncLoad> job = OOBase::allocate_shared<AsyncLoad,OOBase::CrtAllocator>();
+	if (!job)
+		LOG_ERROR_RETURN(("Failed to allocate: %s",OOBase::system_error_text()),false);
+
+	job->m_image = this;
+	job->m_len = 0;
+	job->m_components = m_components;
+	job->m_flags = m_flags;
+	job->m_max_width = m_width;
+	job->m_max_height = m_height;
+	job->m_pixels = NULL;
+	job->m_mips = NULL;
+	job->m_mip_levels = 0;
+	job->m_error = NULL;
+
+	if (!DECODE_POOL::instance().enqueue(&decode_async,job.get()))
+		decode_async(job.get());
+
+	const_cast<Image*>(this)->m_async = job;
+	return true;
+}
+
+bool Indigo::Image::restore_pixels(bool block) const
+{
+	// Called with m_pixel_lock held.  Without block, false while the pixels are still being decoded,
+	// with m_async set, so the caller can try again next frame
+	if (m_async)
+	{
+		if (!block && !m_async->m_done.is_set())
+			return false;
+
+		if (!complete_async())
+			return false;
+	}
+
 	if (m_pixels)
+		return true;
+
+	if (!reloadable() || !reload_async())
+		return false;
+
+	if (!block && !m_async->m_done.is_set())
+		return false;
+
+	return complete_async();
+}
+
+bool Indigo::Image::reloadable() const
+{
+	return m_source;
+}
+
+void Indigo::Image::release_pixels() const
+{
+	if (m_pixels && reloadable())
 	{
 		stbi_image_free(m_pixels);
+		const_cast<Image*>(this)->m_pixels = NULL;
+		const_cast<Image*>(this)->free_mips();
+	}
+}
+
+void Indigo::Image::leave_atlas()
+{
+	// The page reads m_atlas_page under m_pixel_lock when it copies us, and mustn't be freed while we hold it
+	OOBase::SharedPtr<Image> page;
+	OOBase::Guard<OOBase::Condition::Mutex> guard(m_pixel_lock);
+	page = m_atlas_page;
+	m_atlas_page.reset();
+	m_tex_rect = glm::vec4(0.f,0.f,1.f,1.f);
+}
+
+bool Indigo::Image::load(const unsigned char* buffer, size_t len, int components)
+{
+	return load_pixels(buffer,len,components,0);
+}
+
+bool Indigo::Image::load_pixels(const unsigned char* buffer, size_t len, int components, unsigned int flags)
+{
+	finish_async();
+	stop_stream();
+	free_compressed();
+
+	leave_atlas();
+	m_source.reset();
+	m_flags = 0;
+	m_full_size = glm::uvec2(0);
+	free_mips();
+
+	if (m_pixels)
+	{
+		free_pixels();
 
 		m_width = 0;
 		m_height = 0;
@@ -92,29 +844,59 @@ bool Indigo::Image::load(const unsigned char* buffer, size_t len, int components
 		m_pixels = 0;
 	}
 	
+	// The same quality tier as load_async()
 	int x,y,c = 0;
-	void* p = stbi_load_from_memory(buffer,(int)len,&x,&y,&c,components);
+	unsigned int max_width = 0, max_height = 0;
+	glm::uvec2 full_size(0);
+	if ((flags & eLF_downscale) && stbi_info_from_memory(buffer,(int)len,&x,&y,&c) && (components == 4 || (!components && c == 4)))
+	{
+		glm::uvec2 sz = downscaled_size(x,y);
+		if (sz != glm::uvec2(x,y))
+		{
+			max_width = sz.x;
+			max_height = sz.y;
+			full_size = glm::uvec2(x,y);
+		}
+	}
+
+	const char* error = NULL;
+	void* p = decode(buffer,len,components,flags,max_width,max_height,x,y,c,error);
 	if (!p)
-		LOG_ERROR_RETURN(("Failed to load image: %s",stbi_failure_reason()),false);
+		LOG_ERROR_RETURN(("Failed to load image: %s",error),false);
 
 	m_pixels = p;
 	m_width = x;
 	m_height = y;
 	m_valid_components = c;
+	m_flags = flags;
+	m_full_size = full_size;
 
 	if (!components)
 		m_components = c;
 	else
 		m_components = components;
 
+	if ((flags & eLF_mipmaps) && m_components == 4)
+		m_mips = make_mips(m_pixels,m_width,m_height,m_mip_levels);
+
 	return true;
 }
 
 bool Indigo::Image::create(const glm::vec4& colour)
 {
+	finish_async();
+	stop_stream();
+	free_compressed();
+
+	leave_atlas();
+	m_source.reset();
+	m_flags = 0;
+	m_full_size = glm::uvec2(0);
+	free_mips();
+
 	if (m_pixels)
 	{
-		stbi_image_free(m_pixels);
+		free_pixels();
 
 		m_width = 0;
 		m_height = 0;
@@ -146,9 +928,16 @@ bool Indigo::Image::create(const glm::vec4& colour)
 glm::vec4 Indigo::Image::pixel(const glm::uvec2& pos) const
 {
 	glm::vec4 pixel(0.f);
-	if (m_pixels)
+	if (!wait())
+		return pixel;
+
+	OOBase::Guard<OOBase::Condition::Mutex> guard(m_pixel_lock);
+	if (restore_pixels())
 	{
-		const char* p = static_cast<const char*>(m_pixels) + (m_width * pos.y + pos.x) * m_components;
+		// pos is in the full size, before any downscaling
+		glm::uvec2 at = (m_full_size.x ? pos * glm::uvec2(m_width,m_height) / m_full_size : pos);
+
+		const char* p = static_cast<const char*>(m_pixels) + (m_width * at.y + at.x) * m_components;
 		pixel.r = p[0]/255.f;
 		if (m_components > 1)
 			pixel.g = p[1]/255.f;
@@ -160,25 +949,140 @@ glm::vec4 Indigo::Image::pixel(const glm::uvec2& pos) const
 	return pixel;
 }
 
+void Indigo::Image::cancel_stream()
+{
+	TEXTURE_STREAMER::instance().cancel(this);
+}
+
+void Indigo::Image::stop_stream()
+{
+	// The render thread reads m_pixels until the upload completes, and sets m_streaming under m_pixel_lock
+	OOBase::Guard<OOBase::Condition::Mutex> guard(m_pixel_lock);
+	bool streaming = m_streaming;
+	m_streaming = false;
+	guard.release();
+
+	if (streaming)
+		render_pipe()->call(OOBase::make_delegate<OOBase::ThreadLocalAllocator>(this,&Image::cancel_stream));
+}
+
+void Indigo::Image::forget_managed()
+{
+	Render::TextureManager::instance().forget(this);
+}
+
+void Indigo::Image::stop_managed()
+{
+	// Managed textures remake themselves from this image after eviction, m_managed is set under m_pixel_lock
+	OOBase::Guard<OOBase::Condition::Mutex> guard(m_pixel_lock);
+	bool managed = m_managed;
+	m_managed = false;
+	guard.release();
+
+	if (managed)
+		render_pipe()->call(OOBase::make_delegate<OOBase::ThreadLocalAllocator>(this,&Image::forget_managed));
+}
+
 void Indigo::Image::unload()
 {
-	if (m_pixels)
+	finish_async();
+	stop_stream();
+	stop_managed();
+	free_compressed();
+	free_pixels();
+
+	leave_atlas();
+	m_texture.reset();
+	m_source.reset();
+	m_flags = 0;
+	m_full_size = glm::uvec2(0);
+	free_mips();
+}
+
+static GLenum pixel_format(unsigned int components)
+{
+	switch (components)
 	{
-		stbi_image_free(m_pixels);
-		m_pixels = NULL;
+	case 1:
+		return GL_RED;
+
+	case 2:
+		return GL_RG;
+
+	case 3:
+		return GL_RGB;
+
+	case 4:
+		return GL_RGBA;
+
+	default:
+		return 0;
 	}
+}
 
-	m_texture.reset();
+size_t Indigo::Image::texture_bytes(GLenum internalFormat, GLsizei levels) const
+{
+	size_t texel = 4;
+	switch (internalFormat)
+	{
+	case GL_R8:
+		texel = 1;
+		break;
+
+	case GL_RG8:
+		texel = 2;
+		break;
+
+	default:
+		break;
+	}
+
+	// levels of 0 is the full chain
+	size_t bytes = 0;
+	unsigned int w = m_width, h = m_height;
+	for (GLsizei level = 0;levels == 0 || level < levels;++level)
+	{
+		bytes += static_cast<size_t>(w) * h * texel;
+		if (w == 1 && h == 1)
+			break;
+
+		w = (w > 1 ? w / 2 : 1);
+		h = (h > 1 ? h / 2 : 1);
+	}
+	return bytes;
+}
+
+void Indigo::Image::track_texture(const OOBase::SharedPtr<OOGL::Texture>& texture, GLenum internalFormat, size_t bytes) const
+{
+	Render::TextureManager::instance().track(this,texture,internalFormat,m_width,m_height,bytes);
 }
 
-OOBase::SharedPtr<OOGL::Texture> Indigo::Image::make_texture(GLenum internalFormat, bool& cached, GLsizei levels) const
+OOBase::SharedPtr<OOGL::Texture> Indigo::Image::make_texture(GLenum internalFormat, bool& cached, GLsizei levels, bool block) const
 {
 	ASSERT_RENDER_THREAD();
 
 	OOBase::SharedPtr<OOGL::Texture> tex;
-	if (!m_pixels)
+	if (m_atlas_page)
+	{
+		// Atlas pages have no mipmaps, so neighbouring images never bleed together
+		bool page_cached = true;
+		tex = m_atlas_page->make_texture(internalFormat,page_cached,1,block);
+		if (tex && !page_cached)
+			tex->parameter(GL_TEXTURE_MAX_LEVEL,0);
+
+		cached = cached && page_cached;
+		return tex;
+	}
+
+	if (!block && !ready())
+		return tex;
+
+	if (!wait())
 		LOG_ERROR_RETURN(("Invalid image for make_texture"),tex);
 
+	if (m_compressed)
+		return make_compressed_texture(cached,levels);
+
 	if (cached)
 	{
 		tex = m_texture.lock();
@@ -188,34 +1092,243 @@ OOBase::SharedPtr<OOGL::Texture> Indigo::Image::make_texture(GLenum internalForm
 		cached = false;
 	}
 
-	GLenum format = 0;
-	switch (m_components)
+	GLenum format = pixel_format(m_components);
+	if (!format)
+		LOG_ERROR_RETURN(("Invalid image for make_texture"),tex);
+
+	OOBase::Guard<OOBase::Condition::Mutex> guard(m_pixel_lock);
+	if (!restore_pixels(block))
 	{
-	case 1:
-		format = GL_RED;
-		break;
+		// Discarded pixels are being decoded again, so there is nothing to draw this frame
+		if (m_async)
+			return tex;
 
-	case 2:
-		format = GL_RG;
-		break;
+		LOG_ERROR_RETURN(("Invalid image for make_texture"),tex);
+	}
 
-	case 3:
-		format = GL_RGB;
-		break;
+	if (m_mips && levels != 1)
+		tex = make_mipmapped_texture(internalFormat,levels);
+	else
+	{
+		// Rows are tightly packed, whatever the component count
+		glPixelStorei(GL_UNPACK_ALIGNMENT,1);
+		tex = OOBase::allocate_shared<OOGL::Texture,OOBase::ThreadLocalAllocator>(GL_TEXTURE_2D,levels,internalFormat,m_width,m_height,format,GL_UNSIGNED_BYTE,m_pixels);
+		glPixelStorei(GL_UNPACK_ALIGNMENT,4);
+	}
+	if (!tex)
+		LOG_ERROR_RETURN(("Failed to allocate texture"),tex);
 
-	case 4:
-		format = GL_RGBA;
-		break;
+	// Streaming uploads read the pixels for several frames
+	if (m_discard && !m_streaming)
+		release_pixels();
 
-	default:
-		LOG_ERROR(("Invalid image for make_texture"));
+	track_texture(tex,internalFormat,texture_bytes(internalFormat,levels));
+	m_texture = tex;
+	return tex;
+}
+
+OOBase::SharedPtr<OOGL::Texture> Indigo::Image::make_mipmapped_texture(GLenum internalFormat, GLsizei levels) const
+{
+	// Upload the chain from the decode thread, rather than have the driver generate it
+	GLsizei count = static_cast<GLsizei>(m_mip_levels) + 1;
+	if (levels > 0 && levels < count)
+		count = levels;
+
+	OOBase::SharedPtr<OOGL::Texture> tex = OOBase::allocate_shared<OOGL::Texture,OOBase::ThreadLocalAllocator>(GL_TEXTURE_2D);
+	if (!tex)
 		return tex;
+
+	OOGL::State::get_current()->bind(0,tex);
+	glTexImage2D(GL_TEXTURE_2D,0,internalFormat,m_width,m_height,0,GL_RGBA,GL_UNSIGNED_BYTE,m_pixels);
+
+	const unsigned char* p = static_cast<const unsigned char*>(m_mips);
+	for (GLsizei level = 1;level < count;++level)
+	{
+		GLsizei w = (m_width >> level) ? (m_width >> level) : 1;
+		GLsizei h = (m_height >> level) ? (m_height >> level) : 1;
+		glTexImage2D(GL_TEXTURE_2D,level,internalFormat,w,h,0,GL_RGBA,GL_UNSIGNED_BYTE,p);
+		p += static_cast<size_t>(w) * h * 4;
+	}
+
+	tex->parameter(GL_TEXTURE_BASE_LEVEL,0);
+	tex->parameter(GL_TEXTURE_MAX_LEVEL,count - 1);
+	return tex;
+}
+
+OOBase::SharedPtr<OOGL::Texture> Indigo::Image::stream_texture(GLenum internalFormat, bool& cached) const
+{
+	ASSERT_RENDER_THREAD();
+
+	OOBase::SharedPtr<OOGL::Texture> tex;
+	if (!wait())
+		LOG_ERROR_RETURN(("Invalid image for stream_texture"),tex);
+
+	// Compressed payloads are small enough to upload directly
+	if (m_compressed)
+		return make_compressed_texture(cached,1);
+
+	if (cached)
+	{
+		tex = m_texture.lock();
+		if (tex)
+			return tex;
+
+		cached = false;
 	}
 
-	tex = OOBase::allocate_shared<OOGL::Texture,OOBase::ThreadLocalAllocator>(GL_TEXTURE_2D,levels,internalFormat,m_width,m_height,format,GL_UNSIGNED_BYTE,m_pixels);
+	GLenum format = pixel_format(m_components);
+	if (!format)
+		LOG_ERROR_RETURN(("Invalid image for stream_texture"),tex);
+
+	OOBase::Guard<OOBase::Condition::Mutex> guard(m_pixel_lock);
+	if (!restore_pixels())
+		LOG_ERROR_RETURN(("Invalid image for stream_texture"),tex);
+
+	tex = OOBase::allocate_shared<OOGL::Texture,OOBase::ThreadLocalAllocator>(GL_TEXTURE_2D,1,internalFormat,m_width,m_height,format,GL_UNSIGNED_BYTE,static_cast<const void*>(NULL));
 	if (!tex)
 		LOG_ERROR_RETURN(("Failed to allocate texture"),tex);
 
+	if (!TEXTURE_STREAMER::instance().add(this,tex,static_cast<const unsigned char*>(m_pixels),format,m_width,m_height,m_width * m_components))
+	{
+		tex.reset();
+		return tex;
+	}
+
+	track_texture(tex,internalFormat,texture_bytes(internalFormat,1));
+	m_streaming = true;
 	m_texture = tex;
 	return tex;
 }
+
+glm::uvec2 Indigo::Image::level_size(unsigned int level) const
+{
+	glm::uvec2 sz(m_width,m_height);
+	for (;level && (sz.x > 1 || sz.y > 1);--level)
+	{
+		sz.x = (sz.x > 1 ? sz.x / 2 : 1);
+		sz.y = (sz.y > 1 ? sz.y / 2 : 1);
+	}
+	return sz;
+}
+
+OOBase::SharedPtr<OOGL::Texture> Indigo::Image::make_tile(GLenum internalFormat, unsigned int level, const glm::uvec4& rect) const
+{
+	ASSERT_RENDER_THREAD();
+
+	OOBase::SharedPtr<OOGL::Texture> tex;
+	if (!wait() || m_compressed)
+		LOG_ERROR_RETURN(("Invalid image for make_tile"),tex);
+
+	GLenum format = pixel_format(m_components);
+	if (!format || (level && m_components != 4))
+		LOG_ERROR_RETURN(("Invalid image for make_tile"),tex);
+
+	OOBase::Guard<OOBase::Condition::Mutex> guard(m_pixel_lock);
+	const unsigned char* p = NULL;
+	if (!level)
+	{
+		// Discarded pixels are decoded again on a worker, as restore_levels() would
+		if (!restore_pixels(false))
+		{
+			if (m_async)
+				return tex;
+
+			LOG_ERROR_RETURN(("Invalid image for make_tile"),tex);
+		}
+
+		p = static_cast<const unsigned char*>(m_pixels);
+	}
+	else
+	{
+		// The chain is only ever built on the decode thread, it is far too slow to build here
+		if ((m_async && !complete_async()) || !m_mips || level < m_mip_first || level > m_mip_levels)
+			LOG_ERROR_RETURN(("Mip level %u is not loaded for make_tile, load with eLF_mipmaps",level),tex);
+
+		// Levels are packed from m_mip_first down
+		p = static_cast<const unsigned char*>(m_mips);
+		for (unsigned int l = m_mip_first;l < level;++l)
+		{
+			glm::uvec2 sz = level_size(l);
+			p += static_cast<size_t>(sz.x) * sz.y * 4;
+		}
+	}
+
+	glm::uvec2 sz = level_size(level);
+	if (!rect.z || !rect.w || rect.x + rect.z > sz.x || rect.y + rect.w > sz.y)
+		LOG_ERROR_RETURN(("Invalid rectangle for make_tile"),tex);
+
+	p += (static_cast<size_t>(rect.y) * sz.x + rect.x) * m_components;
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT,1);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH,sz.x);
+	tex = OOBase::allocate_shared<OOGL::Texture,OOBase::ThreadLocalAllocator>(GL_TEXTURE_2D,1,internalFormat,rect.z,rect.w,format,GL_UNSIGNED_BYTE,static_cast<const void*>(p));
+	glPixelStorei(GL_UNPACK_ROW_LENGTH,0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT,4);
+	if (!tex)
+		LOG_ERROR_RETURN(("Failed to allocate texture"),tex);
+
+	Render::TextureManager::instance().track(this,tex,internalFormat,rect.z,rect.w,static_cast<size_t>(rect.z) * rect.w * 4);
+	return tex;
+}
+
+void Indigo::Image::drop_levels(unsigned int level) const
+{
+	OOBase::Guard<OOBase::Condition::Mutex> guard(m_pixel_lock);
+	if (!level || !m_source || m_async || !m_mips || level > m_mip_levels || (!m_pixels && level <= m_mip_first))
+		return;
+
+	Image* self = const_cast<Image*>(this);
+	if (level > m_mip_first)
+	{
+		// Move the levels we keep to a block of their own, they are a third the size of the level above
+		size_t offset = 0, bytes = 0;
+		for (unsigned int l = m_mip_first;l <= m_mip_levels;++l)
+		{
+			glm::uvec2 sz = level_size(l);
+			if (l < level)
+				offset += static_cast<size_t>(sz.x) * sz.y * 4;
+			else
+				bytes += static_cast<size_t>(sz.x) * sz.y * 4;
+		}
+
+		void* mips = OOBase::CrtAllocator::allocate(bytes,16);
+		if (!mips)
+			return;
+
+		memcpy(mips,static_cast<const unsigned char*>(m_mips) + offset,bytes);
+		OOBase::CrtAllocator::free(m_mips);
+		self->m_mips = mips;
+		self->m_mip_first = level;
+	}
+
+	if (m_pixels)
+	{
+		stbi_image_free(m_pixels);
+		self->m_pixels = NULL;
+	}
+}
+
+bool Indigo::Image::has_level(unsigned int level) const
+{
+	OOBase::Guard<OOBase::Condition::Mutex> guard(m_pixel_lock);
+	if (m_async && (!m_async->m_done.is_set() || !complete_async()))
+		return false;
+
+	if (!level)
+		return m_pixels != NULL;
+
+	return m_mips && level >= m_mip_first && level <= m_mip_levels;
+}
+
+bool Indigo::Image::restore_levels() const
+{
+	OOBase::Guard<OOBase::Condition::Mutex> guard(m_pixel_lock);
+	if (m_async)
+		return true;
+
+	// Level 0 alone can come back without a mip chain, after discard_pixels()
+	if (!m_source || (m_pixels && !(m_flags & eLF_mipmaps)))
+		return false;
+
+	return reload_async();
+}
@@ -0,0 +1,270 @@
+///////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2015 Rick Taylor
+//
+// This file is part of the Indigo boardgame engine.
+//
+// Indigo is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Indigo is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Indigo.  If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////////
+
+#include "../include/indigo/ImageAtlas.h"
+
+#include "Common.h"
+
+namespace
+{
+	struct Shelf
+	{
+		unsigned int m_y;
+		unsigned int m_height;
+		unsigned int m_x;
+	};
+
+	// Copies w x h pixels to (x,y) of the page, with a one pixel border of their own edge pixels
+	void copy_image(unsigned char* pixels, size_t stride, const unsigned char* src, unsigned int w, unsigned int h, unsigned int x, unsigned int y)
+	{
+		for (unsigned int row = 0;row < h + 2;++row)
+		{
+			unsigned int src_row = (row == 0 ? 0 : (row > h ? h - 1 : row - 1));
+			const unsigned char* s = src + src_row * w * 4;
+			unsigned char* d = pixels + (y + row) * stride + x * 4;
+
+			memcpy(d,s,4);
+			memcpy(d + 4,s,w * 4);
+			memcpy(d + 4 + w * 4,s + (w - 1) * 4,4);
+		}
+	}
+}
+
+class Indigo::ImageAtlas::Page : public Image
+{
+public:
+	struct Member
+	{
+		OOBase::WeakPtr<Image> m_image;
+		unsigned int           m_x;
+		unsigned int           m_y;
+	};
+
+	// Read on the decode thread
+	OOBase::Vector<Member,OOBase::CrtAllocator> m_members;
+
+protected:
+	virtual bool reloadable() const
+	{
+		return true;
+	}
+
+	virtual void* reload_pixels(unsigned int& width, unsigned int& height) const
+	{
+		width = m_width;
+		height = m_height;
+		return ImageAtlas::compose(*this);
+	}
+};
+
+Indigo::ImageAtlas::ImageAtlas(unsigned int page_size) :
+		m_page_size(page_size)
+{
+}
+
+bool Indigo::ImageAtlas::add(const OOBase::SharedPtr<Image>& image)
+{
+	if (!image || m_images.find(image))
+		return true;
+
+	if (!m_images.push_back(image))
+		LOG_ERROR_RETURN(("Failed to add image to atlas: %s",OOBase::system_error_text()),false);
+
+	return true;
+}
+
+void Indigo::ImageAtlas::clear()
+{
+	m_images.clear();
+	m_pages.clear();
+}
+
+bool Indigo::ImageAtlas::build()
+{
+	// Each image gets a one pixel border of its own edge pixels, so bilinear filtering never samples a neighbour
+	const unsigned int max_size = m_page_size / 2;
+
+	OOBase::Vector<OOBase::SharedPtr<Image>,OOBase::ThreadLocalAllocator> candidates;
+	for (image_vector_t::iterator i=m_images.begin();i;++i)
+	{
+		Image* image = i->get();
+		if (image->m_atlas_page || !image->wait())
+			continue;
+
+		OOBase::Guard<OOBase::Condition::Mutex> guard(image->m_pixel_lock);
+		if (!image->restore_pixels() || image->m_components != 4 ||
+				image->m_width + 2 > max_size || image->m_height + 2 > max_size)
+		{
+			continue;
+		}
+
+		if (!candidates.push_back(*i))
+			LOG_ERROR_RETURN(("Failed to allocate: %s",OOBase::system_error_text()),false);
+
+		// Keep the tallest first, for tighter shelves
+		OOBase::SharedPtr<Image>* c = candidates.data();
+		for (size_t j = candidates.size() - 1;j > 0 && c[j-1]->m_height < c[j]->m_height;--j)
+			OOBase::swap(c[j-1],c[j]);
+	}
+
+	if (candidates.size() < 2)
+		return true;
+
+	OOBase::Vector<Placement,OOBase::ThreadLocalAllocator> placements;
+	OOBase::Vector<Shelf,OOBase::ThreadLocalAllocator> shelves;
+	size_t page_first = 0;
+	unsigned int page_height = 0;
+
+	for (size_t n = 0;n < candidates.size();++n)
+	{
+		const OOBase::SharedPtr<Image>& image = candidates.data()[n];
+		unsigned int w = image->m_width + 2;
+		unsigned int h = image->m_height + 2;
+
+		Shelf* shelf = NULL;
+		for (size_t s = 0;s < shelves.size() && !shelf;++s)
+		{
+			if (shelves.data()[s].m_height >= h && shelves.data()[s].m_x + w <= m_page_size)
+				shelf = &shelves.data()[s];
+		}
+
+		if (!shelf)
+		{
+			if (page_height + h > m_page_size)
+			{
+				if (!build_page(placements.data() + page_first,placements.size() - page_first,page_height))
+					return false;
+
+				page_first = placements.size();
+				page_height = 0;
+				shelves.clear();
+			}
+
+			Shelf new_shelf = { page_height, h, 0 };
+			if (!shelves.push_back(new_shelf))
+				LOG_ERROR_RETURN(("Failed to allocate: %s",OOBase::system_error_text()),false);
+
+			shelf = &shelves.data()[shelves.size() - 1];
+			page_height += h;
+		}
+
+		Placement placement = { image, shelf->m_x, shelf->m_y };
+		if (!placements.push_back(placement))
+			LOG_ERROR_RETURN(("Failed to allocate: %s",OOBase::system_error_text()),false);
+
+		shelf->m_x += w;
+	}
+
+	return build_page(placements.data() + page_first,placements.size() - page_first,page_height);
+}
+
+bool Indigo::ImageAtlas::build_page(const Placement* placements, size_t count, unsigned int height)
+{
+	OOBase::SharedPtr<Page> page = OOBase::allocate_shared<Page,OOBase::ThreadLocalAllocator>();
+	if (!page)
+		LOG_ERROR_RETURN(("Failed to allocate: %s",OOBase::system_error_text()),false);
+
+	page->m_width = m_page_size;
+	page->m_height = height;
+	page->m_components = 4;
+	page->m_valid_components = 4;
+	page->discard_pixels();
+
+	for (size_t n = 0;n < count;++n)
+	{
+		Page::Member member;
+		member.m_image = placements[n].m_image;
+		member.m_x = placements[n].m_x;
+		member.m_y = placements[n].m_y;
+		if (!page->m_members.push_back(member))
+			LOG_ERROR_RETURN(("Failed to allocate: %s",OOBase::system_error_text()),false);
+	}
+
+	// Always the page's lock before a member's, as compose() may run on the decode thread
+	OOBase::Guard<OOBase::Condition::Mutex> guard(page->m_pixel_lock);
+
+	page->m_pixels = compose(*page);
+	if (!page->m_pixels)
+		return false;
+
+	if (!m_pages.push_back(page))
+		LOG_ERROR_RETURN(("Failed to allocate: %s",OOBase::system_error_text()),false);
+
+	const glm::vec2 page_size(static_cast<float>(m_page_size),static_cast<float>(height));
+	for (size_t n = 0;n < count;++n)
+	{
+		Image* image = placements[n].m_image.get();
+		glm::vec2 origin(static_cast<float>(placements[n].m_x + 1),static_cast<float>(placements[n].m_y + 1));
+
+		OOBase::Guard<OOBase::Condition::Mutex> image_guard(image->m_pixel_lock);
+		image->m_atlas_page = page;
+		image->m_tex_rect = glm::vec4(origin / page_size,(origin + glm::vec2(image->m_width,image->m_height)) / page_size);
+		image->m_texture.reset();
+		image->free_mips();
+
+		// The page has a copy now
+		if (image->m_discard)
+			image->release_pixels();
+	}
+
+	return true;
+}
+
+void* Indigo::ImageAtlas::compose(const Page& page)
+{
+	const size_t stride = static_cast<size_t>(page.m_width) * 4;
+
+	unsigned char* pixels = static_cast<unsigned char*>(OOBase::CrtAllocator::allocate(stride * page.m_height,16));
+	if (!pixels)
+		LOG_ERROR_RETURN(("Failed to allocate atlas page: %s",OOBase::system_error_text()),pixels);
+
+	memset(pixels,0,stride * page.m_height);
+
+	for (OOBase::Vector<Page::Member,OOBase::CrtAllocator>::const_iterator i=page.m_members.begin();i;++i)
+	{
+		// Gone, or moved to another page, so its area is never drawn
+		OOBase::SharedPtr<Image> image = i->m_image.lock();
+		if (!image)
+			continue;
+
+		OOBase::Guard<OOBase::Condition::Mutex> guard(image->m_pixel_lock);
+		if (image->m_atlas_page && image->m_atlas_page.get() != &page)
+			continue;
+
+		// Members that have dropped their pixels are decoded again, just for the copy
+		const void* src = image->m_pixels;
+		void* decoded = NULL;
+		if (!src)
+		{
+			unsigned int width,height;
+			src = decoded = image->reload_pixels(width,height);
+			if (!src)
+				continue;
+		}
+
+		copy_image(pixels,stride,static_cast<const unsigned char*>(src),image->m_width,image->m_height,i->m_x,i->m_y);
+
+		if (decoded)
+			OOBase::CrtAllocator::free(decoded);
+	}
+
+	return pixels;
+}
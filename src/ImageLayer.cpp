@@ -41,6 +41,7 @@ namespace
 		Indigo::Render::Quad m_quad;
 		OOBase::SharedPtr<OOGL::Texture> m_texture;
 		glm::vec4 m_colour;
+		mutable bool m_streaming;
 
 		glm::mat4 m_mvp;
 	};
@@ -50,13 +51,18 @@ namespace
 		Indigo::Render::Layer(window),
 		m_texture(texture),
 		m_colour(colour),
+		m_streaming(true),
 		m_mvp(2.f,0.f,0.f,0.f,0.f,2.f,0.f,0.f,0.f,0.f,-1.f,0.f,-1.f,-1.f,0.f,1.f)
 {
 }
 
 void ::ImageLayer::on_draw(OOGL::State& glState) const
 {
-	if (m_texture)
+	// The texture holds undefined texels until its stream completes
+	if (m_streaming && m_texture)
+		m_streaming = Indigo::detail::texture_streaming(m_texture.get());
+
+	if (m_texture && !m_streaming)
 	{
 		glState.enable(GL_BLEND);
 		glBlendFunc(GL_SRC_ALPHA,GL_ONE_MINUS_SRC_ALPHA);
@@ -78,7 +84,7 @@ OOBase::SharedPtr<Indigo::Render::Layer> Indigo::ImageLayer::create_render_layer
 {
 	OOBase::SharedPtr< ::ImageLayer> layer;
 	bool cached = true;
-	OOBase::SharedPtr<OOGL::Texture> texture = m_image->make_texture(GL_RGBA8,cached,1);
+	OOBase::SharedPtr<OOGL::Texture> texture = m_image->stream_texture(GL_RGBA8,cached);
 	if (!texture)
 		return layer;
 
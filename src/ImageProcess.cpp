@@ -0,0 +1,290 @@
+///////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2015 Rick Taylor
+//
+// This file is part of the Indigo boardgame engine.
+//
+// Indigo is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Indigo is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Indigo.  If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////////
+
+#include "../include/indigo/Image.h"
+
+#include "Common.h"
+
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define INDIGO_IMAGE_SSE2 1
+#endif
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#define INDIGO_IMAGE_SSSE3 1
+#endif
+
+namespace
+{
+	// sRGB <-> 12 bit linear, so mips average light rather than encoded values.
+	// Alpha is already linear, and is carried as a << 4 in the same 12 bits
+	struct GammaTables
+	{
+		GammaTables()
+		{
+			for (int i = 0;i < 256;++i)
+			{
+				float c = i / 255.f;
+				float l = (c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f,2.4f));
+				to_linear[i] = static_cast<unsigned short>(l * 4095.f + 0.5f);
+			}
+
+			for (int i = 0;i < 4096;++i)
+			{
+				float l = i / 4095.f;
+				float c = (l <= 0.0031308f ? l * 12.92f : 1.055f * powf(l,1.f / 2.4f) - 0.055f);
+				to_srgb[i] = static_cast<unsigned char>(c * 255.f + 0.5f);
+			}
+		}
+
+		unsigned short to_linear[256];
+		unsigned char  to_srgb[4096];
+	};
+
+	const GammaTables s_gamma;
+
+	void linearize_row(const unsigned char* src, unsigned short* dest, unsigned int width)
+	{
+		for (unsigned int x = 0;x < width;++x)
+		{
+			dest[0] = s_gamma.to_linear[src[0]];
+			dest[1] = s_gamma.to_linear[src[1]];
+			dest[2] = s_gamma.to_linear[src[2]];
+			dest[3] = static_cast<unsigned short>(src[3] << 4);
+			src += 4;
+			dest += 4;
+		}
+	}
+
+	void downsample(const unsigned char* src, unsigned int width, unsigned int height, unsigned char* dest, unsigned int new_width, unsigned int new_height, unsigned short* scratch)
+	{
+		unsigned short* row0 = scratch;
+		unsigned short* row1 = row0 + width * 4;
+		unsigned short* sum = row1 + width * 4;
+
+		for (unsigned int y = 0;y < new_height;++y)
+		{
+			unsigned int y0 = y * 2;
+			unsigned int y1 = (y0 + 1 < height ? y0 + 1 : y0);
+
+			linearize_row(src + y0 * width * 4,row0,width);
+			linearize_row(src + y1 * width * 4,row1,width);
+
+			unsigned int x = 0;
+#if defined(INDIGO_IMAGE_SSE2)
+			// Two output pixels from four input pixels of each row.  The sums fit in 16 bits, as 4 * 4095 < 32768
+			const __m128i round = _mm_set1_epi16(2);
+			for (;x + 2 <= new_width && x * 2 + 4 <= width;x += 2)
+			{
+				__m128i a = _mm_add_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + x * 8)),_mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + x * 8)));
+				__m128i b = _mm_add_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + x * 8 + 8)),_mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + x * 8 + 8)));
+				__m128i s = _mm_add_epi16(_mm_unpacklo_epi64(a,b),_mm_unpackhi_epi64(a,b));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(sum + x * 4),_mm_srli_epi16(_mm_add_epi16(s,round),2));
+			}
+#endif
+			for (;x < new_width;++x)
+			{
+				unsigned int x0 = x * 2;
+				unsigned int x1 = (x0 + 1 < width ? x0 + 1 : x0);
+				for (unsigned int c = 0;c < 4;++c)
+					sum[x * 4 + c] = static_cast<unsigned short>((row0[x0 * 4 + c] + row0[x1 * 4 + c] + row1[x0 * 4 + c] + row1[x1 * 4 + c] + 2) >> 2);
+			}
+
+			const unsigned short* s = sum;
+			unsigned char* d = dest + y * new_width * 4;
+			for (x = 0;x < new_width;++x)
+			{
+				d[0] = s_gamma.to_srgb[s[0]];
+				d[1] = s_gamma.to_srgb[s[1]];
+				d[2] = s_gamma.to_srgb[s[2]];
+				d[3] = static_cast<unsigned char>((s[3] + 8) >> 4);
+				s += 4;
+				d += 4;
+			}
+		}
+	}
+}
+
+void* Indigo::Image::expand_rgba(const void* rgb, size_t count)
+{
+	unsigned char* rgba = static_cast<unsigned char*>(OOBase::CrtAllocator::allocate(count * 4,16));
+	if (!rgba)
+		LOG_ERROR_RETURN(("Failed to allocate: %s",OOBase::system_error_text()),rgba);
+
+	const unsigned char* src = static_cast<const unsigned char*>(rgb);
+	unsigned char* dest = rgba;
+	size_t i = 0;
+
+#if defined(INDIGO_IMAGE_SSSE3)
+	// Four pixels at a time, but each load reads 16 of the 12 bytes, so stop short of the end
+	const __m128i shuffle = _mm_setr_epi8(0,1,2,-1,3,4,5,-1,6,7,8,-1,9,10,11,-1);
+	const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xFF000000));
+	for (;i + 6 <= count;i += 4)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dest),_mm_or_si128(_mm_shuffle_epi8(v,shuffle),alpha));
+		src += 12;
+		dest += 16;
+	}
+#endif
+
+	for (;i < count;++i)
+	{
+		dest[0] = src[0];
+		dest[1] = src[1];
+		dest[2] = src[2];
+		dest[3] = 0xFF;
+		src += 3;
+		dest += 4;
+	}
+
+	return rgba;
+}
+
+void Indigo::Image::premultiply(void* rgba, size_t count)
+{
+	// c * a / 255, rounded, as (t + (t >> 8)) >> 8 where t = c * a + 128
+	unsigned char* p = static_cast<unsigned char*>(rgba);
+	size_t i = 0;
+
+#if defined(INDIGO_IMAGE_SSE2)
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i round = _mm_set1_epi16(128);
+	const __m128i rgb_mask = _mm_setr_epi16(-1,-1,-1,0,-1,-1,-1,0);
+	const __m128i alpha_one = _mm_setr_epi16(0,0,0,255,0,0,0,255);
+	for (;i + 4 <= count;i += 4)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+		__m128i halves[2] = { _mm_unpacklo_epi8(v,zero), _mm_unpackhi_epi8(v,zero) };
+		for (int h = 0;h < 2;++h)
+		{
+			// Alpha into every lane of its pixel, but multiply alpha itself by 255 so it stays put
+			__m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(halves[h],_MM_SHUFFLE(3,3,3,3)),_MM_SHUFFLE(3,3,3,3));
+			a = _mm_or_si128(_mm_and_si128(a,rgb_mask),alpha_one);
+
+			__m128i t = _mm_add_epi16(_mm_mullo_epi16(halves[h],a),round);
+			halves[h] = _mm_srli_epi16(_mm_add_epi16(t,_mm_srli_epi16(t,8)),8);
+		}
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(p),_mm_packus_epi16(halves[0],halves[1]));
+		p += 16;
+	}
+#endif
+
+	for (;i < count;++i)
+	{
+		unsigned int a = p[3];
+		for (int c = 0;c < 3;++c)
+		{
+			unsigned int t = p[c] * a + 128;
+			p[c] = static_cast<unsigned char>((t + (t >> 8)) >> 8);
+		}
+		p += 4;
+	}
+}
+
+void* Indigo::Image::make_mips(const void* rgba, unsigned int width, unsigned int height, unsigned int& levels)
+{
+	size_t total = 0;
+	levels = 0;
+	for (unsigned int w = width, h = height;w > 1 || h > 1;++levels)
+	{
+		w = (w > 1 ? w / 2 : 1);
+		h = (h > 1 ? h / 2 : 1);
+		total += static_cast<size_t>(w) * h * 4;
+	}
+
+	if (!levels)
+		return NULL;
+
+	unsigned char* mips = static_cast<unsigned char*>(OOBase::CrtAllocator::allocate(total,16));
+	if (!mips)
+		LOG_ERROR_RETURN(("Failed to allocate: %s",OOBase::system_error_text()),mips);
+
+	// Two linear rows of the source, and one of sums
+	unsigned short* scratch = static_cast<unsigned short*>(OOBase::CrtAllocator::allocate(width * 3 * 4 * sizeof(unsigned short),16));
+	if (!scratch)
+	{
+		OOBase::CrtAllocator::free(mips);
+		LOG_ERROR_RETURN(("Failed to allocate: %s",OOBase::system_error_text()),NULL);
+	}
+
+	const unsigned char* src = static_cast<const unsigned char*>(rgba);
+	unsigned char* dest = mips;
+	for (unsigned int w = width, h = height;w > 1 || h > 1;)
+	{
+		unsigned int nw = (w > 1 ? w / 2 : 1);
+		unsigned int nh = (h > 1 ? h / 2 : 1);
+
+		downsample(src,w,h,dest,nw,nh,scratch);
+
+		src = dest;
+		dest += static_cast<size_t>(nw) * nh * 4;
+		w = nw;
+		h = nh;
+	}
+
+	OOBase::CrtAllocator::free(scratch);
+	return mips;
+}
+
+void* Indigo::Image::downscale(void* rgba, int& width, int& height, unsigned int max_width, unsigned int max_height)
+{
+	// Halve until it fits, freeing each larger level as soon as the next is made
+	unsigned int w = width, h = height;
+	if (w <= max_width && h <= max_height)
+		return rgba;
+
+	unsigned short* scratch = static_cast<unsigned short*>(OOBase::CrtAllocator::allocate(w * 3 * 4 * sizeof(unsigned short),16));
+	if (!scratch)
+	{
+		OOBase::CrtAllocator::free(rgba);
+		LOG_ERROR_RETURN(("Failed to allocate: %s",OOBase::system_error_text()),NULL);
+	}
+
+	while (w > max_width || h > max_height)
+	{
+		unsigned int nw = (w > 1 ? w / 2 : 1);
+		unsigned int nh = (h > 1 ? h / 2 : 1);
+
+		unsigned char* next = static_cast<unsigned char*>(OOBase::CrtAllocator::allocate(static_cast<size_t>(nw) * nh * 4,16));
+		if (!next)
+		{
+			OOBase::CrtAllocator::free(scratch);
+			OOBase::CrtAllocator::free(rgba);
+			LOG_ERROR_RETURN(("Failed to allocate: %s",OOBase::system_error_text()),NULL);
+		}
+
+		downsample(static_cast<const unsigned char*>(rgba),w,h,next,nw,nh,scratch);
+
+		OOBase::CrtAllocator::free(rgba);
+		rgba = next;
+		w = nw;
+		h = nh;
+	}
+
+	OOBase::CrtAllocator::free(scratch);
+	width = w;
+	height = h;
+	return rgba;
+}
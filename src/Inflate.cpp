@@ -0,0 +1,553 @@
+///////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2015 Rick Taylor
+//
+// This file is part of the Indigo boardgame engine.
+//
+// Indigo is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Indigo is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Indigo.  If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////////
+
+#include "Common.h"
+
+namespace
+{
+	// Table entries: bits 0-4 are the bits to consume, 5-7 the type,
+	// 8-11 the extra bits (or subtable bits), and 16-31 the value
+	enum EntryType
+	{
+		eLiteral = 0,
+		eLength = 1,
+		eDistance = 1,
+		eEndOfBlock = 2,
+		eSubtable = 3,
+		eInvalid = 4
+	};
+
+	inline OOBase::uint32_t make_entry(unsigned int bits, unsigned int type, unsigned int extra, unsigned int value)
+	{
+		return bits | (type << 5) | (extra << 8) | (value << 16);
+	}
+
+	inline unsigned int entry_bits(OOBase::uint32_t e) { return e & 0x1F; }
+	inline unsigned int entry_type(OOBase::uint32_t e) { return (e >> 5) & 0x7; }
+	inline unsigned int entry_extra(OOBase::uint32_t e) { return (e >> 8) & 0xF; }
+	inline unsigned int entry_value(OOBase::uint32_t e) { return e >> 16; }
+
+	const unsigned short length_base[29] = { 3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258 };
+	const unsigned char length_extra[29] = { 0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0 };
+	const unsigned short dist_base[30] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577 };
+	const unsigned char dist_extra[30] = { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13 };
+	const unsigned char precode_order[19] = { 16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15 };
+
+	const unsigned int litlen_bits = 10;
+	const unsigned int dist_bits = 8;
+	const unsigned int precode_bits = 7;
+
+	// Roots plus the most subtable space a complete code can need, as counted by zlib's examples/enough.c
+	const size_t litlen_size = 1334;
+	const size_t dist_size = 402;
+
+	enum TableKind
+	{
+		eLitLen,
+		eDist,
+		ePrecode
+	};
+
+	OOBase::uint32_t symbol_entry(TableKind kind, unsigned int sym, unsigned int bits)
+	{
+		switch (kind)
+		{
+		case eLitLen:
+			if (sym < 256)
+				return make_entry(bits,eLiteral,0,sym);
+			if (sym == 256)
+				return make_entry(bits,eEndOfBlock,0,0);
+			if (sym < 286)
+				return make_entry(bits,eLength,length_extra[sym - 257],length_base[sym - 257]);
+			break;
+
+		case eDist:
+			if (sym < 30)
+				return make_entry(bits,eDistance,dist_extra[sym],dist_base[sym]);
+			break;
+
+		default:
+			return make_entry(bits,eLiteral,0,sym);
+		}
+		return make_entry(bits,eInvalid,0,0);
+	}
+
+	// Builds a canonical Huffman decode table, with second level tables for codes longer than table_bits
+	bool build_table(const unsigned char* lens, unsigned int count, TableKind kind, unsigned int table_bits, OOBase::uint32_t* table, size_t table_size)
+	{
+		unsigned int len_count[16] = {0};
+		for (unsigned int i = 0;i < count;++i)
+			++len_count[lens[i]];
+		len_count[0] = 0;
+
+		unsigned int max_len = 15;
+		while (max_len && !len_count[max_len])
+			--max_len;
+
+		const OOBase::uint32_t invalid = make_entry(0,eInvalid,0,0);
+		const size_t root_size = size_t(1) << table_bits;
+		for (size_t i = 0;i < root_size;++i)
+			table[i] = invalid;
+
+		// No codes at all is legal for distances, when a block is only literals
+		if (!max_len)
+			return true;
+
+		// Refuse over-subscribed codes, and incomplete ones bar a single one bit code, as zlib does
+		int left = 1;
+		for (unsigned int len = 1;len < 16;++len)
+		{
+			left <<= 1;
+			left -= len_count[len];
+			if (left < 0)
+				return false;
+		}
+		if (left > 0 && (kind == ePrecode || max_len != 1))
+			return false;
+
+		unsigned short offsets[16];
+		offsets[1] = 0;
+		for (unsigned int len = 1;len < 15;++len)
+			offsets[len + 1] = offsets[len] + len_count[len];
+
+		unsigned short sorted[288];
+		for (unsigned int i = 0;i < count;++i)
+		{
+			if (lens[i])
+				sorted[offsets[lens[i]]++] = static_cast<unsigned short>(i);
+		}
+
+		size_t next_free = root_size;
+		size_t sub_start = 0;
+		unsigned int sub_bits = 0;
+		unsigned int sub_prefix = unsigned(-1);
+
+		unsigned int code = 0;
+		unsigned int n = 0;
+		for (unsigned int len = 1;len < 16;++len)
+		{
+			for (unsigned int c = 0;c < len_count[len];++c,++n,++code)
+			{
+				unsigned int sym = sorted[n];
+
+				unsigned int rev = 0;
+				for (unsigned int b = 0;b < len;++b)
+					rev |= ((code >> b) & 1) << (len - 1 - b);
+
+				if (len <= table_bits)
+				{
+					OOBase::uint32_t e = symbol_entry(kind,sym,len);
+					for (size_t i = rev;i < root_size;i += (size_t(1) << len))
+						table[i] = e;
+				}
+				else
+				{
+					unsigned int prefix = rev & (root_size - 1);
+					if (prefix != sub_prefix)
+					{
+						// Size the subtable to hold every remaining code sharing this prefix
+						sub_bits = len - table_bits;
+						int space = 1 << sub_bits;
+						space -= len_count[len] - c;
+						for (unsigned int l = len + 1;space > 0 && l <= max_len;++l)
+						{
+							space = (space << 1) - len_count[l];
+							++sub_bits;
+						}
+
+						sub_start = next_free;
+						next_free += size_t(1) << sub_bits;
+						if (next_free > table_size)
+							return false;
+
+						for (size_t i = sub_start;i < next_free;++i)
+							table[i] = invalid;
+
+						sub_prefix = prefix;
+						table[prefix] = make_entry(table_bits,eSubtable,sub_bits,static_cast<unsigned int>(sub_start));
+					}
+
+					OOBase::uint32_t e = symbol_entry(kind,sym,len - table_bits);
+					for (size_t i = rev >> table_bits;i < (size_t(1) << sub_bits);i += (size_t(1) << (len - table_bits)))
+						table[sub_start + i] = e;
+				}
+			}
+			code <<= 1;
+		}
+		return true;
+	}
+
+	struct FixedTables
+	{
+		FixedTables()
+		{
+			unsigned char lens[288];
+			unsigned int i = 0;
+			for (;i < 144;++i)
+				lens[i] = 8;
+			for (;i < 256;++i)
+				lens[i] = 9;
+			for (;i < 280;++i)
+				lens[i] = 7;
+			for (;i < 288;++i)
+				lens[i] = 8;
+			build_table(lens,288,eLitLen,litlen_bits,litlen,litlen_size);
+
+			for (i = 0;i < 32;++i)
+				lens[i] = 5;
+			build_table(lens,32,eDist,dist_bits,dist,dist_size);
+		}
+
+		OOBase::uint32_t litlen[litlen_size];
+		OOBase::uint32_t dist[dist_size];
+	};
+
+	const FixedTables s_fixed;
+
+	// A 64 bit little-endian bit buffer, refilled a word at a time while there are 8 bytes to read
+	class BitReader
+	{
+	public:
+		BitReader(const unsigned char* src, size_t len) : m_in(src), m_end(src + len), m_buf(0), m_left(0)
+		{}
+
+		void refill()
+		{
+			if (m_end - m_in >= 8)
+			{
+				OOBase::uint64_t w;
+				memcpy(&w,m_in,8);
+#if (OOBASE_BYTE_ORDER == OOBASE_BIG_ENDIAN)
+				OOBase::byte_swap(w);
+#endif
+				m_buf |= w << m_left;
+				m_in += (63 - m_left) >> 3;
+				m_left |= 56;
+			}
+			else
+			{
+				while (m_left <= 56 && m_in < m_end)
+				{
+					m_buf |= OOBase::uint64_t(*m_in++) << m_left;
+					m_left += 8;
+				}
+			}
+		}
+
+		OOBase::uint64_t peek() const { return m_buf; }
+		unsigned int available() const { return m_left; }
+
+		void consume(unsigned int n)
+		{
+			m_buf >>= n;
+			m_left -= n;
+		}
+
+		bool bits(unsigned int n, unsigned int& v)
+		{
+			if (m_left < n)
+			{
+				refill();
+				if (m_left < n)
+					return false;
+			}
+			v = static_cast<unsigned int>(m_buf & ((OOBase::uint64_t(1) << n) - 1));
+			consume(n);
+			return true;
+		}
+
+		// Drops to the next byte boundary, and hands back any whole bytes held, for stored blocks
+		const unsigned char* align()
+		{
+			consume(m_left & 7);
+			m_in -= m_left >> 3;
+			m_buf = 0;
+			m_left = 0;
+			return m_in;
+		}
+
+		void skip_to(const unsigned char* p) { m_in = p; }
+		const unsigned char* end() const { return m_end; }
+
+	private:
+		const unsigned char* m_in;
+		const unsigned char* m_end;
+		OOBase::uint64_t     m_buf;
+		unsigned int         m_left;
+	};
+
+	// The entry for the next code, with its bits counting the root bits if it came from a subtable
+	inline OOBase::uint32_t lookup(OOBase::uint64_t buf, const OOBase::uint32_t* table, unsigned int table_bits)
+	{
+		OOBase::uint32_t e = table[buf & ((1u << table_bits) - 1)];
+		if (entry_type(e) == eSubtable)
+			e = table[entry_value(e) + ((buf >> table_bits) & ((1u << entry_extra(e)) - 1))] + table_bits;
+		return e;
+	}
+
+	inline bool decode(BitReader& br, const OOBase::uint32_t* table, unsigned int table_bits, OOBase::uint32_t& e)
+	{
+		e = lookup(br.peek(),table,table_bits);
+		if (entry_type(e) == eInvalid || entry_bits(e) > br.available())
+			return false;
+
+		br.consume(entry_bits(e));
+		return true;
+	}
+
+	inline unsigned int extra_bits(BitReader& br, unsigned int n)
+	{
+		unsigned int v = static_cast<unsigned int>(br.peek() & ((OOBase::uint64_t(1) << n) - 1));
+		br.consume(n);
+		return v;
+	}
+
+	bool read_dynamic_tables(BitReader& br, OOBase::uint32_t* litlen, OOBase::uint32_t* dist)
+	{
+		unsigned int hlit,hdist,hclen;
+		if (!br.bits(5,hlit) || !br.bits(5,hdist) || !br.bits(4,hclen))
+			return false;
+
+		hlit += 257;
+		hdist += 1;
+		hclen += 4;
+		if (hlit > 286 || hdist > 30)
+			return false;
+
+		unsigned char lens[286 + 30] = {0};
+		for (unsigned int i = 0;i < hclen;++i)
+		{
+			unsigned int v;
+			if (!br.bits(3,v))
+				return false;
+			lens[precode_order[i]] = static_cast<unsigned char>(v);
+		}
+
+		OOBase::uint32_t precode[1 << precode_bits];
+		if (!build_table(lens,19,ePrecode,precode_bits,precode,1 << precode_bits))
+			return false;
+
+		memset(lens,0,sizeof(lens));
+		for (unsigned int i = 0;i < hlit + hdist;)
+		{
+			br.refill();
+
+			OOBase::uint32_t e;
+			if (!decode(br,precode,precode_bits,e))
+				return false;
+
+			unsigned int sym = entry_value(e);
+			if (sym < 16)
+			{
+				lens[i++] = static_cast<unsigned char>(sym);
+				continue;
+			}
+
+			unsigned int repeat, value = 0;
+			if (sym == 16)
+			{
+				if (!i || !br.bits(2,repeat))
+					return false;
+				value = lens[i - 1];
+				repeat += 3;
+			}
+			else if (sym == 17)
+			{
+				if (!br.bits(3,repeat))
+					return false;
+				repeat += 3;
+			}
+			else
+			{
+				if (!br.bits(7,repeat))
+					return false;
+				repeat += 11;
+			}
+
+			if (i + repeat > hlit + hdist)
+				return false;
+
+			while (repeat--)
+				lens[i++] = static_cast<unsigned char>(value);
+		}
+
+		// There must be an end of block code
+		if (!lens[256])
+			return false;
+
+		return build_table(lens,hlit,eLitLen,litlen_bits,litlen,litlen_size) &&
+				build_table(lens + hlit,hdist,eDist,dist_bits,dist,dist_size);
+	}
+}
+
+size_t Indigo::detail::inflate(const unsigned char* src, size_t src_len, unsigned char* dest, size_t dest_len)
+{
+	// Raw DEFLATE, as stored in zip files.  Returns the bytes written, or size_t(-1) on error
+	BitReader br(src,src_len);
+	unsigned char* out = dest;
+	unsigned char* const out_end = dest + dest_len;
+
+	// Small enough for the stack, which keeps this free of allocation and callable from anywhere
+	OOBase::uint32_t litlen_table[litlen_size];
+	OOBase::uint32_t dist_table[dist_size];
+
+	for (unsigned int final = 0;!final;)
+	{
+		unsigned int type;
+		if (!br.bits(1,final) || !br.bits(2,type))
+			return size_t(-1);
+
+		if (type == 0)
+		{
+			const unsigned char* in = br.align();
+			if (br.end() - in < 4)
+				return size_t(-1);
+
+			unsigned int len = in[0] | (in[1] << 8);
+			unsigned int nlen = in[2] | (in[3] << 8);
+			in += 4;
+			if (len != (~nlen & 0xFFFF) || size_t(br.end() - in) < len || size_t(out_end - out) < len)
+				return size_t(-1);
+
+			memcpy(out,in,len);
+			out += len;
+			br.skip_to(in + len);
+			continue;
+		}
+
+		const OOBase::uint32_t* litlen = s_fixed.litlen;
+		const OOBase::uint32_t* dist = s_fixed.dist;
+		if (type == 2)
+		{
+			if (!read_dynamic_tables(br,litlen_table,dist_table))
+				return size_t(-1);
+
+			litlen = litlen_table;
+			dist = dist_table;
+		}
+		else if (type != 1)
+			return size_t(-1);
+
+		for (;;)
+		{
+			// Enough for a length and a distance with their extra bits, 48 at most
+			br.refill();
+
+			OOBase::uint32_t e;
+			size_t len,distance;
+			if (br.available() >= 48 && size_t(out_end - out) >= 258 + 8)
+			{
+				// The fast path: no bounds checks until the match, and a second literal without a refill
+				e = lookup(br.peek(),litlen,litlen_bits);
+				if (entry_type(e) == eLiteral)
+				{
+					br.consume(entry_bits(e));
+					*out++ = static_cast<unsigned char>(entry_value(e));
+
+					e = lookup(br.peek(),litlen,litlen_bits);
+					if (entry_type(e) == eLiteral)
+					{
+						br.consume(entry_bits(e));
+						*out++ = static_cast<unsigned char>(entry_value(e));
+					}
+					continue;
+				}
+
+				if (entry_type(e) != eLength)
+				{
+					if (entry_type(e) == eEndOfBlock)
+					{
+						br.consume(entry_bits(e));
+						break;
+					}
+					return size_t(-1);
+				}
+
+				br.consume(entry_bits(e));
+				len = entry_value(e) + extra_bits(br,entry_extra(e));
+
+				e = lookup(br.peek(),dist,dist_bits);
+				if (entry_type(e) != eDistance)
+					return size_t(-1);
+
+				br.consume(entry_bits(e));
+				distance = entry_value(e) + extra_bits(br,entry_extra(e));
+			}
+			else
+			{
+				if (!decode(br,litlen,litlen_bits,e))
+					return size_t(-1);
+
+				unsigned int kind = entry_type(e);
+				if (kind == eLiteral)
+				{
+					if (out == out_end)
+						return size_t(-1);
+
+					*out++ = static_cast<unsigned char>(entry_value(e));
+					continue;
+				}
+
+				if (kind == eEndOfBlock)
+					break;
+
+				unsigned int extra;
+				if (!br.bits(entry_extra(e),extra))
+					return size_t(-1);
+				len = entry_value(e) + extra;
+
+				if (!decode(br,dist,dist_bits,e) || !br.bits(entry_extra(e),extra))
+					return size_t(-1);
+				distance = entry_value(e) + extra;
+			}
+
+			if (distance > size_t(out - dest) || len > size_t(out_end - out))
+				return size_t(-1);
+
+			const unsigned char* from = out - distance;
+			if (distance >= 8 && size_t(out_end - out) >= len + 8)
+			{
+				// Whole words, which may overrun the match but never the buffer, and only read what is written
+				unsigned char* stop = out + len;
+				do
+				{
+					memcpy(out,from,8);
+					out += 8;
+					from += 8;
+				}
+				while (out < stop);
+				out = stop;
+			}
+			else if (distance == 1)
+			{
+				memset(out,*from,len);
+				out += len;
+			}
+			else
+			{
+				while (len--)
+					*out++ = *from++;
+			}
+		}
+	}
+
+	return out - dest;
+}
@@ -501,7 +501,13 @@ OOBase::SharedPtr<Indigo::ResourceBundle> Indigo::Parser::cd_resource(const char
 
 OOBase::SharedPtr<Indigo::Image> Indigo::Parser::load_image(const OOBase::ScopedString& image_name)
 {
-	size_t hash = OOBase::Hash<const char*>::hash(image_name);
+	return load_image(image_name,Image::eLF_mipmaps | Image::eLF_downscale);
+}
+
+OOBase::SharedPtr<Indigo::Image> Indigo::Parser::load_image(const OOBase::ScopedString& image_name, unsigned int flags)
+{
+	// The same image loaded with other flags is decoded differently
+	size_t hash = OOBase::Hash<const char*>::hash(image_name) ^ flags;
 	image_hash_t::iterator i = m_hashImages.find(hash);
 	if (i)
 		return i->second;
@@ -513,7 +519,10 @@ OOBase::SharedPtr<Indigo::Image> Indigo::Parser::load_image(const OOBase::Scoped
 	if (!image)
 		LOG_ERROR_RETURN(("Failed to allocate: %s",OOBase::system_error_text()),image);
 
-	if (!image->load(*m_resource,image_name.c_str(),4))
+	// Parsed images live until unload(), so don't keep their pixels as well as their textures
+	image->discard_pixels();
+
+	if (!image->load_async(*m_resource,image_name.c_str(),4,flags))
 		return OOBase::SharedPtr<Image>();
 
 	if (!m_hashImages.insert(hash,image))
@@ -584,6 +593,9 @@ bool Indigo::Parser::load(const OOBase::SharedPtr<ResourceBundle>& resource, con
 		}
 	}
 
+	if (ok)
+		ok = on_loaded();
+
 	m_resource.reset();
 	return ok;
 }
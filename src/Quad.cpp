@@ -32,7 +32,7 @@ namespace
 	class QuadFactory
 	{
 	public:
-		void draw(OOGL::State& state, const OOBase::SharedPtr<OOGL::Texture>& texture, const glm::mat4& mvp, const glm::vec4& colour);
+		void draw(OOGL::State& state, const OOBase::SharedPtr<OOGL::Texture>& texture, const glm::mat4& mvp, const glm::vec4& colour, const glm::vec4& tex_rect);
 
 	private:
 		struct vertex_data
@@ -56,7 +56,7 @@ namespace
 	class SGQuad : public Indigo::Render::SGDrawable
 	{
 	public:
-		SGQuad(const Indigo::AABB& aabb, const OOBase::SharedPtr<OOGL::Texture>& texture, bool transparent, const glm::vec4& colour);
+		SGQuad(const Indigo::AABB& aabb, const OOBase::SharedPtr<OOGL::Texture>& texture, bool transparent, const glm::vec4& colour, const glm::vec4& tex_rect);
 
 		bool transparent() const { return m_transparent; }
 		void on_draw(OOGL::State& glState, const glm::mat4& mvp) const;
@@ -66,6 +66,7 @@ namespace
 		OOBase::SharedPtr<OOGL::Texture> m_texture;
 		bool m_transparent;
 		glm::vec4 m_colour;
+		glm::vec4 m_tex_rect;
 	};
 }
 
@@ -91,10 +92,10 @@ bool QuadFactory::alloc()
 		LOG_ERROR_RETURN(("Failed to allocate VBO: %s",OOBase::system_error_text(ERROR_OUTOFMEMORY)),false);
 
 	OOBase::SharedPtr<OOGL::Shader> shaders[2];
-	shaders[0] = Indigo::ShaderPool::add_shader("2d_textured_colour.vert",GL_VERTEX_SHADER,Indigo::static_resources());
+	shaders[0] = Indigo::ShaderPool::add_shader("2d_textured_rect.vert",GL_VERTEX_SHADER,Indigo::static_resources());
 	shaders[1] = Indigo::ShaderPool::add_shader("colour_blend.frag",GL_FRAGMENT_SHADER,Indigo::static_resources());
 	if (shaders[0] && shaders[1])
-		m_ptrProgram = Indigo::ShaderPool::add_program("2d_image",shaders,2);
+		m_ptrProgram = Indigo::ShaderPool::add_program("2d_image_rect",shaders,2);
 
 	if (!m_ptrProgram)
 		return false;
@@ -119,7 +120,7 @@ bool QuadFactory::alloc()
 	return true;
 }
 
-void QuadFactory::draw(OOGL::State& glState, const OOBase::SharedPtr<OOGL::Texture>& texture, const glm::mat4& mvp, const glm::vec4& colour)
+void QuadFactory::draw(OOGL::State& glState, const OOBase::SharedPtr<OOGL::Texture>& texture, const glm::mat4& mvp, const glm::vec4& colour, const glm::vec4& tex_rect)
 {
 	if (!m_ptrProgram)
 		alloc();
@@ -130,6 +131,7 @@ void QuadFactory::draw(OOGL::State& glState, const OOBase::SharedPtr<OOGL::Textu
 		glState.bind(0,texture);
 
 		m_ptrProgram->uniform("in_Colour",colour);
+		m_ptrProgram->uniform("in_TexRect",tex_rect);
 		m_ptrProgram->uniform("MVP",mvp);
 
 		m_ptrVAO->draw_elements(GL_TRIANGLES,0,3,elements_per_quad,GL_UNSIGNED_BYTE,0);
@@ -141,25 +143,26 @@ Indigo::Render::Quad::Quad() :
 {
 }
 
-void Indigo::Render::Quad::draw(OOGL::State& state, const OOBase::SharedPtr<OOGL::Texture>& texture, const glm::mat4& mvp, const glm::vec4& colour) const
+void Indigo::Render::Quad::draw(OOGL::State& state, const OOBase::SharedPtr<OOGL::Texture>& texture, const glm::mat4& mvp, const glm::vec4& colour, const glm::vec4& tex_rect) const
 {
 	if (texture && colour.a > 0.f)
-		static_cast<QuadFactory*>(m_factory)->draw(state,texture,mvp,colour);
+		static_cast<QuadFactory*>(m_factory)->draw(state,texture,mvp,colour,tex_rect);
 }
 
-SGQuad::SGQuad(const Indigo::AABB& aabb, const OOBase::SharedPtr<OOGL::Texture>& texture, bool transparent, const glm::vec4& colour) :
+SGQuad::SGQuad(const Indigo::AABB& aabb, const OOBase::SharedPtr<OOGL::Texture>& texture, bool transparent, const glm::vec4& colour, const glm::vec4& tex_rect) :
 		Indigo::Render::SGDrawable(aabb),
 		m_factory(OOGL::ContextSingleton<QuadFactory>::instance_ptr()),
 		m_texture(texture),
 		m_transparent(transparent),
-		m_colour(colour)
+		m_colour(colour),
+		m_tex_rect(tex_rect)
 {
 }
 
 void SGQuad::on_draw(OOGL::State& glState, const glm::mat4& mvp) const
 {
 	if (m_colour.a > 0.f)
-		m_factory->draw(glState,m_texture,mvp,m_colour);
+		m_factory->draw(glState,m_texture,mvp,m_colour,m_tex_rect);
 }
 
 OOBase::SharedPtr<Indigo::Render::SGNode> Indigo::SGQuad::on_render_create(Render::SGGroup* parent)
@@ -179,7 +182,7 @@ OOBase::SharedPtr<Indigo::Render::SGNode> Indigo::SGQuad::on_render_create(Rende
 		texture->parameter(GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
 	}
 
-	OOBase::SharedPtr< ::SGQuad> quad = OOBase::allocate_shared< ::SGQuad>(AABB(glm::vec3(0.5f,0.5f,0),glm::vec3(0.5f,0.5f,0)),texture,m_transparent,m_colour);
+	OOBase::SharedPtr< ::SGQuad> quad = OOBase::allocate_shared< ::SGQuad>(AABB(glm::vec3(0.5f,0.5f,0),glm::vec3(0.5f,0.5f,0)),texture,m_transparent,m_colour,m_image->tex_rect());
 	if (!quad)
 		LOG_ERROR_RETURN(("Failed to allocate: %s\n",OOBase::system_error_text()),node);
 
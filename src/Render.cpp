@@ -25,9 +25,12 @@
 
 #include "Common.h"
 
+#include <OOGL/StateFns.h>
+
 namespace Indigo
 {
 	void render_init(Pipe* pipe);
+	void next_render_frame();
 
 	bool run(const char* name, void (*fn)(void*), void* param);
 }
@@ -41,6 +44,13 @@ namespace
 	};
 
 	typedef OOBase::TLSSingleton<PipeRack> PIPE_RACK;
+
+	OOBase::uint64_t s_render_frame = 0;
+
+	// A fence after each frame still in flight, by frame number, and the count of frames the GPU has finished
+	const OOBase::uint64_t max_frames_in_flight = 8;
+	GLsync s_frame_fences[max_frames_in_flight] = {0};
+	OOBase::uint64_t s_frames_complete = 0;
 }
 
 const OOBase::SharedPtr<Indigo::Pipe>& Indigo::render_pipe()
@@ -61,6 +71,58 @@ const OOBase::SharedPtr<Indigo::Pipe>& Indigo::logic_pipe()
 	return pipe;
 }
 
+OOBase::uint64_t Indigo::render_frame()
+{
+	ASSERT_RENDER_THREAD();
+
+	return s_render_frame;
+}
+
+bool Indigo::render_frame_complete(OOBase::uint64_t frame)
+{
+	ASSERT_RENDER_THREAD();
+
+	return frame < s_frames_complete;
+}
+
+void Indigo::next_render_frame()
+{
+	ASSERT_RENDER_THREAD();
+
+	// If the GPU has fallen a whole ring of frames behind, wait for the oldest
+	GLsync& fence = s_frame_fences[s_render_frame % max_frames_in_flight];
+	if (fence)
+	{
+		OOGL::StateFns::get_current()->glClientWaitSync(fence,GL_SYNC_FLUSH_COMMANDS_BIT,GLuint64(-1));
+		OOGL::StateFns::get_current()->glDeleteSync(fence);
+		s_frames_complete = s_render_frame - max_frames_in_flight + 1;
+	}
+
+	fence = OOGL::StateFns::get_current()->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE,0);
+	if (!fence)
+	{
+		glFinish();
+		s_frames_complete = s_render_frame + 1;
+	}
+
+	++s_render_frame;
+
+	// Collect the fences that have signalled, oldest first
+	for (;s_frames_complete < s_render_frame;++s_frames_complete)
+	{
+		GLsync& f = s_frame_fences[s_frames_complete % max_frames_in_flight];
+		if (f)
+		{
+			GLenum r = OOGL::StateFns::get_current()->glClientWaitSync(f,0,0);
+			if (r != GL_ALREADY_SIGNALED && r != GL_CONDITION_SATISFIED)
+				break;
+
+			OOGL::StateFns::get_current()->glDeleteSync(f);
+			f = 0;
+		}
+	}
+}
+
 #if !defined(NDEBUG)
 void Indigo::assert_render_thread()
 {
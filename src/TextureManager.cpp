@@ -0,0 +1,277 @@
+///////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2015 Rick Taylor
+//
+// This file is part of the Indigo boardgame engine.
+//
+// Indigo is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Indigo is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Indigo.  If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////////
+
+#include "../include/indigo/TextureManager.h"
+#include "../include/indigo/Image.h"
+#include "../include/indigo/Render.h"
+
+#include "Common.h"
+
+#include <OOBase/HashTable.h>
+
+namespace Indigo
+{
+	void trim_textures();
+}
+
+Indigo::Render::ManagedTexture::ManagedTexture(const Image* image, GLenum internalFormat, GLsizei levels, GLenum min_filter) :
+		m_image(image),
+		m_internal_format(internalFormat),
+		m_levels(levels),
+		m_min_filter(min_filter),
+		m_last_drawn(render_frame())
+{
+}
+
+const OOBase::SharedPtr<OOGL::Texture>& Indigo::Render::ManagedTexture::get(bool block)
+{
+	m_last_drawn = render_frame();
+
+	if (!m_texture && m_image)
+	{
+		bool cached = true;
+		m_texture = m_image->make_texture(m_internal_format,cached,m_levels,block);
+		if (m_texture && !cached)
+		{
+			m_texture->parameter(GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+			m_texture->parameter(GL_TEXTURE_MIN_FILTER,m_min_filter);
+			m_texture->parameter(GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
+			m_texture->parameter(GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
+		}
+	}
+	return m_texture;
+}
+
+Indigo::Render::TextureManager::TextureManager() :
+		m_budget(0),
+		m_prune_at(64)
+{
+}
+
+Indigo::Render::TextureManager& Indigo::Render::TextureManager::instance()
+{
+	return OOGL::ContextSingleton<TextureManager>::instance();
+}
+
+OOBase::SharedPtr<Indigo::Render::ManagedTexture> Indigo::Render::TextureManager::acquire(const Image* image, GLenum internalFormat, GLsizei levels, GLenum min_filter)
+{
+	ASSERT_RENDER_THREAD();
+
+	OOBase::SharedPtr<ManagedTexture> managed;
+	for (OOBase::Vector<OOBase::WeakPtr<ManagedTexture>,OOBase::ThreadLocalAllocator>::iterator i=m_managed.begin();i;)
+	{
+		managed = i->lock();
+		if (!managed)
+			i = m_managed.erase(i);
+		else if (managed->m_image == image && managed->m_internal_format == internalFormat && managed->m_levels == levels && managed->m_min_filter == min_filter)
+			break;
+		else
+		{
+			managed.reset();
+			++i;
+		}
+	}
+
+	if (!managed)
+	{
+		managed = OOBase::allocate_shared<ManagedTexture,OOBase::ThreadLocalAllocator>(image,internalFormat,levels,min_filter);
+		if (!managed)
+			LOG_ERROR_RETURN(("Failed to allocate: %s",OOBase::system_error_text()),managed);
+
+		if (!m_managed.push_back(managed))
+		{
+			managed.reset();
+			LOG_ERROR_RETURN(("Failed to allocate: %s",OOBase::system_error_text()),managed);
+		}
+
+		// Read on the logic thread, by Image::stop_managed
+		OOBase::Guard<OOBase::Condition::Mutex> guard(image->m_pixel_lock);
+		image->m_managed = true;
+	}
+
+	if (!managed->get(true))
+		managed.reset();
+
+	return managed;
+}
+
+void Indigo::Render::TextureManager::forget(const Image* image)
+{
+	// The textures already made stay alive while drawn, but can't be made again
+	for (OOBase::Vector<OOBase::WeakPtr<ManagedTexture>,OOBase::ThreadLocalAllocator>::iterator i=m_managed.begin();i;)
+	{
+		OOBase::SharedPtr<ManagedTexture> managed = i->lock();
+		if (!managed)
+			i = m_managed.erase(i);
+		else
+		{
+			if (managed->m_image == image)
+				managed->m_image = NULL;
+			++i;
+		}
+	}
+}
+
+bool Indigo::Render::TextureManager::track(const Image* image, const OOBase::SharedPtr<OOGL::Texture>& texture, GLenum internalFormat, unsigned int width, unsigned int height, size_t bytes)
+{
+	Entry entry;
+	entry.m_texture = texture;
+	entry.m_image = image;
+	entry.m_format = internalFormat;
+	entry.m_width = width;
+	entry.m_height = height;
+	entry.m_bytes = bytes;
+
+	// Without a budget nothing else sweeps out the dead, so do it whenever the list has doubled
+	if (m_entries.size() >= m_prune_at)
+	{
+		resident();
+		m_prune_at = 2 * m_entries.size() + 64;
+	}
+
+	if (!m_entries.push_back(entry))
+		LOG_ERROR_RETURN(("Failed to track texture: %s",OOBase::system_error_text()),false);
+
+	return true;
+}
+
+size_t Indigo::Render::TextureManager::resident()
+{
+	size_t total = 0;
+	for (OOBase::Vector<Entry,OOBase::ThreadLocalAllocator>::iterator i=m_entries.begin();i;)
+	{
+		if (!i->m_texture.lock())
+			i = m_entries.erase(i);
+		else
+		{
+			total += i->m_bytes;
+			++i;
+		}
+	}
+	return total;
+}
+
+void Indigo::Render::TextureManager::trim()
+{
+	ASSERT_RENDER_THREAD();
+
+	if (!m_budget)
+		return;
+
+	// Total up in one pass, keeping the size of each texture for the evictions below
+	OOBase::HashTable<size_t,size_t,OOBase::ThreadLocalAllocator> sizes;
+	size_t total = 0;
+	for (OOBase::Vector<Entry,OOBase::ThreadLocalAllocator>::iterator i=m_entries.begin();i;)
+	{
+		OOBase::SharedPtr<OOGL::Texture> texture = i->m_texture.lock();
+		if (!texture)
+			i = m_entries.erase(i);
+		else
+		{
+			total += i->m_bytes;
+			if (!sizes.insert(reinterpret_cast<size_t>(texture.get()),i->m_bytes))
+				LOG_WARNING(("Failed to allocate: %s",OOBase::system_error_text()));
+			++i;
+		}
+	}
+	if (total <= m_budget)
+		return;
+
+	// Anything drawn this frame is on screen, and would only be made again next frame
+	OOBase::uint64_t frame = render_frame();
+
+	OOBase::Vector<ManagedTexture*,OOBase::ThreadLocalAllocator> candidates;
+	for (OOBase::Vector<OOBase::WeakPtr<ManagedTexture>,OOBase::ThreadLocalAllocator>::iterator i=m_managed.begin();i;)
+	{
+		OOBase::SharedPtr<ManagedTexture> managed = i->lock();
+		if (!managed)
+		{
+			i = m_managed.erase(i);
+			continue;
+		}
+
+		if (managed->m_texture && managed->m_image && managed->m_last_drawn < frame)
+		{
+			if (!candidates.push_back(managed.get()))
+			{
+				LOG_ERROR(("Failed to allocate: %s",OOBase::system_error_text()));
+				return;
+			}
+
+			// Least recently drawn first
+			ManagedTexture** c = candidates.data();
+			for (size_t j = candidates.size() - 1;j > 0 && c[j-1]->m_last_drawn > c[j]->m_last_drawn;--j)
+				OOBase::swap(c[j-1],c[j]);
+		}
+		++i;
+	}
+
+	// The drawables holding the candidates keep them alive until we return
+	for (size_t n = 0;n < candidates.size() && total > m_budget;++n)
+	{
+		ManagedTexture* managed = candidates.data()[n];
+		OOBase::HashTable<size_t,size_t,OOBase::ThreadLocalAllocator>::iterator i = sizes.find(reinterpret_cast<size_t>(managed->m_texture.get()));
+		if (i)
+			total -= (i->second < total ? i->second : total);
+
+		managed->m_texture.reset();
+	}
+
+	// A texture still held elsewhere is still resident, so count once more for the real total
+	total = resident();
+
+	if (total > m_budget)
+		LOG_WARNING(("Textures in use exceed the budget of %lu bytes by %lu bytes",static_cast<unsigned long>(m_budget),static_cast<unsigned long>(total - m_budget)));
+}
+
+void Indigo::Render::TextureManager::report()
+{
+	ASSERT_RENDER_THREAD();
+
+	size_t total = resident();
+	OOBase::Logger::log(OOBase::Logger::Information,"Textures: %lu bytes in %lu textures, budget %lu bytes",static_cast<unsigned long>(total),static_cast<unsigned long>(m_entries.size()),static_cast<unsigned long>(m_budget));
+
+	OOBase::uint64_t frame = render_frame();
+	for (OOBase::Vector<Entry,OOBase::ThreadLocalAllocator>::iterator i=m_entries.begin();i;++i)
+	{
+		OOBase::SharedPtr<OOGL::Texture> texture = i->m_texture.lock();
+
+		const ManagedTexture* managed = NULL;
+		for (OOBase::Vector<OOBase::WeakPtr<ManagedTexture>,OOBase::ThreadLocalAllocator>::iterator j=m_managed.begin();j && !managed;++j)
+		{
+			OOBase::SharedPtr<ManagedTexture> m = j->lock();
+			if (m && m->m_texture.get() == texture.get())
+				managed = m.get();
+		}
+
+		if (managed)
+			OOBase::Logger::log(OOBase::Logger::Information,"  Image %p: %ux%u format 0x%X, %lu bytes, drawn %lu frames ago",i->m_image,i->m_width,i->m_height,i->m_format,static_cast<unsigned long>(i->m_bytes),static_cast<unsigned long>(frame - managed->m_last_drawn));
+		else
+			OOBase::Logger::log(OOBase::Logger::Information,"  Image %p: %ux%u format 0x%X, %lu bytes, not evictable",i->m_image,i->m_width,i->m_height,i->m_format,static_cast<unsigned long>(i->m_bytes));
+	}
+}
+
+void Indigo::trim_textures()
+{
+	ASSERT_RENDER_THREAD();
+
+	Render::TextureManager::instance().trim();
+}
@@ -0,0 +1,372 @@
+///////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2015 Rick Taylor
+//
+// This file is part of the Indigo boardgame engine.
+//
+// Indigo is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Indigo is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Indigo.  If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////////
+
+#include "../include/indigo/Render.h"
+#include "../include/indigo/Image.h"
+#include "../include/indigo/TiledImageLayer.h"
+#include "../include/indigo/Quad.h"
+
+#include "Common.h"
+
+namespace
+{
+	class TiledImageLayer : public Indigo::Render::Layer
+	{
+	public:
+		TiledImageLayer(const Indigo::Image* image, Indigo::Render::Window* window, const glm::vec4& colour, const glm::vec4& view, unsigned int tile_size, unsigned int max_tiles);
+
+		bool on_update();
+		void on_draw(OOGL::State& glState) const;
+		void on_size(const glm::uvec2& sz);
+
+		void colour(const glm::vec4& colour) { m_colour = colour; }
+		void view(const glm::vec4& view);
+		void detach() { m_image = NULL; }
+
+	private:
+		static const unsigned int uploads_per_frame = 2;
+
+		struct Tile
+		{
+			unsigned int     m_level;
+			glm::uvec2       m_pos;
+			glm::vec4        m_rect;      // The area of the whole image, (u0,v0,u1,v1)
+			glm::vec4        m_tex_rect;  // The texture inside the border
+			OOBase::uint64_t m_last_drawn;
+
+			OOBase::SharedPtr<OOGL::Texture> m_texture;
+		};
+
+		const Indigo::Image* m_image;
+		Indigo::Render::Quad m_quad;
+		glm::vec4            m_colour;
+		glm::vec4            m_view;
+		glm::uvec2           m_window_size;
+		unsigned int         m_tile_size;
+		unsigned int         m_max_tiles;
+		unsigned int         m_level;
+		unsigned int         m_base_level;
+		bool                 m_complete;
+
+		Tile m_base;
+		OOBase::Vector<Tile,OOBase::ThreadLocalAllocator> m_tiles;
+
+		glm::mat4 m_mvp;
+
+		void choose_level();
+		bool make_tile(Tile& tile, unsigned int level, const glm::uvec2& pos);
+		void draw_tile(OOGL::State& glState, const Tile& tile) const;
+	};
+}
+
+::TiledImageLayer::TiledImageLayer(const Indigo::Image* image, Indigo::Render::Window* window, const glm::vec4& colour, const glm::vec4& view, unsigned int tile_size, unsigned int max_tiles) :
+		Indigo::Render::Layer(window),
+		m_image(image),
+		m_colour(colour),
+		m_view(view),
+		m_window_size(window->window()->size()),
+		m_tile_size(tile_size),
+		m_max_tiles(max_tiles),
+		m_level(0),
+		m_base_level(0),
+		m_complete(false),
+		m_mvp(2.f,0.f,0.f,0.f,0.f,2.f,0.f,0.f,0.f,0.f,-1.f,0.f,-1.f,-1.f,0.f,1.f)
+{
+}
+
+void ::TiledImageLayer::on_size(const glm::uvec2& sz)
+{
+	m_window_size = sz;
+	if (m_base.m_texture)
+		choose_level();
+}
+
+void ::TiledImageLayer::view(const glm::vec4& view)
+{
+	m_view = view;
+	if (m_base.m_texture)
+		choose_level();
+}
+
+void ::TiledImageLayer::choose_level()
+{
+	if (!m_image || !m_window_size.x || !m_window_size.y)
+		return;
+
+	// The coarsest level that still has a texel for every pixel
+	glm::vec2 texels = glm::vec2(m_view.z - m_view.x,m_view.w - m_view.y) * glm::vec2(m_image->level_size(0));
+	float ratio = glm::min(texels.x / m_window_size.x,texels.y / m_window_size.y);
+	for (m_level = 0;m_level < m_base_level && ratio >= 2.f;++m_level)
+		ratio /= 2.f;
+
+	m_complete = false;
+}
+
+bool ::TiledImageLayer::make_tile(Tile& tile, unsigned int level, const glm::uvec2& pos)
+{
+	glm::uvec2 sz = m_image->level_size(level);
+	glm::uvec2 origin = pos * m_tile_size;
+	glm::uvec2 end = glm::min(origin + glm::uvec2(m_tile_size),sz);
+
+	// A one pixel border from the neighbours, so linear filtering matches across the seams
+	glm::uvec2 from(origin.x ? origin.x - 1 : 0,origin.y ? origin.y - 1 : 0);
+	glm::uvec2 to = glm::min(end + glm::uvec2(1),sz);
+
+	tile.m_texture = m_image->make_tile(GL_RGBA8,level,glm::uvec4(from,to - from));
+	if (!tile.m_texture)
+		return false;
+
+	tile.m_texture->parameter(GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+	tile.m_texture->parameter(GL_TEXTURE_MIN_FILTER,GL_LINEAR);
+	tile.m_texture->parameter(GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
+	tile.m_texture->parameter(GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
+
+	glm::vec2 tex_size(to - from);
+	tile.m_level = level;
+	tile.m_pos = pos;
+	tile.m_rect = glm::vec4(glm::vec2(origin) / glm::vec2(sz),glm::vec2(end) / glm::vec2(sz));
+	tile.m_tex_rect = glm::vec4(glm::vec2(origin - from) / tex_size,glm::vec2(end - from) / tex_size);
+	tile.m_last_drawn = Indigo::render_frame();
+	return true;
+}
+
+bool ::TiledImageLayer::on_update()
+{
+	if (!m_image || !m_image->ready())
+		return false;
+
+	if (!m_base.m_texture)
+	{
+		// The level that fits in one tile is drawn first, and under the rest until they arrive
+		m_base_level = 0;
+		for (glm::uvec2 sz = m_image->level_size(0);sz.x > m_tile_size || sz.y > m_tile_size;sz = m_image->level_size(++m_base_level))
+			;
+
+		// Discarded pixels are decoded again on a worker, with nothing drawn meanwhile
+		if (!m_image->has_level(m_base_level))
+		{
+			if (!m_image->restore_levels())
+				m_image = NULL;
+			return false;
+		}
+
+		if (!make_tile(m_base,m_base_level,glm::uvec2(0)))
+			m_image = NULL;
+		else
+			choose_level();
+
+		return false;
+	}
+
+	if (m_level >= m_base_level)
+	{
+		m_complete = true;
+		m_image->drop_levels(m_base_level);
+		return false;
+	}
+
+	// Zoomed in past the levels we kept, so decode them again, drawing the base meanwhile
+	if (!m_image->has_level(m_level))
+	{
+		if (!m_image->restore_levels())
+			m_level = m_base_level;
+		return false;
+	}
+
+	// Only the tiles in view, a few each frame
+	OOBase::uint64_t frame = Indigo::render_frame();
+	glm::uvec2 sz = m_image->level_size(m_level);
+	glm::uvec2 count((sz.x + m_tile_size - 1) / m_tile_size,(sz.y + m_tile_size - 1) / m_tile_size);
+	glm::vec4 view = glm::clamp(m_view,glm::vec4(0.f),glm::vec4(1.f));
+	glm::uvec2 first = glm::min(glm::uvec2(glm::vec2(view.x,view.y) * glm::vec2(sz)) / m_tile_size,count);
+	glm::uvec2 last = glm::min(glm::uvec2(glm::ceil(glm::vec2(view.z,view.w) * glm::vec2(sz) / float(m_tile_size))),count);
+
+	bool complete = true;
+	unsigned int uploads = 0;
+	for (unsigned int y = first.y;y < last.y;++y)
+	{
+		for (unsigned int x = first.x;x < last.x;++x)
+		{
+			Tile* tile = NULL;
+			for (size_t i = 0;i < m_tiles.size() && !tile;++i)
+			{
+				Tile& t = m_tiles.data()[i];
+				if (t.m_level == m_level && t.m_pos == glm::uvec2(x,y))
+					tile = &t;
+			}
+
+			if (!tile)
+			{
+				complete = false;
+				if (uploads == uploads_per_frame)
+					continue;
+
+				++uploads;
+				Tile new_tile;
+				if (!make_tile(new_tile,m_level,glm::uvec2(x,y)))
+					continue;
+
+				if (!m_tiles.push_back(new_tile))
+				{
+					LOG_ERROR(("Failed to allocate: %s",OOBase::system_error_text()));
+					continue;
+				}
+
+				tile = &m_tiles.data()[m_tiles.size() - 1];
+			}
+
+			tile->m_last_drawn = frame;
+		}
+	}
+	m_complete = complete;
+
+	// With every tile in view made, the finer levels are not needed until we zoom in
+	if (complete)
+		m_image->drop_levels(m_level);
+
+	// Drop the tiles out of view longest, down to max_tiles
+	while (m_tiles.size() > m_max_tiles)
+	{
+		OOBase::uint64_t oldest = frame;
+		for (size_t i = 0;i < m_tiles.size();++i)
+		{
+			if (m_tiles.data()[i].m_last_drawn < oldest)
+				oldest = m_tiles.data()[i].m_last_drawn;
+		}
+
+		if (oldest == frame)
+			break;
+
+		for (OOBase::Vector<Tile,OOBase::ThreadLocalAllocator>::iterator i=m_tiles.begin();i;)
+		{
+			if (i->m_last_drawn == oldest)
+				i = m_tiles.erase(i);
+			else
+				++i;
+		}
+	}
+
+	return false;
+}
+
+void ::TiledImageLayer::draw_tile(OOGL::State& glState, const Tile& tile) const
+{
+	glm::vec2 view_size(m_view.z - m_view.x,m_view.w - m_view.y);
+	glm::vec2 p0 = (glm::vec2(tile.m_rect.x,tile.m_rect.y) - glm::vec2(m_view.x,m_view.y)) / view_size;
+	glm::vec2 p1 = (glm::vec2(tile.m_rect.z,tile.m_rect.w) - glm::vec2(m_view.x,m_view.y)) / view_size;
+
+	// Rows run down the window, and the top of the quad is v = 0
+	glm::mat4 mvp = glm::scale(glm::translate(m_mvp,glm::vec3(p0.x,1.f - p1.y,0.f)),glm::vec3(p1.x - p0.x,p1.y - p0.y,1.f));
+
+	m_quad.draw(glState,tile.m_texture,mvp,m_colour,tile.m_tex_rect);
+}
+
+void ::TiledImageLayer::on_draw(OOGL::State& glState) const
+{
+	if (m_base.m_texture)
+	{
+		glState.enable(GL_BLEND);
+		glBlendFunc(GL_SRC_ALPHA,GL_ONE_MINUS_SRC_ALPHA);
+
+		glDepthMask(GL_FALSE);
+		glState.disable(GL_DEPTH_TEST);
+
+		// Once every tile in view is loaded, the base would only show through any transparency
+		if (!m_complete || m_level >= m_base_level)
+			draw_tile(glState,m_base);
+
+		if (m_level < m_base_level)
+		{
+			OOBase::uint64_t frame = Indigo::render_frame();
+			for (size_t i = 0;i < m_tiles.size();++i)
+			{
+				const Tile& tile = m_tiles.data()[i];
+				if (tile.m_level == m_level && tile.m_last_drawn == frame)
+					draw_tile(glState,tile);
+			}
+		}
+	}
+}
+
+Indigo::TiledImageLayer::TiledImageLayer(const OOBase::SharedPtr<Image>& image, const glm::vec4& colour, unsigned int tile_size, unsigned int max_tiles) :
+		m_image(image),
+		m_colour(colour),
+		m_view(0.f,0.f,1.f,1.f),
+		m_tile_size(tile_size ? tile_size : 512),
+		m_max_tiles(max_tiles)
+{
+}
+
+Indigo::TiledImageLayer::~TiledImageLayer()
+{
+	// Our render layer is only dropped after m_image has gone
+	render_pipe()->call(OOBase::make_delegate<OOBase::ThreadLocalAllocator>(this,&TiledImageLayer::detach));
+}
+
+void Indigo::TiledImageLayer::detach()
+{
+	OOBase::SharedPtr< ::TiledImageLayer> layer = OOBase::static_pointer_cast< ::TiledImageLayer>(render_layer());
+	if (layer)
+		layer->detach();
+}
+
+OOBase::SharedPtr<Indigo::Render::Layer> Indigo::TiledImageLayer::create_render_layer(Render::Window* window)
+{
+	OOBase::SharedPtr< ::TiledImageLayer> layer;
+	if (!m_image || !m_image->valid() || m_image->components() != 4)
+		LOG_ERROR_RETURN(("TiledImageLayer needs a 4 component image"),layer);
+
+	layer = OOBase::allocate_shared< ::TiledImageLayer,OOBase::ThreadLocalAllocator>(m_image.get(),window,m_colour,m_view,m_tile_size,m_max_tiles);
+	if (!layer)
+		LOG_ERROR(("Failed to allocate layer: %s",OOBase::system_error_text()));
+
+	return layer;
+}
+
+glm::vec4 Indigo::TiledImageLayer::colour(const glm::vec4& colour)
+{
+	glm::vec4 prev_colour = m_colour;
+	if (colour != prev_colour)
+	{
+		m_colour = colour;
+
+		OOBase::SharedPtr< ::TiledImageLayer> layer = OOBase::static_pointer_cast< ::TiledImageLayer>(render_layer());
+		if (layer)
+			render_pipe()->post(OOBase::make_delegate<OOBase::ThreadLocalAllocator>(layer.get(),&::TiledImageLayer::colour),colour);
+	}
+
+	return prev_colour;
+}
+
+glm::vec4 Indigo::TiledImageLayer::view(const glm::vec4& view)
+{
+	glm::vec4 prev_view = m_view;
+	if (view != prev_view && view.z > view.x && view.w > view.y)
+	{
+		m_view = view;
+
+		OOBase::SharedPtr< ::TiledImageLayer> layer = OOBase::static_pointer_cast< ::TiledImageLayer>(render_layer());
+		if (layer)
+			render_pipe()->post(OOBase::make_delegate<OOBase::ThreadLocalAllocator>(layer.get(),&::TiledImageLayer::view),view);
+	}
+
+	return prev_view;
+}
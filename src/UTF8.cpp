@@ -0,0 +1,239 @@
+///////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2015 Rick Taylor
+//
+// This file is part of the Indigo boardgame engine.
+//
+// Indigo is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Indigo is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Indigo.  If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////////
+
+#include "Common.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define INDIGO_UTF8_SSE2 1
+#endif
+
+namespace
+{
+	const char utf8_data[256] =
+	{
+		// Key:
+		//  0 = Invalid first byte
+		//  1 = Single byte
+		//  2 = 2 byte sequence
+		//  3 = 3 byte sequence
+		//  4 = 4 byte sequence
+
+		// -1 = Continuation byte
+		// -2 = Overlong 2 byte sequence
+		// -3 = 3 byte overlong check (0x80..0x9F) as next byte fail
+		// -4 = 3 byte reserved check (0xA0..0xBF) as next byte fail
+		// -5 = 4 byte overlong check (0x80..0x8F) as next byte fail
+		// -6 = 4 byte reserved check (0x90..0xBF) as next byte fail
+
+		 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 0x00..0x0F
+		 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 0x10..0x1F
+		 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 0x20..0x2F
+		 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 0x30..0x3F
+		 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 0x40..0x4F
+		 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 0x50..0x5F
+		 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 0x60..0x6F
+		 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 0x70..0x7F
+		-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,  // 0x80..0x8F
+		-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,  // 0x90..0x9F
+		-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,  // 0xA0..0xAF
+		-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,  // 0xB0..0xBF
+		-2,-2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,  // 0xC0..0xCF
+		 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,  // 0xD0..0xDF
+		-3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,-4, 3, 3,  // 0xE0..0xEF
+		-5, 4, 4, 4,-6, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0   // 0xF0..0xFF
+	};
+
+	const OOBase::uint32_t utf_subst_val = 0xFFFD;
+
+#if defined(INDIGO_UTF8_SSE2)
+	int bit_count(int v)
+	{
+		int n = 0;
+		for (;v;++n)
+			v &= v - 1;
+		return n;
+	}
+#endif
+}
+
+bool Indigo::detail::drawable_glyph(OOBase::uint32_t glyph)
+{
+	return (glyph > 31 && glyph != 127 && (glyph < 128 || glyph > 159));
+}
+
+OOBase::uint32_t Indigo::detail::utf8_decode(const unsigned char*& sz, const unsigned char* end)
+{
+	// Default to substitution value
+	OOBase::uint32_t wide_val = utf_subst_val;
+	int l = 0;
+
+	unsigned char c = *sz++;
+	switch (utf8_data[c])
+	{
+		case 1:
+			wide_val = c;
+			break;
+
+		case 2:
+			wide_val = (c & 0x1F);
+			l = 1;
+			break;
+
+		case -2:
+			++sz;
+			break;
+
+		case 3:
+			wide_val = (c & 0x0F);
+			l = 2;
+			break;
+
+		case -3:
+			if (sz < end && *sz >= 0x80 && *sz <= 0x9F)
+				sz += 2;
+			else
+			{
+				wide_val = (c & 0x0F);
+				l = 2;
+			}
+			break;
+
+		case 4:
+			wide_val = (c & 0x07);
+			l = 3;
+			break;
+
+		case -4:
+			if (sz < end && *sz >= 0xA0 && *sz <= 0xBF)
+				sz += 2;
+			else
+			{
+				wide_val = (c & 0x0F);
+				l = 2;
+			}
+			break;
+
+		case -5:
+			if (sz < end && *sz >= 0x80 && *sz <= 0x8F)
+				sz += 3;
+			else
+			{
+				wide_val = (c & 0x07);
+				l = 3;
+			}
+			break;
+
+		case -6:
+			if (sz < end && *sz >= 0x90 && *sz <= 0xBF)
+				sz += 3;
+			else
+			{
+				wide_val = (c & 0x07);
+				l = 3;
+			}
+			break;
+
+		default:
+			break;
+	}
+
+	while (l-- > 0)
+	{
+		if (sz >= end)
+		{
+			// Truncated sequence
+			wide_val = utf_subst_val;
+			break;
+		}
+
+		c = *sz++;
+		if (utf8_data[c] != -1)
+		{
+			wide_val = utf_subst_val;
+			sz += l;
+			break;
+		}
+
+		wide_val <<= 6;
+		wide_val |= (c & 0x3F);
+	}
+
+	if (sz > end)
+		sz = end;
+
+	return wide_val;
+}
+
+// Decodes into glyphs, which must have room for s_len entries, and returns the number of code points.
+// Invalid sequences decode to utf_subst_val
+size_t Indigo::detail::utf8_to_glyphs(const char* s, size_t s_len, OOBase::uint32_t* glyphs, GLsizei& drawable)
+{
+	drawable = 0;
+	const unsigned char* sz = reinterpret_cast<const unsigned char*>(s);
+	const unsigned char* end = sz + s_len;
+	OOBase::uint32_t* g = glyphs;
+
+#if defined(INDIGO_UTF8_SSE2)
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i space = _mm_set1_epi8(32);
+	const __m128i del = _mm_set1_epi8(127);
+
+	while (end - sz >= 16)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sz));
+		if (_mm_movemask_epi8(v) == 0)
+		{
+			// 16 ASCII characters: widen to 32 bits and count the control characters
+			__m128i lo = _mm_unpacklo_epi8(v,zero);
+			__m128i hi = _mm_unpackhi_epi8(v,zero);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(g),_mm_unpacklo_epi16(lo,zero));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(g + 4),_mm_unpackhi_epi16(lo,zero));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(g + 8),_mm_unpacklo_epi16(hi,zero));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(g + 12),_mm_unpackhi_epi16(hi,zero));
+
+			drawable += 16 - bit_count(_mm_movemask_epi8(_mm_or_si128(_mm_cmplt_epi8(v,space),_mm_cmpeq_epi8(v,del))));
+
+			g += 16;
+			sz += 16;
+		}
+		else
+		{
+			// Multi-byte sequences somewhere in this block
+			for (const unsigned char* block_end = sz + 16;sz < block_end;++g)
+			{
+				*g = utf8_decode(sz,end);
+				if (drawable_glyph(*g))
+					++drawable;
+			}
+		}
+	}
+#endif
+
+	for (;sz < end;++g)
+	{
+		*g = utf8_decode(sz,end);
+		if (drawable_glyph(*g))
+			++drawable;
+	}
+
+	return static_cast<size_t>(g - glyphs);
+}
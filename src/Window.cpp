@@ -27,6 +27,13 @@
 
 #include <OOGL/StateFns.h>
 
+namespace Indigo
+{
+	void next_render_frame();
+	void pump_texture_streams();
+	void trim_textures();
+}
+
 Indigo::Render::Window::Window(Indigo::Window* owner) :
 		m_owner(owner),
 		m_have_cursor(false),
@@ -313,8 +320,14 @@ void Indigo::Window::run()
 
 		// Draw window
 		wnd->draw();
+
+		// Feed any streaming texture uploads, and drop textures over budget
+		pump_texture_streams();
+		trim_textures();
 		wnd.reset();
 
+		next_render_frame();
+
 		// Poll for UI events
 		glfwPollEvents();
 
@@ -23,13 +23,12 @@
 
 #include "Common.h"
 
-extern "C"
-{
-	#include "../3rdparty/stb/stb_image.h"
-}
+#include <OOBase/Vector.h>
 
 namespace
 {
+	Indigo::ZipResource::inflate_fn s_inflate = NULL;
+
 	template <typename T>
 	OOBase::uint32_t read_uint32(const T& buf, ptrdiff_t offset)
 	{
@@ -53,29 +52,100 @@ namespace
 #endif
 		return r;
 	}
+
+	// FNV-1a, which carries on from the prefix to the name without joining them
+	OOBase::uint32_t hash_name(const char* p, size_t len, OOBase::uint32_t h = 2166136261u)
+	{
+		for (size_t i = 0;i < len;++i)
+			h = (h ^ static_cast<unsigned char>(p[i])) * 16777619u;
+		return h;
+	}
+
+	// Keeps the archive mapped while a stored entry is in use
+	class MappingShare : public OOBase::detail::SharedCountBase
+	{
+	public:
+		MappingShare(const OOBase::SharedPtr<const OOBase::uint8_t>& mapping) : OOBase::detail::SharedCountBase(), m_mapping(mapping) {}
+		void dispose() { m_mapping.reset(); }
+
+		void destroy()
+		{
+			OOBase::CrtAllocator::delete_free(this);
+		}
+
+	private:
+		OOBase::SharedPtr<const OOBase::uint8_t> m_mapping;
+	};
 }
 
 namespace Indigo
 {
 	namespace detail
 	{
+		// The whole archive is mapped once, and nothing changes after open(), so loads may come from several threads at once
 		class ZipFile
 		{
 		public:
+			ZipFile() : m_length(0), m_count(0), m_mask(0), m_cache_budget(8 * 1024 * 1024), m_cache_bytes(0), m_hits(0), m_misses(0), m_tick(0)
+			{}
+
 			bool open(const char* filename);
 			OOBase::SharedPtr<const char> load(const OOBase::String& prefix, const char* name);
 			OOBase::uint64_t size(const OOBase::String& prefix, const char* name);
 			bool exists(const OOBase::String& prefix, const char* name);
 
+			bool load_many(const OOBase::String& prefix, const char* const* names, size_t count, OOBase::SharedPtr<const char>* results);
+
+			void cache_budget(size_t bytes);
+			void cache_stats(size_t& budget, size_t& bytes, OOBase::uint64_t& hits, OOBase::uint64_t& misses);
+
 		private:
-			OOBase::File m_file;
+			OOBase::File                             m_file;
+			OOBase::SharedPtr<const OOBase::uint8_t> m_map;
+			OOBase::uint64_t                         m_length;
 
-			struct Info
+			struct Entry
 			{
-				OOBase::uint32_t m_offset;
+				const char*      m_name;        // In m_map
+				OOBase::uint32_t m_hash;
+				OOBase::uint32_t m_offset;      // Of the data, past the local header
+				OOBase::uint32_t m_compressed;
 				OOBase::uint32_t m_length;
+				OOBase::uint16_t m_name_len;
+				OOBase::uint16_t m_compression;
 			};
-			OOBase::Table<OOBase::String,Info> m_mapFiles;
+			OOBase::ScopedArrayPtr<Entry,OOBase::CrtAllocator> m_entries;
+			size_t m_count;
+
+			// Open addressed by name hash, holding indexes into m_entries plus one, so 0 is empty
+			OOBase::ScopedArrayPtr<OOBase::uint32_t,OOBase::CrtAllocator> m_index;
+			size_t m_mask;
+
+			const Entry* find(const OOBase::String& prefix, const char* name);
+			OOBase::SharedPtr<const char> load(size_t entry);
+			OOBase::SharedPtr<const char> inflate(size_t entry);
+
+			struct InflateJob;
+			static void inflate_async(void* param);
+
+			// Inflated entries, least recently used first out once over budget
+			struct Cached
+			{
+				size_t                        m_entry;
+				OOBase::uint64_t              m_last_used;
+				OOBase::SharedPtr<const char> m_data;
+			};
+			OOBase::Condition::Mutex                    m_cache_lock;
+			OOBase::Vector<Cached,OOBase::CrtAllocator> m_cache;
+			size_t                                      m_cache_budget;
+			size_t                                      m_cache_bytes;
+			OOBase::uint64_t                            m_hits;
+			OOBase::uint64_t                            m_misses;
+			OOBase::uint64_t                            m_tick;
+
+			OOBase::SharedPtr<const char> cache_find(size_t entry);
+			void cache_add(size_t entry, const OOBase::SharedPtr<const char>& data);
+			void cache_trim(size_t budget);
 		};
 	}
 }
@@ -84,6 +154,7 @@ bool Indigo::detail::ZipFile::open(const char* filename)
 {
 	static const OOBase::uint8_t END_OF_CDR[4] = { 0x50, 0x4b, 0x05, 0x06 };
 	static const OOBase::uint8_t CDR_HEADER[4] = { 0x50, 0x4b, 0x01, 0x02 };
+	static const OOBase::uint8_t LFR_HEADER[4] = { 0x50, 0x4b, 0x03, 0x04 };
 
 	int err = m_file.open(filename,false);
 	if (err)
@@ -93,200 +164,420 @@ bool Indigo::detail::ZipFile::open(const char* filename)
 	if (len == OOBase::uint64_t(-1))
 		LOG_ERROR_RETURN(("Failed to get file length: %s",OOBase::system_error_text()),false);
 
-	// Step backwards looking for end of central directory record
-	OOBase::uint32_t cdr_size = 0;
-
-	OOBase::ScopedArrayPtr<OOBase::uint8_t,OOBase::ThreadLocalAllocator,256> buf;
-	for (OOBase::int64_t offset = len - 256;!cdr_size;)
-	{
-		if (offset < 0)
-			offset = 0;
+	if (len < 22 || len > OOBase::uint32_t(-1))
+		LOG_ERROR_RETURN(("Failed to find end of central dictionary in zip %s",filename),false);
 
-		OOBase::uint64_t p = m_file.seek(offset,OOBase::File::seek_begin);
-		if (p == OOBase::uint64_t(-1))
-			LOG_ERROR_RETURN(("Failed to get seek in file: %s",OOBase::system_error_text()),false);
+	m_map = m_file.auto_map<const OOBase::uint8_t>(false,0,static_cast<size_t>(len));
+	if (!m_map)
+		LOG_ERROR_RETURN(("Failed to map file %s: %s",filename,OOBase::system_error_text()),false);
 
-		size_t chunk_len = m_file.read(buf.get(),256);
-		if (chunk_len == size_t(-1))
-			LOG_ERROR_RETURN(("Failed to read file: %s",OOBase::system_error_text()),false);
+	m_length = len;
+	const OOBase::uint8_t* base = m_map.get();
 
-		// Scan forwards looking for signatures
-		for (OOBase::uint8_t* c = buf.get(); c < buf.get() + chunk_len - 4; ++c)
+	// Step backwards looking for end of central directory record, which may be followed by up to 64K of comment
+	const OOBase::uint8_t* eocd = NULL;
+	for (const OOBase::uint8_t* c = base + len - 22;!eocd;--c)
+	{
+		if (memcmp(c,END_OF_CDR,4) == 0)
 		{
-			if (memcmp(c,END_OF_CDR,4) == 0)
+			OOBase::uint64_t eof_cdr = c - base;
+			OOBase::uint16_t disk_no = read_uint16(c,4);
+			OOBase::uint16_t cdr_disk_no = read_uint16(c,6);
+			OOBase::uint16_t cdr_entries_disk = read_uint16(c,8);
+			OOBase::uint16_t cdr_entries = read_uint16(c,10);
+			OOBase::uint32_t cdr_size = read_uint32(c,12);
+			OOBase::uint32_t cdr_offset = read_uint32(c,16);
+			OOBase::uint16_t comments = read_uint16(c,20);
+
+			if (cdr_size >= 46 && (eof_cdr + 22 + comments == len) &&
+				(disk_no == 0 && cdr_disk_no == 0 && cdr_entries_disk == cdr_entries) &&
+				(OOBase::uint64_t(cdr_offset) + cdr_size <= eof_cdr) &&
+				memcmp(base + cdr_offset,CDR_HEADER,4) == 0)
 			{
-				OOBase::uint64_t eof_cdr = p + (c - buf.get());
-				if (len - eof_cdr >= 22 && m_file.seek(eof_cdr,OOBase::File::seek_begin) == eof_cdr)
-				{
-					m_file.read(buf.get(),22);
-
-					OOBase::uint16_t disk_no = read_uint16(buf,4);
-					OOBase::uint16_t cdr_disk_no = read_uint16(buf,6);
-					OOBase::uint16_t cdr_entries_disk = read_uint16(buf,8);
-					OOBase::uint16_t cdr_entries = read_uint16(buf,10);
-					OOBase::uint32_t cdr_size_i = read_uint32(buf,12);
-					OOBase::uint32_t cdr_offset = read_uint32(buf,16);
-					OOBase::uint16_t comments = read_uint16(buf,20);
-					
-					if (cdr_size_i >= 46 && (eof_cdr + 22 + comments == len) && 
-						(disk_no == 0 && cdr_disk_no == 0 && cdr_entries_disk == cdr_entries) &&
-						(cdr_offset + cdr_size_i <= eof_cdr))
-					{
-						if (m_file.seek(cdr_offset,OOBase::File::seek_begin) == cdr_offset)
-						{
-							m_file.read(buf.get(),46);
-							if (memcmp(buf.get(),CDR_HEADER,4) == 0)
-							{
-								cdr_size = cdr_size_i;
-								break;
-							}
-						}
-					}
-				}
+				eocd = c;
 			}
 		}
 
-		if (offset > 0)
-			offset -= 253;
-		else
+		if (c == base || (base + len) - c >= 22 + 0xFFFF)
 			break;
 	}
 
-	if (!cdr_size)
+	if (!eocd)
 		LOG_ERROR_RETURN(("Failed to find end of central dictionary in zip %s",filename),false);
 
-	// Now loop reading file entries
-	for (;;)
+	OOBase::uint16_t count = read_uint16(eocd,10);
+	const OOBase::uint8_t* p = base + read_uint32(eocd,16);
+	const OOBase::uint8_t* end = p + read_uint32(eocd,12);
+
+	// A power of two, at most half full
+	size_t slots = 2;
+	while (slots < size_t(count) * 2)
+		slots *= 2;
+
+	if (!m_entries.resize(count ? count : 1) || !m_index.resize(slots))
+		LOG_ERROR_RETURN(("Failed to resize buffer: %s",OOBase::system_error_text()),false);
+
+	memset(m_index.get(),0,slots * sizeof(OOBase::uint32_t));
+	m_mask = slots - 1;
+	m_count = 0;
+
+	// Now loop reading file entries, resolving each local header as we go
+	for (OOBase::uint16_t n = 0;n < count;++n)
 	{
-		struct Info info = {0};
+		if (end - p < 46 || memcmp(p,CDR_HEADER,4) != 0)
+			LOG_ERROR_RETURN(("Invalid central dictionary header in zip %s",filename),false);
 
-		info.m_length = read_uint32(buf,24);
-		OOBase::uint16_t filename_len = read_uint16(buf,28);
-		OOBase::uint16_t extra_len = read_uint16(buf,30);
-		OOBase::uint16_t comments = read_uint16(buf,32);
-		OOBase::uint16_t disk_no = read_uint16(buf,34);
-		info.m_offset = read_uint32(buf,42);
+		Entry entry;
+		entry.m_compression = read_uint16(p,10);
+		entry.m_compressed = read_uint32(p,20);
+		entry.m_length = read_uint32(p,24);
+		entry.m_name_len = read_uint16(p,28);
+		OOBase::uint16_t extra_len = read_uint16(p,30);
+		OOBase::uint16_t comments = read_uint16(p,32);
+		OOBase::uint16_t disk_no = read_uint16(p,34);
+		OOBase::uint32_t header_offset = read_uint32(p,42);
+		entry.m_name = reinterpret_cast<const char*>(p + 46);
 
 		if (disk_no != 0)
 			LOG_ERROR_RETURN(("Multi-disk zip file not supported: %s",filename),false);
 
-		if (filename_len == 0)
-			LOG_WARNING(("Ignoring empty filename in %s",filename));
-		else
+		size_t record = 46 + entry.m_name_len + extra_len + comments;
+		if (size_t(end - p) < record)
+			LOG_ERROR_RETURN(("Invalid central dictionary header in zip %s",filename),false);
+
+		p += record;
+
+		if (entry.m_name_len == 0)
 		{
-			if (!buf.resize(filename_len))
-				LOG_ERROR_RETURN(("Failed to resize buffer: %s",OOBase::system_error_text()),false);
+			LOG_WARNING(("Ignoring empty filename in %s",filename));
+			continue;
+		}
 
-			if (m_file.read(buf.get(),filename_len) != filename_len)
-				LOG_ERROR_RETURN(("Failed to read file %s: %s",filename,OOBase::system_error_text()),false);
+		if (OOBase::uint64_t(header_offset) + 30 > len || memcmp(base + header_offset,LFR_HEADER,4) != 0)
+			LOG_ERROR_RETURN(("Invalid local file header header in zip %s",filename),false);
 
-			OOBase::String strFilename;
-			if (!strFilename.assign(reinterpret_cast<char*>(buf.get()),filename_len))
-				LOG_ERROR_RETURN(("Failed to assign string: %s",OOBase::system_error_text()),false);
+		OOBase::uint64_t data = OOBase::uint64_t(header_offset) + 30 + read_uint16(base + header_offset,26) + read_uint16(base + header_offset,28);
+		if (data + entry.m_compressed > len)
+			LOG_ERROR_RETURN(("Invalid file length in zip %s",filename),false);
 
-			if (!m_mapFiles.insert(strFilename,info))
-				LOG_ERROR_RETURN(("Failed to insert zip entry: %s",OOBase::system_error_text()),false);
+		entry.m_offset = static_cast<OOBase::uint32_t>(data);
+		entry.m_hash = hash_name(entry.m_name,entry.m_name_len);
+
+		// The first of any duplicates wins
+		size_t slot = entry.m_hash & m_mask;
+		bool duplicate = false;
+		for (;m_index.get()[slot] && !duplicate;slot = (slot + 1) & m_mask)
+		{
+			const Entry& e = m_entries.get()[m_index.get()[slot] - 1];
+			duplicate = (e.m_hash == entry.m_hash && e.m_name_len == entry.m_name_len && memcmp(e.m_name,entry.m_name,entry.m_name_len) == 0);
 		}
 
-		if (cdr_size <= OOBase::uint32_t(filename_len) + extra_len + comments + 46)
-			break;
+		if (!duplicate)
+		{
+			m_entries.get()[m_count] = entry;
+			m_index.get()[slot] = static_cast<OOBase::uint32_t>(++m_count);
+		}
+	}
 
-		cdr_size -= 46 + filename_len + extra_len + comments;
-		if (m_file.seek(extra_len + comments,OOBase::File::seek_current) == OOBase::uint64_t(-1))
-			LOG_ERROR_RETURN(("Failed to get seek in file: %s",OOBase::system_error_text()),false);
+	return true;
+}
 
-		if (m_file.read(buf.get(),46) != 46)
-			LOG_ERROR_RETURN(("Failed to read central dictionary header in zip %s",filename),false);
+const Indigo::detail::ZipFile::Entry* Indigo::detail::ZipFile::find(const OOBase::String& prefix, const char* name)
+{
+	if (!m_count || !name)
+		return NULL;
 
-		if (memcmp(buf.get(),CDR_HEADER,4) != 0)
-			LOG_ERROR_RETURN(("Invalid central dictionary header in zip %s",filename),false);
+	size_t prefix_len = prefix.length();
+	size_t name_len = strlen(name);
+	OOBase::uint32_t hash = hash_name(name,name_len,hash_name(prefix.c_str(),prefix_len));
+
+	for (size_t slot = hash & m_mask;m_index.get()[slot];slot = (slot + 1) & m_mask)
+	{
+		const Entry* e = m_entries.get() + m_index.get()[slot] - 1;
+		if (e->m_hash == hash && e->m_name_len == prefix_len + name_len &&
+				(!prefix_len || memcmp(e->m_name,prefix.c_str(),prefix_len) == 0) &&
+				memcmp(e->m_name + prefix_len,name,name_len) == 0)
+		{
+			return e;
+		}
 	}
-	
-	return true;
+
+	return NULL;
 }
 
 OOBase::SharedPtr<const char> Indigo::detail::ZipFile::load(const OOBase::String& prefix, const char* name)
+{
+	const Entry* e = find(prefix,name);
+	if (!e)
+		return OOBase::SharedPtr<const char>();
+
+	return load(e - m_entries.get());
+}
+
+OOBase::SharedPtr<const char> Indigo::detail::ZipFile::load(size_t entry)
 {
 	OOBase::SharedPtr<const char> ret;
-	OOBase::String filename(prefix);
-	if (!filename.append(name))
-		LOG_ERROR_RETURN(("Failed to append string: %s",OOBase::system_error_text()),ret);
+	const Entry* e = m_entries.get() + entry;
+	if (e->m_compression == 0)
+	{
+		MappingShare* ms = OOBase::CrtAllocator::allocate_new<MappingShare>(m_map);
+		if (!ms)
+			LOG_ERROR_RETURN(("Failed to allocate: %s",OOBase::system_error_text()),ret);
+
+		ret = OOBase::make_shared(reinterpret_cast<const char*>(m_map.get()) + e->m_offset,ms);
+		if (!ret)
+		{
+			LOG_ERROR(("Failed to allocate: %s",OOBase::system_error_text()));
+			OOBase::CrtAllocator::delete_free(ms);
+		}
+	}
+	else if (e->m_compression == 8)
+	{
+		ret = cache_find(entry);
+		if (!ret)
+		{
+			ret = inflate(entry);
+			if (ret)
+				cache_add(entry,ret);
+		}
+	}
+	else
+		LOG_ERROR(("Unsupported zip compression method: %u",e->m_compression));
 
-	OOBase::Table<OOBase::String,Info>::iterator i=m_mapFiles.find(filename);
-	if (!i)
-		return ret;
+	return ret;
+}
 
-	// Read the local file header
-	if (m_file.seek(i->second.m_offset,OOBase::File::seek_begin) == OOBase::uint64_t(-1))
-		LOG_ERROR_RETURN(("Failed to get seek in file: %s",OOBase::system_error_text()),ret);
+OOBase::SharedPtr<const char> Indigo::detail::ZipFile::inflate(size_t entry)
+{
+	OOBase::SharedPtr<const char> ret;
+	const Entry* e = m_entries.get() + entry;
 
-	OOBase::uint8_t header[30];
-	if (m_file.read(header,30) != 30)
-		LOG_ERROR_RETURN(("Failed to read local file header header in zip"),ret);
+	char* p = static_cast<char*>(OOBase::CrtAllocator::allocate(e->m_length ? e->m_length : 1,1));
+	if (!p)
+		LOG_ERROR_RETURN(("Failed to allocate: %s",OOBase::system_error_text()),ret);
 
-	static const OOBase::uint8_t LFR_HEADER[4] = { 0x50, 0x4b, 0x03, 0x04 };
-	if (memcmp(header,LFR_HEADER,4) != 0)
-		LOG_ERROR_RETURN(("Invalid local file header header in zip"),ret);
+	ZipResource::inflate_fn fn = (s_inflate ? s_inflate : &detail::inflate);
+	if ((*fn)(m_map.get() + e->m_offset,e->m_compressed,reinterpret_cast<unsigned char*>(p),e->m_length) != e->m_length)
+	{
+		LOG_ERROR(("Failed to inflate file: %.*s",static_cast<int>(e->m_name_len),e->m_name));
+		OOBase::CrtAllocator::free(p);
+	}
+	else
+	{
+		ret = OOBase::const_pointer_cast<const char>(OOBase::make_shared<char>(p));
+		if (!ret)
+		{
+			LOG_ERROR(("Failed to allocate: %s",OOBase::system_error_text()));
+			OOBase::CrtAllocator::free(p);
+		}
+	}
+
+	return ret;
+}
 
-	OOBase::uint16_t compression = read_uint16(header,8);
-	OOBase::uint32_t compressed_size = read_uint32(header,18);
-	size_t offset = 30 + read_uint16(header,26) + read_uint16(header,28);
+struct Indigo::detail::ZipFile::InflateJob
+{
+	ZipFile*                      m_zip;
+	size_t                        m_entry;
+	OOBase::SharedPtr<const char> m_result;
+	OOBase::Condition::Mutex      m_lock;
+	bool                          m_claimed;
+	unsigned int                  m_refs;
+	OOBase::Event                 m_done;
+
+	// Whichever of the caller and a worker gets here first does the work
+	bool claim()
+	{
+		OOBase::Guard<OOBase::Condition::Mutex> guard(m_lock);
+		if (m_claimed)
+			return false;
 
-	OOBase::SharedPtr<const char> mapping = m_file.auto_map<const char>(false,i->second.m_offset + offset,compressed_size);
-	if (!mapping)
-		LOG_ERROR_RETURN(("Failed to map file content: %s",OOBase::system_error_text()),ret);
+		m_claimed = true;
+		return true;
+	}
 
-	if (compression == 0)
+	void run()
 	{
-		ret = mapping;
+		m_result = m_zip->inflate(m_entry);
+		if (m_result)
+			m_zip->cache_add(m_entry,m_result);
+
+		m_done.set();
 	}
-	else if (compression == 8)
+
+	void release()
 	{
-		void* p = OOBase::CrtAllocator::allocate(i->second.m_length,1);
-		if (!p)
-			LOG_ERROR_RETURN(("Failed to allocate: %s",OOBase::system_error_text()),ret);
+		OOBase::Guard<OOBase::Condition::Mutex> guard(m_lock);
+		bool last = (--m_refs == 0);
+		guard.release();
+
+		if (last)
+			OOBase::CrtAllocator::delete_free(this);
+	}
+};
 
-		if (stbi_zlib_decode_noheader_buffer(static_cast<char*>(p),(int)i->second.m_length,mapping.get(),(int)compressed_size) == -1)
+void Indigo::detail::ZipFile::inflate_async(void* param)
+{
+	InflateJob* job = static_cast<InflateJob*>(param);
+	if (job->claim())
+		job->run();
+
+	job->release();
+}
+
+bool Indigo::detail::ZipFile::load_many(const OOBase::String& prefix, const char* const* names, size_t count, OOBase::SharedPtr<const char>* results)
+{
+	OOBase::ScopedArrayPtr<InflateJob*,OOBase::ThreadLocalAllocator> jobs;
+	if (!jobs.resize(count ? count : 1))
+		LOG_ERROR_RETURN(("Failed to allocate: %s",OOBase::system_error_text()),false);
+
+	bool ret = true;
+	for (size_t n = 0;n < count;++n)
+	{
+		jobs.get()[n] = NULL;
+		results[n].reset();
+
+		const Entry* e = find(prefix,names[n]);
+		if (!e)
+			continue;
+
+		size_t entry = e - m_entries.get();
+		if (e->m_compression != 8 || (results[n] = cache_find(entry)))
 		{
-			LOG_ERROR(("Failed to inflate file: %s",stbi_failure_reason()));
-			OOBase::CrtAllocator::free(p);
+			if (!results[n])
+				results[n] = load(entry);
+			continue;
 		}
-		else
+
+		InflateJob* job = OOBase::CrtAllocator::allocate_new<InflateJob>();
+		if (!job)
 		{
-			ret = OOBase::const_pointer_cast<const char>(OOBase::make_shared<char>(static_cast<char*>(p)));
-			if (!ret)
-			{
-				LOG_ERROR(("Failed to allocate: %s",OOBase::system_error_text()));
-				OOBase::CrtAllocator::free(p);
-			}
+			LOG_ERROR(("Failed to allocate: %s",OOBase::system_error_text()));
+			ret = false;
+			continue;
+		}
+
+		job->m_zip = this;
+		job->m_entry = entry;
+		job->m_claimed = false;
+		job->m_refs = 2;
+		if (!run_on_decode_pool(&inflate_async,job))
+			job->m_refs = 1;
+
+		jobs.get()[n] = job;
+	}
+
+	// Inflate whatever the workers have not started, rather than wait behind other work, then collect the rest
+	for (size_t n = 0;n < count;++n)
+	{
+		if (jobs.get()[n] && jobs.get()[n]->claim())
+			jobs.get()[n]->run();
+	}
+
+	for (size_t n = 0;n < count;++n)
+	{
+		InflateJob* job = jobs.get()[n];
+		if (job)
+		{
+			job->m_done.wait();
+			results[n] = job->m_result;
+			job->release();
 		}
 	}
-	else
-		LOG_ERROR(("Unsupported zip compression method: %u",compression));
 
 	return ret;
 }
 
 OOBase::uint64_t Indigo::detail::ZipFile::size(const OOBase::String& prefix, const char* name)
 {
-	OOBase::String filename(prefix);
-	if (!filename.append(name))
-		LOG_ERROR_RETURN(("Cannot append string: %s",OOBase::system_error_text()),OOBase::uint64_t(-1));
+	const Entry* e = find(prefix,name);
+	return e ? e->m_length : 0;
+}
 
-	OOBase::Table<OOBase::String,Info>::iterator i=m_mapFiles.find(filename);
-	if (!i)
-		return 0;
+bool Indigo::detail::ZipFile::exists(const OOBase::String& prefix, const char* name)
+{
+	return find(prefix,name) != NULL;
+}
 
-	return i->second.m_length;
+OOBase::SharedPtr<const char> Indigo::detail::ZipFile::cache_find(size_t entry)
+{
+	OOBase::Guard<OOBase::Condition::Mutex> guard(m_cache_lock);
+
+	for (OOBase::Vector<Cached,OOBase::CrtAllocator>::iterator i=m_cache.begin();i;++i)
+	{
+		if (i->m_entry == entry)
+		{
+			i->m_last_used = ++m_tick;
+			++m_hits;
+			return i->m_data;
+		}
+	}
+
+	++m_misses;
+	return OOBase::SharedPtr<const char>();
 }
 
-bool Indigo::detail::ZipFile::exists(const OOBase::String& prefix, const char* name)
+void Indigo::detail::ZipFile::cache_add(size_t entry, const OOBase::SharedPtr<const char>& data)
+{
+	size_t bytes = m_entries.get()[entry].m_length;
+
+	OOBase::Guard<OOBase::Condition::Mutex> guard(m_cache_lock);
+
+	if (bytes > m_cache_budget)
+		return;
+
+	// Another thread may have inflated it too
+	for (OOBase::Vector<Cached,OOBase::CrtAllocator>::iterator i=m_cache.begin();i;++i)
+	{
+		if (i->m_entry == entry)
+			return;
+	}
+
+	cache_trim(m_cache_budget - bytes);
+
+	Cached cached;
+	cached.m_entry = entry;
+	cached.m_last_used = ++m_tick;
+	cached.m_data = data;
+	if (!m_cache.push_back(cached))
+		LOG_WARNING(("Failed to cache zip entry: %s",OOBase::system_error_text()));
+	else
+		m_cache_bytes += bytes;
+}
+
+void Indigo::detail::ZipFile::cache_trim(size_t budget)
+{
+	// Callers may still hold what we drop; we just stop keeping it for them
+	while (m_cache_bytes > budget && !m_cache.empty())
+	{
+		OOBase::Vector<Cached,OOBase::CrtAllocator>::iterator oldest = m_cache.begin();
+		for (OOBase::Vector<Cached,OOBase::CrtAllocator>::iterator i=m_cache.begin();i;++i)
+		{
+			if (i->m_last_used < oldest->m_last_used)
+				oldest = i;
+		}
+
+		m_cache_bytes -= m_entries.get()[oldest->m_entry].m_length;
+		m_cache.erase(oldest);
+	}
+}
+
+void Indigo::detail::ZipFile::cache_budget(size_t bytes)
 {
-	OOBase::String filename(prefix);
-	if (!filename.append(name))
-		LOG_ERROR_RETURN(("Cannot append string: %s",OOBase::system_error_text()),false);
+	OOBase::Guard<OOBase::Condition::Mutex> guard(m_cache_lock);
 
-	return m_mapFiles.exists(filename);
+	m_cache_budget = bytes;
+	cache_trim(bytes);
+}
+
+void Indigo::detail::ZipFile::cache_stats(size_t& budget, size_t& bytes, OOBase::uint64_t& hits, OOBase::uint64_t& misses)
+{
+	OOBase::Guard<OOBase::Condition::Mutex> guard(m_cache_lock);
+
+	budget = m_cache_budget;
+	bytes = m_cache_bytes;
+	hits = m_hits;
+	misses = m_misses;
 }
 
 Indigo::ZipResource::ZipResource()
@@ -354,3 +645,35 @@ bool Indigo::ZipResource::exists(const char* name) const
 
 	return m_zip->exists(m_prefix,name);
 }
+
+void Indigo::ZipResource::cache_budget(size_t bytes)
+{
+	if (m_zip)
+		m_zip->cache_budget(bytes);
+}
+
+Indigo::ZipResource::CacheStats Indigo::ZipResource::cache_stats() const
+{
+	CacheStats stats = {0};
+	if (m_zip)
+		m_zip->cache_stats(stats.m_budget,stats.m_bytes,stats.m_hits,stats.m_misses);
+
+	return stats;
+}
+
+void Indigo::ZipResource::inflater(inflate_fn fn)
+{
+	s_inflate = fn;
+}
+
+bool Indigo::ZipResource::load_many(const char* const* names, size_t count, OOBase::SharedPtr<const char>* results) const
+{
+	if (!m_zip)
+	{
+		for (size_t n = 0;n < count;++n)
+			results[n].reset();
+		return false;
+	}
+
+	return m_zip->load_many(m_prefix,names,count,results);
+}
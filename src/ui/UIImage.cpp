@@ -26,10 +26,11 @@
 
 #include "../Common.h"
 
-Indigo::Render::UIImage::UIImage(const OOBase::SharedPtr<OOGL::Texture>& texture, const glm::vec4& colour, bool visible, const glm::ivec2& position, const glm::uvec2& size) :
+Indigo::Render::UIImage::UIImage(const OOBase::SharedPtr<ManagedTexture>& texture, const glm::vec4& colour, bool visible, const glm::ivec2& position, const glm::uvec2& size, const glm::vec4& tex_rect) :
 		UIDrawable(visible,position,size),
 		m_texture(texture),
-		m_colour(colour)
+		m_colour(colour),
+		m_tex_rect(tex_rect)
 {
 }
 
@@ -37,8 +38,12 @@ void Indigo::Render::UIImage::on_draw(OOGL::State& glState, const glm::mat4& mvp
 {
 	if (m_texture && m_colour.a > 0.f)
 	{
-		const glm::uvec2& sz = size();
-		m_quad.draw(glState,m_texture,glm::scale(mvp,glm::vec3(sz.x,sz.y,0.f)),m_colour);
+		const OOBase::SharedPtr<OOGL::Texture>& texture = m_texture->get();
+		if (texture)
+		{
+			const glm::uvec2& sz = size();
+			m_quad.draw(glState,texture,glm::scale(mvp,glm::vec3(sz.x,sz.y,0.f)),m_colour,m_tex_rect);
+		}
 	}
 }
 
@@ -69,24 +74,18 @@ void Indigo::UIImage::on_size(glm::uvec2& sz)
 bool Indigo::UIImage::on_render_create(Indigo::Render::UIGroup* group)
 {
 	
-	OOBase::SharedPtr<OOGL::Texture> texture;
+	OOBase::SharedPtr<Render::ManagedTexture> texture;
+	glm::vec4 tex_rect(0.f,0.f,1.f,1.f);
 	if (m_image)
 	{
-		bool cached = true;
-		texture = m_image->make_texture(GL_RGBA8,cached);
+		texture = Render::TextureManager::instance().acquire(m_image.get(),GL_RGBA8,0,GL_LINEAR_MIPMAP_LINEAR);
 		if (!texture)
 			return false;
 
-		if (!cached)
-		{
-			texture->parameter(GL_TEXTURE_MAG_FILTER,GL_LINEAR);
-			texture->parameter(GL_TEXTURE_MIN_FILTER,GL_LINEAR_MIPMAP_LINEAR);
-			texture->parameter(GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
-			texture->parameter(GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
-		}
+		tex_rect = m_image->tex_rect();
 	}
 
-	OOBase::SharedPtr<Render::UIImage> render_image = OOBase::allocate_shared<Render::UIImage,OOBase::ThreadLocalAllocator>(texture,m_colour,true,glm::ivec2(),size());
+	OOBase::SharedPtr<Render::UIImage> render_image = OOBase::allocate_shared<Render::UIImage,OOBase::ThreadLocalAllocator>(texture,m_colour,true,glm::ivec2(),size(),tex_rect);
 	if (!render_image)
 		LOG_ERROR_RETURN(("Failed to allocate button caption: %s",OOBase::system_error_text()),false);
 
@@ -56,6 +56,9 @@ Indigo::Render::UIShadowLabel::UIShadowLabel(const OOBase::SharedPtr<Font>& font
 
 void Indigo::Render::UIShadowLabel::on_draw(OOGL::State& glState, const glm::mat4& mvp) const
 {
+	if (m_drop != glm::ivec2(0) && m_shadow.a > 0.f && Text::draw_shadowed(glState,glm::scale(mvp,glm::vec3(m_font_size)),m_colour,m_shadow,glm::vec2(m_drop) / m_font_size))
+		return;
+
 	if (m_drop != glm::ivec2(0) && m_shadow.a > 0.f)
 		Text::draw(glState,glm::scale(glm::translate(mvp,glm::vec3(m_drop.x,m_drop.y,0.f)),glm::vec3(m_font_size)),m_shadow);
 
@@ -539,8 +539,9 @@ OOBase::SharedPtr<Indigo::UIWidget> Indigo::UILoader::load_uiimage(const char*&
 	OOBase::SharedPtr<Image> image;
 	if (!image_name.empty())
 	{
-		image = load_image(image_name);
-		if (!image)
+		// Atlas pages are never mipmapped, so don't build a mip chain only to drop it
+		image = load_image(image_name,Image::eLF_downscale);
+		if (!image || !m_atlas.add(image))
 			return OOBase::SharedPtr<UIWidget>();
 	}
 
@@ -568,12 +569,18 @@ OOBase::SharedPtr<Indigo::NinePatch> Indigo::UILoader::load_9patch(const char*&
 	if (!patch)
 		LOG_ERROR_RETURN(("Failed to allocate: %s",OOBase::system_error_text()),patch);
 
+	// Patches are only drawn from their textures
+	patch->discard_pixels();
+
 	if (!patch->load(*m_resource,patch_name.c_str(),4))
 		return OOBase::SharedPtr<NinePatch>();
 
 	if (!m_hash9Patches.insert(hash,patch))
 		LOG_WARNING(("Failed to cache 9 patch: %s",OOBase::system_error_text()));
 
+	if (!m_atlas.add(patch))
+		return OOBase::SharedPtr<NinePatch>();
+
 	return patch;
 }
 
@@ -1012,6 +1019,12 @@ OOBase::SharedPtr<Indigo::UIWidget> Indigo::UILoader::load_panel(const char*& p,
 	return panel;
 }
 
+bool Indigo::UILoader::on_loaded()
+{
+	// Pack everything this file uses before any of it reaches the render thread
+	return m_atlas.build();
+}
+
 void Indigo::UILoader::unload()
 {
 	for (button_style_hash_t::iterator i=m_hashButtonStyles.begin();i;++i)
@@ -1019,6 +1032,8 @@ void Indigo::UILoader::unload()
 	
 	for (ninepatch_hash_t::iterator i=m_hash9Patches.begin();i;++i)
 		i->second->unload();
+
+	m_atlas.clear();
 	
 	Parser::unload();
 }
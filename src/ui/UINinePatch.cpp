@@ -27,9 +27,15 @@
 
 #include "../Common.h"
 
+#include <OOBase/HashTable.h>
 #include <OOGL/BufferObject.h>
 #include <OOGL/VertexArrayObject.h>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define INDIGO_NINEPATCH_SSE2 1
+#endif
+
 namespace
 {
 	class NinePatchFactory
@@ -37,9 +43,9 @@ namespace
 	public:
 		NinePatchFactory();
 
-		GLsizei alloc_patch(const glm::uvec2& size, const glm::uvec4& borders, const glm::uvec2& tex_size);
+		GLsizei alloc_patch(const glm::uvec2& size, const glm::uvec4& borders, const glm::uvec2& tex_size, const glm::vec4& tex_rect);
 		void free_patch(GLsizei p);
-		void layout_patch(GLsizei patch, const glm::uvec2& size, const glm::uvec4& borders, const glm::uvec2& tex_size);
+		void layout_patch(GLsizei patch, const glm::uvec2& size, const glm::uvec4& borders, const glm::uvec2& tex_size, const glm::vec4& tex_rect);
 
 		void draw(OOGL::State& state, const OOBase::SharedPtr<OOGL::Texture>& texture, const glm::mat4& mvp, const glm::vec4& colour, const GLsizeiptr* firsts, const GLsizei* counts, GLsizei drawcount);
 
@@ -66,6 +72,51 @@ namespace
 
 	const unsigned int vertices_per_patch = 16;
 	const unsigned int elements_per_patch = 24;
+
+	// What the border scan found, by hash of the encoded image, so loading the same patch again skips it.
+	// The encoded image is kept to compare against, as the hash alone can collide
+	struct NinePatchCache
+	{
+		struct Entry
+		{
+			OOBase::SharedPtr<const unsigned char> m_source;
+			size_t       m_len;
+			int          m_components;
+			unsigned int m_valid_components;
+			glm::uvec2   m_size;
+			glm::uvec4   m_borders;
+			glm::uvec4   m_margins;
+		};
+
+		typedef OOBase::HashTable<size_t,Entry,OOBase::CrtAllocator> table_t;
+
+		OOBase::Condition::Mutex m_lock;
+		table_t                  m_entries;
+	};
+
+	typedef OOBase::Singleton<NinePatchCache> NINEPATCH_CACHE;
+
+	// Finds the span of black after the first run of clear, which must be followed only by clear
+	bool scan(const unsigned char* black, unsigned int len, glm::uvec2& span)
+	{
+		for (span.x = 0;span.x < len && !black[span.x];++span.x)
+			;
+
+		if (span.x == 0)
+			return false;
+
+		for (span.y = span.x;span.y < len && black[span.y];++span.y)
+			;
+
+		if (span.x == span.y || span.y == len)
+			return false;
+
+		unsigned int eol = span.y;
+		for (;eol < len && !black[eol];++eol)
+			;
+
+		return (eol == len);
+	}
 }
 
 NinePatchFactory::NinePatchFactory() : m_allocated(0)
@@ -83,7 +134,7 @@ bool NinePatchFactory::create_program()
 	return m_ptrProgram;
 }
 
-GLsizei NinePatchFactory::alloc_patch(const glm::uvec2& size, const glm::uvec4& borders, const glm::uvec2& tex_size)
+GLsizei NinePatchFactory::alloc_patch(const glm::uvec2& size, const glm::uvec4& borders, const glm::uvec2& tex_size, const glm::vec4& tex_rect)
 {
 	GLsizei patch = -1;
 
@@ -171,15 +222,19 @@ GLsizei NinePatchFactory::alloc_patch(const glm::uvec2& size, const glm::uvec4&
 		e[i*2 + 1] = static_cast<GLuint>(idx + i + 4);
 	}
 
-	layout_patch(patch,size,borders,tex_size);
+	layout_patch(patch,size,borders,tex_size,tex_rect);
 
 	return patch;
 }
 
-void NinePatchFactory::layout_patch(GLsizei patch, const glm::uvec2& size, const glm::uvec4& borders, const glm::uvec2& tex_size)
+void NinePatchFactory::layout_patch(GLsizei patch, const glm::uvec2& size, const glm::uvec4& borders, const glm::uvec2& tex_size, const glm::vec4& tex_rect)
 {
 	static const unsigned int ushort_max = 0xFFFF;
 
+	// Texture coordinates within tex_rect, which is the whole texture unless the patch is in an atlas
+	const glm::vec2 uv0(glm::vec2(tex_rect.x,tex_rect.y) * float(ushort_max));
+	const glm::vec2 uv_scale(glm::vec2(tex_rect.z - tex_rect.x,tex_rect.w - tex_rect.y) * float(ushort_max));
+
 	OOBase::SharedPtr<vertex_data> attribs = m_ptrVertices->auto_map<vertex_data>(GL_MAP_WRITE_BIT,patch * vertices_per_patch * sizeof(vertex_data),vertices_per_patch * sizeof(vertex_data));
 	vertex_data* a = attribs.get();
 
@@ -188,10 +243,10 @@ void NinePatchFactory::layout_patch(GLsizei patch, const glm::uvec2& size, const
 	a[3].x = static_cast<float>(size.x);
 	a[2].x = a[3].x - borders.z;
 
-	a[0].u = 0;
-	a[1].u = static_cast<GLushort>(static_cast<float>(borders.x) / tex_size.x * ushort_max);
-	a[2].u = static_cast<GLushort>(static_cast<float>(tex_size.x - borders.z) / tex_size.x * ushort_max);
-	a[3].u = ushort_max;
+	a[0].u = static_cast<GLushort>(uv0.x);
+	a[1].u = static_cast<GLushort>(uv0.x + static_cast<float>(borders.x) / tex_size.x * uv_scale.x);
+	a[2].u = static_cast<GLushort>(uv0.x + static_cast<float>(tex_size.x - borders.z) / tex_size.x * uv_scale.x);
+	a[3].u = static_cast<GLushort>(uv0.x + uv_scale.x);
 
 	for (size_t i=0;i<4;++i)
 	{
@@ -204,10 +259,10 @@ void NinePatchFactory::layout_patch(GLsizei patch, const glm::uvec2& size, const
 
 		a[i+12].u = a[i+8].u = a[i+4].u = a[i].u;
 
-		a[i].v = 0;
-		a[i+4].v = static_cast<GLushort>(static_cast<float>(borders.w) / tex_size.y * ushort_max);
-		a[i+8].v = static_cast<GLushort>(static_cast<float>(tex_size.y - borders.y) / tex_size.y * ushort_max);
-		a[i+12].v = ushort_max;
+		a[i].v = static_cast<GLushort>(uv0.y);
+		a[i+4].v = static_cast<GLushort>(uv0.y + static_cast<float>(borders.w) / tex_size.y * uv_scale.y);
+		a[i+8].v = static_cast<GLushort>(uv0.y + static_cast<float>(tex_size.y - borders.y) / tex_size.y * uv_scale.y);
+		a[i+12].v = static_cast<GLushort>(uv0.y + uv_scale.y);
 	}
 }
 
@@ -247,15 +302,16 @@ void NinePatchFactory::draw(OOGL::State& glState, const OOBase::SharedPtr<OOGL::
 	}
 }
 
-Indigo::Render::UINinePatch::UINinePatch(const OOBase::SharedPtr<OOGL::Texture>& texture, const glm::vec4& colour, const OOBase::SharedPtr<Indigo::NinePatch::Info>& info, bool visible, const glm::ivec2& position, const glm::uvec2& size) :
+Indigo::Render::UINinePatch::UINinePatch(const OOBase::SharedPtr<ManagedTexture>& texture, const glm::vec4& colour, const OOBase::SharedPtr<Indigo::NinePatch::Info>& info, bool visible, const glm::ivec2& position, const glm::uvec2& size, const glm::vec4& tex_rect) :
 		UIDrawable(visible,position,size),
 		m_factory(OOGL::ContextSingleton<NinePatchFactory>::instance_ptr()),
 		m_texture(texture),
 		m_colour(colour),
+		m_tex_rect(tex_rect),
 		m_patch(-1),
 		m_info(info)
 {
-	m_patch = static_cast<NinePatchFactory*>(m_factory)->alloc_patch(size,m_info->m_borders,m_info->m_tex_size);
+	m_patch = static_cast<NinePatchFactory*>(m_factory)->alloc_patch(size,m_info->m_borders,m_info->m_tex_size,m_tex_rect);
 	if (m_patch != -1)
 	{
 		GLsizei patch = m_patch * elements_per_patch;
@@ -323,7 +379,7 @@ Indigo::Render::UINinePatch::~UINinePatch()
 void Indigo::Render::UINinePatch::size(const glm::uvec2& sz)
 {
 	if (m_patch != -1 && m_info)
-		static_cast<NinePatchFactory*>(m_factory)->layout_patch(m_patch,sz,m_info->m_borders,m_info->m_tex_size);
+		static_cast<NinePatchFactory*>(m_factory)->layout_patch(m_patch,sz,m_info->m_borders,m_info->m_tex_size,m_tex_rect);
 
 	UIDrawable::size(sz);
 }
@@ -332,19 +388,23 @@ void Indigo::Render::UINinePatch::on_draw(OOGL::State& glState, const glm::mat4&
 {
 	if (m_patch != -1 && m_colour.a > 0)
 	{
+		const OOBase::SharedPtr<OOGL::Texture>& texture = m_texture->get();
+		if (!texture)
+			return;
+
 		if (m_counts[0])
 		{
 			if (m_counts[2])
-				static_cast<NinePatchFactory*>(m_factory)->draw(glState,m_texture,mvp,m_colour,m_firsts,m_counts,3);
+				static_cast<NinePatchFactory*>(m_factory)->draw(glState,texture,mvp,m_colour,m_firsts,m_counts,3);
 			else
-				static_cast<NinePatchFactory*>(m_factory)->draw(glState,m_texture,mvp,m_colour,m_firsts,m_counts,2);
+				static_cast<NinePatchFactory*>(m_factory)->draw(glState,texture,mvp,m_colour,m_firsts,m_counts,2);
 		}
 		else
 		{
 			if (m_counts[2])
-				static_cast<NinePatchFactory*>(m_factory)->draw(glState,m_texture,mvp,m_colour,&m_firsts[1],&m_counts[1],2);
+				static_cast<NinePatchFactory*>(m_factory)->draw(glState,texture,mvp,m_colour,&m_firsts[1],&m_counts[1],2);
 			else
-				static_cast<NinePatchFactory*>(m_factory)->draw(glState,m_texture,mvp,m_colour,&m_firsts[1],&m_counts[1],1);
+				static_cast<NinePatchFactory*>(m_factory)->draw(glState,texture,mvp,m_colour,&m_firsts[1],&m_counts[1],1);
 		}
 	}
 }
@@ -370,7 +430,72 @@ bool Indigo::NinePatch::load(const ResourceBundle& resource, const char* name, i
 	if (!buffer)
 		return false;
 
-	return this->load(buffer.get(),resource.size(name),components);
+	size_t len = resource.size(name);
+	size_t hash = OOBase::Hash<const char*>::hash(reinterpret_cast<const char*>(buffer.get()),len);
+
+	// A patch we have seen before needs no scan, and is decoded on a worker thread
+	if (load_cached(hash,buffer,len,components))
+	{
+		keep_source(buffer,len,components);
+		return restore_levels();
+	}
+
+	if (!this->load(buffer.get(),len,components))
+		return false;
+
+	keep_source(buffer,len,components);
+
+	NinePatchCache::Entry entry;
+	entry.m_source = buffer;
+	entry.m_len = len;
+	entry.m_components = components;
+	entry.m_valid_components = m_valid_components;
+	entry.m_size = glm::uvec2(m_width,m_height);
+	entry.m_borders = m_info->m_borders;
+	entry.m_margins = m_margins;
+
+	NinePatchCache& cache = NINEPATCH_CACHE::instance();
+	OOBase::Guard<OOBase::Condition::Mutex> guard(cache.m_lock);
+	if (!cache.m_entries.find(hash) && !cache.m_entries.insert(hash,entry))
+		LOG_WARNING(("Failed to cache 9-patch: %s",OOBase::system_error_text()));
+
+	return true;
+}
+
+bool Indigo::NinePatch::load_cached(size_t hash, const OOBase::SharedPtr<const unsigned char>& buffer, size_t len, int components)
+{
+	NinePatchCache::Entry entry;
+	{
+		NinePatchCache& cache = NINEPATCH_CACHE::instance();
+		OOBase::Guard<OOBase::Condition::Mutex> guard(cache.m_lock);
+
+		NinePatchCache::table_t::iterator i = cache.m_entries.find(hash);
+		if (!i || i->second.m_len != len || i->second.m_components != components)
+			return false;
+
+		if (i->second.m_source.get() != buffer.get() && memcmp(i->second.m_source.get(),buffer.get(),len) != 0)
+			return false;
+
+		entry = i->second;
+	}
+
+	OOBase::SharedPtr<Info> info = OOBase::allocate_shared<Indigo::NinePatch::Info>();
+	if (!info)
+		return false;
+
+	unload();
+
+	m_width = entry.m_size.x;
+	m_height = entry.m_size.y;
+	m_valid_components = entry.m_valid_components;
+	m_components = (components ? components : entry.m_valid_components);
+	m_margins = entry.m_margins;
+
+	info->m_borders = entry.m_borders;
+	info->m_tex_size = entry.m_size;
+	m_info = info;
+
+	return true;
 }
 
 bool Indigo::NinePatch::load(const unsigned char* buffer, size_t len, int components)
@@ -394,62 +519,78 @@ bool Indigo::NinePatch::load(const unsigned char* buffer, size_t len, int compon
 	return ret;
 }
 
-bool Indigo::NinePatch::pixel_cmp(int x, int y, bool black)
+void Indigo::NinePatch::classify(unsigned int first, unsigned int step, unsigned int count, unsigned char* black) const
 {
-	static const char black_rgba[4] = { 0, 0, 0, char(0xFF) };
-	int comp_bits = 0;
-
-	const char* p = static_cast<char*>(m_pixels) + ((y * m_width) + x) * m_components;
+	// Sets black[i] when the valid components of pixel first + i * step are all opaque black
+	static const unsigned char black_rgba[4] = { 0, 0, 0, 0xFF };
+	const unsigned char* pixels = static_cast<const unsigned char*>(m_pixels);
+	unsigned int i = 0;
 
-	for (unsigned int c=0;c<m_valid_components;++c)
+	if (m_components == 4)
 	{
-		if (p[c] == black_rgba[c])
-			comp_bits |= (1 << c);
+		unsigned char mask_bytes[4] = { 0, 0, 0, 0 };
+		for (unsigned int c = 0;c < m_valid_components && c < 4;++c)
+			mask_bytes[c] = 0xFF;
+
+		OOBase::uint32_t mask, expect;
+		memcpy(&mask,mask_bytes,4);
+		memcpy(&expect,black_rgba,4);
+		expect &= mask;
+
+#if defined(INDIGO_NINEPATCH_SSE2)
+		const __m128i vmask = _mm_set1_epi32(static_cast<int>(mask));
+		const __m128i vexpect = _mm_set1_epi32(static_cast<int>(expect));
+		for (;i + 4 <= count;i += 4)
+		{
+			__m128i v;
+			if (step == 1)
+				v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + (first + i) * 4));
+			else
+			{
+				OOBase::uint32_t p[4];
+				for (unsigned int j = 0;j < 4;++j)
+					memcpy(&p[j],pixels + (first + (i + j) * step) * 4,4);
+				v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+			}
+
+			int bits = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(v,vmask),vexpect)));
+			black[i] = bits & 1;
+			black[i+1] = (bits >> 1) & 1;
+			black[i+2] = (bits >> 2) & 1;
+			black[i+3] = (bits >> 3) & 1;
+		}
+#endif
+		for (;i < count;++i)
+		{
+			OOBase::uint32_t p;
+			memcpy(&p,pixels + (first + i * step) * 4,4);
+			black[i] = ((p & mask) == expect);
+		}
 	}
+	else
+	{
+		for (;i < count;++i)
+		{
+			const unsigned char* p = pixels + (first + i * step) * m_components;
+			unsigned int c = 0;
+			while (c < m_valid_components && p[c] == black_rgba[c])
+				++c;
 
-	return (black == (comp_bits == ((1 << m_valid_components)-1)));
+			black[i] = (c == m_valid_components);
+		}
+	}
 }
 
-bool Indigo::NinePatch::scan_line(int line, glm::uvec2& span)
+bool Indigo::NinePatch::scan_line(unsigned int line, glm::uvec2& span, unsigned char* black) const
 {
-	for (span.x = 0;span.x < m_width && pixel_cmp(span.x,line,false);++span.x)
-		;
-
-	if (span.x == 0)
-		return false;
-
-	for (span.y = span.x;span.y < m_width && pixel_cmp(span.y,line,true);++span.y)
-		;
-
-	if (span.x == span.y || span.y == m_width)
-		return false;
-
-	unsigned int eol = span.y;
-	for (;eol < m_width && pixel_cmp(eol,line,false);++eol)
-		;
-
-	return (eol == m_width);
+	classify(line * m_width,1,m_width,black);
+	return scan(black,m_width,span);
 }
 
-bool Indigo::NinePatch::scan_column(int column, glm::uvec2& span)
+bool Indigo::NinePatch::scan_column(unsigned int column, glm::uvec2& span, unsigned char* black) const
 {
-	for (span.x = 0;span.x < m_height && pixel_cmp(column,span.x,false);++span.x)
-		;
-
-	if (span.x == 0)
-		return false;
-
-	for (span.y = span.x;span.y < m_height && pixel_cmp(column,span.y,true);++span.y)
-		;
-
-	if (span.x == span.y || span.y == m_height)
-		return false;
-
-	unsigned int eoc = span.y;
-	for (;eoc < m_height && pixel_cmp(column,eoc,false);++eoc)
-		;
-
-	return (eoc == m_height);
+	classify(column,m_width,m_height,black);
+	return scan(black,m_height,span);
 }
 
 bool Indigo::NinePatch::get_bounds()
@@ -457,25 +598,29 @@ bool Indigo::NinePatch::get_bounds()
 	bool has_border = false;
 	bool has_margins = false;
 
+	OOBase::ScopedArrayPtr<unsigned char,OOBase::ThreadLocalAllocator> black;
+	if (!black.resize(m_width > m_height ? m_width : m_height))
+		LOG_ERROR_RETURN(("Failed to allocate: %s",OOBase::system_error_text()),false);
+
 	glm::uvec2 span;
-	if (scan_line(0,span))
+	if (scan_line(0,span,black.get()))
 	{
 		m_info->m_borders.x = span.x;
 		m_info->m_borders.z = m_width - span.y;
 
-		if (scan_column(0,span))
+		if (scan_column(0,span,black.get()))
 		{
 			has_border = true;
 
 			m_info->m_borders.y = m_height - span.y;
 			m_info->m_borders.w = span.x;
 
-			if (scan_line(m_height-1,span))
+			if (scan_line(m_height-1,span,black.get()))
 			{
 				m_margins.x = span.x;
 				m_margins.z = m_width  - span.y;
 
-				if (scan_column(m_width-1,span))
+				if (scan_column(m_width-1,span,black.get()))
 				{
 					has_margins = true;
 
@@ -486,54 +631,60 @@ bool Indigo::NinePatch::get_bounds()
 		}
 	}
 
-	if (has_margins)
+	if (has_margins || has_border)
 	{
 		// Now swap out the pixels for a sub-image...
-		char* new_pixels = static_cast<char*>(OOBase::ThreadLocalAllocator::allocate((m_width-2)*(m_height-2)*m_components));
+		unsigned int width = m_width;
+		m_width -= (has_margins ? 2 : 1);
+		m_height -= (has_margins ? 2 : 1);
+
+		void* new_pixels = crop(m_pixels,width);
 		if (!new_pixels)
 			LOG_ERROR_RETURN(("Failed to allocate 9-patch pixel data!"),false);
 
-		char* dest = new_pixels;
-		const char* src = static_cast<const char*>(m_pixels) + (m_width+1)*m_components;
-		for (unsigned int y=1;y<m_height-1;++y)
-		{
-			memcpy(dest,src,(m_width-2)*m_components);
-
-			src += m_width*m_components;
-			dest += (m_width-2)*m_components;
-		}
-
-		OOBase::ThreadLocalAllocator::free(m_pixels);
+		free_pixels();
 		m_pixels = new_pixels;
-		m_height -= 2;
-		m_width -= 2;
 	}
-	else if (has_border)
-	{
-		// Now swap out the pixels for a sub-image...
-		char* new_pixels = static_cast<char*>(OOBase::ThreadLocalAllocator::allocate((m_width-1)*(m_height-1)*m_components));
-		if (!new_pixels)
-			LOG_ERROR_RETURN(("Failed to allocate 9-patch pixel data!"),false);
 
-		char* dest = new_pixels;
-		const char* src = static_cast<const char*>(m_pixels) + (m_width+1)*m_components;
-		for (unsigned int y=1;y<m_height;++y)
-		{
-			memcpy(dest,src,(m_width-1)*m_components);
+	m_info->m_tex_size = size();
 
-			src += m_width*m_components;
-			dest += (m_width-1)*m_components;
-		}
+	return true;
+}
 
-		OOBase::ThreadLocalAllocator::free(m_pixels);
-		m_pixels = new_pixels;
-		m_height -= 1;
-		m_width -= 1;
+void* Indigo::NinePatch::crop(const void* pixels, unsigned int width) const
+{
+	// Copy m_width x m_height from (1,1) of the full image, which is width pixels wide
+	char* new_pixels = static_cast<char*>(OOBase::CrtAllocator::allocate(m_width*m_height*m_components,16));
+	if (!new_pixels)
+		return NULL;
+
+	char* dest = new_pixels;
+	const char* src = static_cast<const char*>(pixels) + (width+1)*m_components;
+	for (unsigned int y=0;y<m_height;++y)
+	{
+		memcpy(dest,src,m_width*m_components);
+
+		src += width*m_components;
+		dest += m_width*m_components;
 	}
 
-	m_info->m_tex_size = size();
+	return new_pixels;
+}
 
-	return true;
+void* Indigo::NinePatch::reload_pixels(unsigned int& width, unsigned int& height) const
+{
+	void* p = decode_source(width,height);
+	if (!p || (width == m_width && height == m_height))
+		return p;
+
+	void* new_pixels = crop(p,width);
+	OOBase::CrtAllocator::free(p);
+	if (!new_pixels)
+		LOG_ERROR_RETURN(("Failed to allocate 9-patch pixel data!"),NULL);
+
+	width = m_width;
+	height = m_height;
+	return new_pixels;
 }
 
 OOBase::SharedPtr<Indigo::Render::UIDrawable> Indigo::NinePatch::make_drawable(const glm::vec4& colour, bool visible, const glm::ivec2& position, const glm::uvec2& size) const
@@ -544,24 +695,15 @@ OOBase::SharedPtr<Indigo::Render::UIDrawable> Indigo::NinePatch::make_drawable(c
 		LOG_ERROR_RETURN(("NinePatch::make_drawable called when invalid!"),OOBase::SharedPtr<Indigo::Render::UIDrawable>());
 
 	bool is_9 = (m_info->m_borders != glm::uvec4(0));
-	bool cached = true;
 
-	OOBase::SharedPtr<OOGL::Texture> texture = make_texture(GL_RGBA8,cached,is_9 ? 1 : 0);
+	OOBase::SharedPtr<Render::ManagedTexture> texture = Render::TextureManager::instance().acquire(this,GL_RGBA8,is_9 ? 1 : 0,is_9 ? GL_LINEAR : GL_LINEAR_MIPMAP_LINEAR);
 	if (!texture)
 		return OOBase::SharedPtr<Indigo::Render::UIDrawable>();
 
-	if (cached)
-	{
-		texture->parameter(GL_TEXTURE_MAG_FILTER,GL_LINEAR);
-		texture->parameter(GL_TEXTURE_MIN_FILTER,is_9 ? GL_LINEAR : GL_LINEAR_MIPMAP_LINEAR);
-		texture->parameter(GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
-		texture->parameter(GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
-	}
-
 	if (is_9)
-		return OOBase::allocate_shared<Render::UINinePatch,OOBase::ThreadLocalAllocator>(texture,colour,m_info,visible,position,size);
+		return OOBase::allocate_shared<Render::UINinePatch,OOBase::ThreadLocalAllocator>(texture,colour,m_info,visible,position,size,tex_rect());
 	else
-		return OOBase::allocate_shared<Render::UIImage,OOBase::ThreadLocalAllocator>(texture,colour,visible,position,size);
+		return OOBase::allocate_shared<Render::UIImage,OOBase::ThreadLocalAllocator>(texture,colour,visible,position,size,tex_rect());
 }
 
 glm::uvec2 Indigo::NinePatch::min_size() const
@@ -0,0 +1,429 @@
+///////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2015 Rick Taylor
+//
+// This file is part of the Indigo boardgame engine.
+//
+// Indigo is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Indigo is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Indigo.  If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////////
+
+// Checks detail::inflate against raw DEFLATE streams made by zlib, see test/data/inflate/make_vectors.py,
+// and that truncated, corrupt and oversized streams are refused without writing past the output
+
+#include "../src/Common.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#if !defined(INFLATE_TEST_DATA)
+#define INFLATE_TEST_DATA "test/data/inflate"
+#endif
+
+namespace
+{
+	// Must match make_vectors.py
+	const char* const inputs[] = { "text", "random", "runs" };
+	const unsigned int levels[] = { 0, 1, 6, 9 };
+	const char* const strategies[] = { "default", "filtered", "huffman", "rle", "fixed" };
+	const unsigned int corrupt_count = 16;
+
+	const size_t guard_len = 16;
+	const unsigned char guard_byte = 0xA5;
+
+	unsigned int s_checks = 0;
+	unsigned int s_failures = 0;
+
+	struct Buffer
+	{
+		Buffer() : m_data(NULL), m_len(0)
+		{}
+
+		~Buffer()
+		{
+			free(m_data);
+		}
+
+		unsigned char* m_data;
+		size_t         m_len;
+	};
+
+	bool load(const char* name, Buffer& buf)
+	{
+		char path[256];
+		snprintf(path,sizeof(path),"%s/%s",INFLATE_TEST_DATA,name);
+
+		FILE* f = fopen(path,"rb");
+		if (!f)
+		{
+			++s_failures;
+			printf("FAIL: cannot open %s\n",path);
+			return false;
+		}
+
+		fseek(f,0,SEEK_END);
+		long len = ftell(f);
+		fseek(f,0,SEEK_SET);
+
+		buf.m_data = static_cast<unsigned char*>(malloc(len + 1));
+		buf.m_len = fread(buf.m_data,1,len,f);
+		fclose(f);
+
+		if (buf.m_len != size_t(len))
+		{
+			++s_failures;
+			printf("FAIL: cannot read %s\n",path);
+			return false;
+		}
+		return true;
+	}
+
+	// Inflates into dest_len bytes followed by guard bytes, and checks the guard survives
+	size_t inflate(const char* name, const unsigned char* src, size_t src_len, unsigned char* dest, size_t dest_len)
+	{
+		memset(dest + dest_len,guard_byte,guard_len);
+
+		size_t r = Indigo::detail::inflate(src,src_len,dest,dest_len);
+
+		for (size_t i = 0;i < guard_len;++i)
+		{
+			if (dest[dest_len + i] != guard_byte)
+			{
+				++s_failures;
+				printf("FAIL: %s: wrote past the end of the output\n",name);
+				break;
+			}
+		}
+
+		if (r != size_t(-1) && r > dest_len)
+		{
+			++s_failures;
+			printf("FAIL: %s: returned %u for a %u byte output\n",name,static_cast<unsigned int>(r),static_cast<unsigned int>(dest_len));
+		}
+		return r;
+	}
+
+	void check_good(const char* name, const unsigned char* src, size_t src_len, const unsigned char* expected, size_t expected_len)
+	{
+		++s_checks;
+
+		unsigned char* dest = static_cast<unsigned char*>(malloc(expected_len + guard_len));
+		size_t r = inflate(name,src,src_len,dest,expected_len);
+		if (r != expected_len)
+		{
+			++s_failures;
+			printf("FAIL: %s: returned %d, expected %u\n",name,static_cast<int>(r),static_cast<unsigned int>(expected_len));
+		}
+		else if (memcmp(dest,expected,expected_len) != 0)
+		{
+			++s_failures;
+			printf("FAIL: %s: wrong output\n",name);
+		}
+		free(dest);
+	}
+
+	void check_bad(const char* name, const unsigned char* src, size_t src_len, size_t dest_len)
+	{
+		++s_checks;
+
+		unsigned char* dest = static_cast<unsigned char*>(malloc(dest_len + guard_len));
+		size_t r = inflate(name,src,src_len,dest,dest_len);
+		if (r != size_t(-1))
+		{
+			++s_failures;
+			printf("FAIL: %s: accepted, returned %u\n",name,static_cast<unsigned int>(r));
+		}
+		free(dest);
+	}
+
+	void test_vectors()
+	{
+		for (size_t i = 0;i < sizeof(inputs)/sizeof(inputs[0]);++i)
+		{
+			char name[64];
+			snprintf(name,sizeof(name),"%s.raw",inputs[i]);
+
+			Buffer raw;
+			if (!load(name,raw))
+				continue;
+
+			for (size_t l = 0;l < sizeof(levels)/sizeof(levels[0]);++l)
+			{
+				for (size_t s = 0;s < sizeof(strategies)/sizeof(strategies[0]);++s)
+				{
+					snprintf(name,sizeof(name),"%s_%u_%s.deflate",inputs[i],levels[l],strategies[s]);
+
+					Buffer z;
+					if (!load(name,z))
+						continue;
+
+					check_good(name,z.m_data,z.m_len,raw.m_data,raw.m_len);
+
+					// Too little room, by one byte and by a lot
+					check_bad(name,z.m_data,z.m_len,raw.m_len - 1);
+					check_bad(name,z.m_data,z.m_len,raw.m_len / 2);
+
+					// Every truncation of the short streams, and a spread of the long ones
+					size_t step = z.m_len / 256 + 1;
+					for (size_t len = 0;len < z.m_len;len += (z.m_len - len <= 64 ? 1 : step))
+						check_bad(name,z.m_data,len,raw.m_len);
+				}
+			}
+		}
+	}
+
+	void test_corrupt()
+	{
+		for (unsigned int i = 0;i < corrupt_count;++i)
+		{
+			char name[64];
+			snprintf(name,sizeof(name),"corrupt_%u.deflate",i);
+
+			Buffer z;
+			if (load(name,z))
+				check_bad(name,z.m_data,z.m_len,64 * 1024);
+		}
+	}
+
+	// Writes codes least significant bit first, as DEFLATE does, with Huffman codes reversed
+	class BitWriter
+	{
+	public:
+		BitWriter() : m_len(0), m_bits(0)
+		{
+			memset(m_data,0,sizeof(m_data));
+		}
+
+		void put(unsigned int v, unsigned int n)
+		{
+			for (unsigned int i = 0;i < n;++i,++m_bits)
+				m_data[m_bits / 8] |= ((v >> i) & 1) << (m_bits % 8);
+			m_len = (m_bits + 7) / 8;
+		}
+
+		void code(unsigned int c, unsigned int n)
+		{
+			for (unsigned int i = n;i-- > 0;++m_bits)
+				m_data[m_bits / 8] |= ((c >> i) & 1) << (m_bits % 8);
+			m_len = (m_bits + 7) / 8;
+		}
+
+		// The fixed literal/length code
+		void litlen(unsigned int sym)
+		{
+			if (sym < 144)
+				code(0x30 + sym,8);
+			else if (sym < 256)
+				code(0x190 + sym - 144,9);
+			else if (sym < 280)
+				code(sym - 256,7);
+			else
+				code(0xC0 + sym - 280,8);
+		}
+
+		void dist(unsigned int sym)
+		{
+			code(sym,5);
+		}
+
+		unsigned char m_data[64];
+		size_t        m_len;
+
+	private:
+		unsigned int  m_bits;
+	};
+
+	void test_handmade()
+	{
+		{
+			const unsigned char e[] = { 'a','a','a','a' };
+			BitWriter w;
+			w.put(1,1);
+			w.put(1,2);
+			w.litlen('a');
+			w.litlen(257);
+			w.dist(0);
+			w.litlen(256);
+			check_good("fixed run",w.m_data,w.m_len,e,4);
+		}
+		{
+			const unsigned char e[] = { 'h','i' };
+			const unsigned char z[] = { 0x01, 0x02,0x00, 0xFD,0xFF, 'h','i' };
+			check_good("stored",z,sizeof(z),e,2);
+		}
+		{
+			// An empty final fixed block
+			const unsigned char e[1] = { 0 };
+			const unsigned char z[] = { 0x03, 0x00 };
+			check_good("empty",z,sizeof(z),e,0);
+		}
+
+		check_bad("no input",NULL,0,16);
+		{
+			const unsigned char z[] = { 0x07, 0x00 };
+			check_bad("block type 3",z,sizeof(z),16);
+		}
+		{
+			const unsigned char z[] = { 0x01, 0x02,0x00, 0xFC,0xFF, 'h','i' };
+			check_bad("stored bad nlen",z,sizeof(z),16);
+		}
+		{
+			const unsigned char z[] = { 0x01, 0x08,0x00, 0xF7,0xFF, 'h','i' };
+			check_bad("stored short",z,sizeof(z),16);
+		}
+		{
+			// Not final, and nothing after it
+			const unsigned char z[] = { 0x00, 0x02,0x00, 0xFD,0xFF, 'h','i' };
+			check_bad("no final block",z,sizeof(z),16);
+		}
+		{
+			BitWriter w;
+			w.put(1,1);
+			w.put(1,2);
+			w.litlen('a');
+			w.litlen(257);
+			w.dist(1);
+			w.litlen(256);
+			check_bad("distance too far",w.m_data,w.m_len,16);
+		}
+		{
+			BitWriter w;
+			w.put(1,1);
+			w.put(1,2);
+			w.litlen(257);
+			w.dist(0);
+			w.litlen(256);
+			check_bad("distance before start",w.m_data,w.m_len,16);
+		}
+		{
+			BitWriter w;
+			w.put(1,1);
+			w.put(1,2);
+			w.litlen('a');
+			w.litlen(286);
+			w.dist(0);
+			w.litlen(256);
+			check_bad("length code 286",w.m_data,w.m_len,16);
+		}
+		{
+			BitWriter w;
+			w.put(1,1);
+			w.put(1,2);
+			w.litlen('a');
+			w.litlen(257);
+			w.dist(30);
+			w.litlen(256);
+			check_bad("distance code 30",w.m_data,w.m_len,16);
+		}
+		{
+			BitWriter w;
+			w.put(1,1);
+			w.put(1,2);
+			w.litlen('a');
+			w.litlen(257);
+			check_bad("no end of block",w.m_data,w.m_len,16);
+		}
+		{
+			// Every code length code one bit long
+			BitWriter w;
+			w.put(1,1);
+			w.put(2,2);
+			w.put(0,5);
+			w.put(0,5);
+			w.put(15,4);
+			for (unsigned int i = 0;i < 19;++i)
+				w.put(1,3);
+			check_bad("over-subscribed code lengths",w.m_data,w.m_len,16);
+		}
+		{
+			// Two code length codes, both two bits long
+			BitWriter w;
+			w.put(1,1);
+			w.put(2,2);
+			w.put(0,5);
+			w.put(0,5);
+			w.put(0,4);
+			w.put(2,3);
+			w.put(2,3);
+			w.put(0,3);
+			w.put(0,3);
+			check_bad("incomplete code lengths",w.m_data,w.m_len,16);
+		}
+		{
+			// A repeat of the previous length, with none before it: symbol 16 then 0, one bit each
+			BitWriter w;
+			w.put(1,1);
+			w.put(2,2);
+			w.put(0,5);
+			w.put(0,5);
+			w.put(0,4);
+			w.put(1,3);
+			w.put(0,3);
+			w.put(0,3);
+			w.put(1,3);
+			w.code(1,1);
+			w.put(0,2);
+			check_bad("repeat with no length",w.m_data,w.m_len,16);
+		}
+	}
+
+	// Damaged copies of the good streams must be refused or decode within bounds, never crash
+	void test_fuzz()
+	{
+		unsigned int seed = 1;
+		for (size_t i = 0;i < sizeof(inputs)/sizeof(inputs[0]);++i)
+		{
+			char name[64];
+			snprintf(name,sizeof(name),"%s.raw",inputs[i]);
+
+			Buffer raw;
+			if (!load(name,raw))
+				continue;
+
+			unsigned char* dest = static_cast<unsigned char*>(malloc(raw.m_len + guard_len));
+			for (size_t l = 1;l < sizeof(levels)/sizeof(levels[0]);++l)
+			{
+				snprintf(name,sizeof(name),"%s_%u_default.deflate",inputs[i],levels[l]);
+
+				Buffer z;
+				if (!load(name,z))
+					continue;
+
+				for (unsigned int n = 0;n < 200;++n)
+				{
+					seed = seed * 1103515245 + 12345;
+					size_t pos = (seed >> 8) % (n & 1 ? (z.m_len < 64 ? z.m_len : 64) : z.m_len);
+					unsigned char bit = static_cast<unsigned char>(1 << ((seed >> 4) & 7));
+
+					z.m_data[pos] ^= bit;
+					++s_checks;
+					inflate(name,z.m_data,z.m_len,dest,raw.m_len);
+					z.m_data[pos] ^= bit;
+				}
+			}
+			free(dest);
+		}
+	}
+}
+
+int main()
+{
+	test_vectors();
+	test_corrupt();
+	test_handmade();
+	test_fuzz();
+
+	printf("%u checks, %u failures\n",s_checks,s_failures);
+	return s_failures ? 1 : 0;
+}
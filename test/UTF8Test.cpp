@@ -0,0 +1,422 @@
+///////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2015 Rick Taylor
+//
+// This file is part of the Indigo boardgame engine.
+//
+// Indigo is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Indigo is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Indigo.  If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////////
+
+// Checks utf8_to_glyphs, and its SSE2 ASCII path, against the decoder it replaced
+
+#include "../src/Common.h"
+
+#include <stdio.h>
+
+namespace
+{
+	const char utf8_data[256] =
+	{
+		 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 0x00..0x0F
+		 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 0x10..0x1F
+		 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 0x20..0x2F
+		 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 0x30..0x3F
+		 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 0x40..0x4F
+		 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 0x50..0x5F
+		 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 0x60..0x6F
+		 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 0x70..0x7F
+		-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,  // 0x80..0x8F
+		-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,  // 0x90..0x9F
+		-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,  // 0xA0..0xAF
+		-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,  // 0xB0..0xBF
+		-2,-2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,  // 0xC0..0xCF
+		 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,  // 0xD0..0xDF
+		-3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,-4, 3, 3,  // 0xE0..0xEF
+		-5, 4, 4, 4,-6, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0   // 0xF0..0xFF
+	};
+
+	const OOBase::uint32_t utf_subst_val = 0xFFFD;
+
+	const size_t max_len = 512;
+
+	// The original scalar decoder, unchanged but for writing to an array.
+	// It reads up to 3 bytes past the end of truncated input, so s must be padded with zeros
+	size_t reference_decode(const unsigned char* sz, size_t s_len, OOBase::uint32_t* glyphs, GLsizei& drawable)
+	{
+		drawable = 0;
+		const unsigned char* end = sz + s_len;
+		size_t count = 0;
+
+		while (sz < end)
+		{
+			OOBase::uint32_t wide_val = utf_subst_val;
+			int l = 0;
+
+			unsigned char c = *sz++;
+			switch (utf8_data[c])
+			{
+				case 1:
+					wide_val = c;
+					break;
+
+				case 2:
+					wide_val = (c & 0x1F);
+					l = 1;
+					break;
+
+				case -2:
+					++sz;
+					break;
+
+				case 3:
+					wide_val = (c & 0x0F);
+					l = 2;
+					break;
+
+				case -3:
+					if (*sz >= 0x80 && *sz <= 0x9F)
+						sz += 2;
+					else
+					{
+						wide_val = (c & 0x0F);
+						l = 2;
+					}
+					break;
+
+				case 4:
+					wide_val = (c & 0x07);
+					l = 3;
+					break;
+
+				case -4:
+					if (*sz >= 0xA0 && *sz <= 0xBF)
+						sz += 2;
+					else
+					{
+						wide_val = (c & 0x0F);
+						l = 2;
+					}
+					break;
+
+				case -5:
+					if (*sz >= 0x80 && *sz <= 0x8F)
+						sz += 3;
+					else
+					{
+						wide_val = (c & 0x07);
+						l = 3;
+					}
+					break;
+
+				case -6:
+					if (*sz >= 0x90 && *sz <= 0xBF)
+						sz += 3;
+					else
+					{
+						wide_val = (c & 0x07);
+						l = 3;
+					}
+					break;
+
+				default:
+					break;
+			}
+
+			while (l-- > 0)
+			{
+				c = *sz++;
+				if (utf8_data[c] != -1)
+				{
+					wide_val = utf_subst_val;
+					sz += l;
+					break;
+				}
+
+				wide_val <<= 6;
+				wide_val |= (c & 0x3F);
+			}
+
+			glyphs[count++] = wide_val;
+
+			if (wide_val > 31 && wide_val != 127 && (wide_val < 128 || wide_val > 159))
+				++drawable;
+		}
+
+		return count;
+	}
+
+	unsigned int s_failures = 0;
+	unsigned int s_checks = 0;
+
+	void dump(const char* label, const unsigned char* s, size_t len)
+	{
+		printf("  %s:",label);
+		for (size_t i = 0;i < len;++i)
+			printf(" %02X",s[i]);
+		printf("\n");
+	}
+
+	// Decodes s at every alignment in a 16 byte block, and compares with the reference decoder
+	bool check(const char* name, const unsigned char* s, size_t len)
+	{
+		if (len > max_len)
+			return false;
+
+		unsigned char padded[max_len + 4] = {0};
+		memcpy(padded,s,len);
+
+		OOBase::uint32_t expected[max_len];
+		GLsizei expected_drawable = 0;
+		size_t expected_count = reference_decode(padded,len,expected,expected_drawable);
+
+		for (size_t offset = 0;offset < 16;++offset)
+		{
+			++s_checks;
+
+			char buffer[max_len + 16];
+			memcpy(buffer + offset,s,len);
+
+			// One spare entry, which must survive, as callers size the output to len
+			OOBase::uint32_t glyphs[max_len + 1];
+			glyphs[len] = 0xDEADBEEF;
+
+			GLsizei drawable = -1;
+			size_t count = Indigo::detail::utf8_to_glyphs(buffer + offset,len,glyphs,drawable);
+
+			bool ok = (count == expected_count && drawable == expected_drawable && glyphs[len] == 0xDEADBEEF);
+			for (size_t i = 0;ok && i < count;++i)
+				ok = (glyphs[i] == expected[i]);
+
+			if (!ok)
+			{
+				++s_failures;
+				printf("FAIL: %s (offset %u): %u glyphs, %d drawable, expected %u glyphs, %d drawable\n",name,static_cast<unsigned int>(offset),static_cast<unsigned int>(count),static_cast<int>(drawable),static_cast<unsigned int>(expected_count),static_cast<int>(expected_drawable));
+				dump("input",s,len);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// As check(), but also against known code points
+	void check_exact(const char* name, const char* s, const OOBase::uint32_t* expected, size_t expected_count)
+	{
+		const unsigned char* us = reinterpret_cast<const unsigned char*>(s);
+		size_t len = strlen(s);
+		if (!check(name,us,len))
+			return;
+
+		OOBase::uint32_t glyphs[max_len];
+		GLsizei drawable = 0;
+		size_t count = Indigo::detail::utf8_to_glyphs(s,len,glyphs,drawable);
+
+		bool ok = (count == expected_count);
+		for (size_t i = 0;ok && i < count;++i)
+			ok = (glyphs[i] == expected[i]);
+
+		if (!ok)
+		{
+			++s_failures;
+			printf("FAIL: %s: wrong code points\n",name);
+			dump("input",us,len);
+		}
+	}
+
+	OOBase::uint32_t s_rand = 12345;
+
+	unsigned int next_rand()
+	{
+		s_rand = s_rand * 1103515245 + 12345;
+		return (s_rand >> 16) & 0x7FFF;
+	}
+
+	void test_ascii()
+	{
+		// Every ASCII byte, including the control characters that are not drawable, at every length to 4 blocks
+		unsigned char s[80];
+		for (size_t i = 0;i < sizeof(s);++i)
+			s[i] = static_cast<unsigned char>((i * 37 + 11) & 0x7F);
+
+		for (size_t len = 0;len <= sizeof(s);++len)
+			check("ascii",s,len);
+
+		for (unsigned int c = 0;c < 128;++c)
+		{
+			memset(s,static_cast<int>(c),sizeof(s));
+			check("ascii run",s,sizeof(s));
+		}
+	}
+
+	void test_mixed()
+	{
+		// Each multi-byte sequence at each position of a 48 byte string, so some straddle block edges
+		static const char* const sequences[] =
+		{
+			"\xC2\xA9",          // U+00A9
+			"\xC2\x80",          // U+0080, a C1 control, not drawable
+			"\xDF\xBF",          // U+07FF
+			"\xE0\xA0\x80",      // U+0800
+			"\xE2\x82\xAC",      // U+20AC
+			"\xED\x9F\xBF",      // U+D7FF
+			"\xEE\x80\x80",      // U+E000
+			"\xEF\xBF\xBD",      // U+FFFD
+			"\xF0\x90\x80\x80",  // U+10000
+			"\xF4\x8F\xBF\xBF"   // U+10FFFF
+		};
+
+		for (size_t n = 0;n < sizeof(sequences)/sizeof(sequences[0]);++n)
+		{
+			size_t seq_len = strlen(sequences[n]);
+			for (size_t pos = 0;pos + seq_len <= 48;++pos)
+			{
+				unsigned char s[48];
+				for (size_t i = 0;i < sizeof(s);++i)
+					s[i] = static_cast<unsigned char>('a' + i % 26);
+
+				memcpy(s + pos,sequences[n],seq_len);
+				check("mixed",s,sizeof(s));
+				check("mixed tail",s,pos + seq_len);
+			}
+		}
+	}
+
+	void test_tails()
+	{
+		// Whole blocks followed by every length of tail, ASCII and not
+		unsigned char s[64];
+		for (size_t blocks = 0;blocks < 3;++blocks)
+		{
+			for (size_t tail = 0;tail < 16;++tail)
+			{
+				size_t len = blocks * 16 + tail;
+				for (size_t i = 0;i < len;++i)
+					s[i] = static_cast<unsigned char>('A' + i % 26);
+				check("ascii tail",s,len);
+
+				if (tail >= 2)
+				{
+					memcpy(s + len - 2,"\xC3\xA9",2);
+					check("utf8 tail",s,len);
+				}
+			}
+		}
+	}
+
+	void test_malformed()
+	{
+		const OOBase::uint32_t subst = utf_subst_val;
+
+		// Truncated, at the end and followed by ASCII
+		{
+			const OOBase::uint32_t e[] = { 'a', subst };
+			check_exact("truncated 2 byte",   "a\xC3",e,2);
+			check_exact("truncated 3 byte/1", "a\xE2",e,2);
+			check_exact("truncated 3 byte/2", "a\xE2\x82",e,2);
+			check_exact("truncated 4 byte/1", "a\xF0",e,2);
+			check_exact("truncated 4 byte/2", "a\xF0\x90",e,2);
+			check_exact("truncated 4 byte/3", "a\xF0\x90\x80",e,2);
+		}
+		{
+			// The byte that cut the sequence short is skipped with it
+			const OOBase::uint32_t e[] = { subst, 'b', 'c' };
+			check_exact("interrupted 2 byte", "\xC3" "abc",e,3);
+		}
+		{
+			const OOBase::uint32_t e[] = { subst, 'b', 'c' };
+			check_exact("interrupted 3 byte", "\xE2\x82" "abc",e,3);
+		}
+
+		// Overlong forms are a single substitution
+		{
+			const OOBase::uint32_t e[] = { subst, 'x' };
+			check_exact("overlong C0",  "\xC0\x80x",e,2);
+			check_exact("overlong C1",  "\xC1\xBFx",e,2);
+			check_exact("overlong E0",  "\xE0\x80\x80x",e,2);
+			check_exact("overlong E0/2","\xE0\x9F\xBFx",e,2);
+			check_exact("overlong F0",  "\xF0\x80\x80\x80x",e,2);
+			check_exact("overlong F0/2","\xF0\x8F\xBF\xBFx",e,2);
+		}
+
+		// UTF-16 surrogates
+		{
+			const OOBase::uint32_t e[] = { subst, 'x' };
+			check_exact("surrogate D800","\xED\xA0\x80x",e,2);
+			check_exact("surrogate DFFF","\xED\xBF\xBFx",e,2);
+		}
+
+		// Past U+10FFFF, and bytes that never start a sequence
+		{
+			const OOBase::uint32_t e[] = { subst, 'x' };
+			check_exact("out of range F4","\xF4\x90\x80\x80x",e,2);
+		}
+		{
+			const OOBase::uint32_t e[] = { subst, subst, subst, subst, 'x' };
+			check_exact("out of range F5","\xF5\x80\x80\x80x",e,5);
+		}
+		{
+			const OOBase::uint32_t e[] = { subst, subst, 'x' };
+			check_exact("invalid FF","\xFF\xFEx",e,3);
+			check_exact("lone continuation","\x80\xBFx",e,3);
+		}
+
+		// Each of those in the middle of otherwise ASCII blocks
+		static const char* const bad[] =
+		{
+			"\xC3", "\xE2\x82", "\xF0\x90\x80", "\xC0\x80", "\xE0\x80\x80", "\xF0\x80\x80\x80",
+			"\xED\xA0\x80", "\xF4\x90\x80\x80", "\xF5", "\xFF", "\x80"
+		};
+		for (size_t n = 0;n < sizeof(bad)/sizeof(bad[0]);++n)
+		{
+			size_t bad_len = strlen(bad[n]);
+			for (size_t pos = 0;pos + bad_len <= 40;++pos)
+			{
+				unsigned char s[40];
+				memset(s,'z',sizeof(s));
+				memcpy(s + pos,bad[n],bad_len);
+				check("malformed",s,sizeof(s));
+				check("malformed tail",s,pos + bad_len);
+			}
+		}
+	}
+
+	void test_random()
+	{
+		// Mostly ASCII with some high bytes, so both paths and every error case get exercised
+		unsigned char s[200];
+		for (unsigned int iter = 0;iter < 20000;++iter)
+		{
+			size_t len = next_rand() % sizeof(s);
+			unsigned int high = next_rand() % 8;
+			for (size_t i = 0;i < len;++i)
+			{
+				unsigned int r = next_rand();
+				s[i] = static_cast<unsigned char>(r % 8 < high ? 0x80 | (r >> 3) : (r >> 3) & 0x7F);
+			}
+			check("random",s,len);
+		}
+	}
+}
+
+int main()
+{
+	test_ascii();
+	test_mixed();
+	test_tails();
+	test_malformed();
+	test_random();
+
+	printf("%u checks, %u failures\n",s_checks,s_failures);
+	return s_failures ? 1 : 0;
+}
@@ -0,0 +1,99 @@
+#!/usr/bin/env python3
+#
+# Regenerates the raw DEFLATE vectors used by test/InflateTest.cpp, using zlib.
+# The names and the level and strategy lists must match the test.
+#
+#   <input>.raw                      - the uncompressed input
+#   <input>_<level>_<strategy>.deflate - zlib's raw deflate of it
+#   corrupt_<n>.deflate              - damaged streams that zlib refuses
+
+import os
+import random
+import zlib
+
+inputs = ('text', 'random', 'runs')
+levels = (0, 1, 6, 9)
+strategies = (
+	('default', zlib.Z_DEFAULT_STRATEGY),
+	('filtered', zlib.Z_FILTERED),
+	('huffman', zlib.Z_HUFFMAN_ONLY),
+	('rle', zlib.Z_RLE),
+	('fixed', zlib.Z_FIXED),
+)
+corrupt_count = 16
+
+def make_text(rng, size):
+	words = ('the', 'board', 'game', 'engine', 'indigo', 'render', 'thread', 'image', 'layer', 'font',
+		'glyph', 'atlas', 'texture', 'window', 'pipe', 'zip', 'resource', 'inflate', 'of', 'and', 'a',
+		'to', 'is', 'with', 'for', 'on', 'pixels', 'mipmap', 'queue', 'delegate')
+	out = []
+	n = 0
+	while n < size:
+		w = rng.choice(words)
+		if rng.random() < 0.1:
+			w = w.capitalize() + '.'
+		out.append(w)
+		n += len(w) + 1
+	return (' '.join(out) + '\n').encode('ascii')[:size]
+
+def make_runs(rng, size):
+	# Short and long runs, and blocks repeated from near the far end of the window
+	out = bytearray()
+	while len(out) < size:
+		r = rng.random()
+		if r < 0.4:
+			out += bytes([rng.randrange(256)]) * rng.randrange(1, 600)
+		elif r < 0.7 and len(out) > 32768:
+			start = len(out) - rng.randrange(30000, 32768)
+			out += out[start:start + rng.randrange(3, 300)]
+		else:
+			out += bytes(rng.randrange(4) for _ in range(rng.randrange(1, 200)))
+	return bytes(out[:size])
+
+def deflate(data, level, strategy):
+	c = zlib.compressobj(level, zlib.DEFLATED, -15, 9, strategy)
+	return c.compress(data) + c.flush()
+
+def refused(data):
+	try:
+		zlib.decompress(data, -15)
+	except zlib.error:
+		return True
+	return False
+
+def main():
+	here = os.path.dirname(os.path.abspath(__file__))
+	rng = random.Random(20150601)
+
+	raw = {
+		'text': make_text(rng, 34000),
+		'random': bytes(rng.randrange(256) for _ in range(4096)),
+		'runs': make_runs(rng, 34000),
+	}
+
+	valid = []
+	for name in inputs:
+		with open(os.path.join(here, name + '.raw'), 'wb') as f:
+			f.write(raw[name])
+
+		for level in levels:
+			for sname, strategy in strategies:
+				data = deflate(raw[name], level, strategy)
+				assert zlib.decompress(data, -15) == raw[name]
+				valid.append(data)
+				with open(os.path.join(here, '%s_%d_%s.deflate' % (name, level, sname)), 'wb') as f:
+					f.write(data)
+
+	# Flip bits in the headers and bodies of compressed (not stored) streams, keeping what zlib refuses
+	n = 0
+	while n < corrupt_count:
+		data = bytearray(rng.choice([v for v in valid if v[0] & 6 and len(v) < 8192]))
+		pos = rng.randrange(min(len(data), 64)) if n % 2 else rng.randrange(len(data))
+		data[pos] ^= 1 << rng.randrange(8)
+		if refused(bytes(data)):
+			with open(os.path.join(here, 'corrupt_%d.deflate' % n), 'wb') as f:
+				f.write(data)
+			n += 1
+
+if __name__ == '__main__':
+	main()
@@ -0,0 +1,394 @@
+///////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2015 Rick Taylor
+//
+// This file is part of the Indigo boardgame engine.
+//
+// Indigo is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Indigo is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Indigo.  If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////////
+
+// Cooks a binary BMFont (.fnt) and its page image into an Indigo font blob (.ifnt)
+// that Indigo::Font can use in place, without parsing or per-glyph allocation.
+//
+// Blob layout, all little-endian, must match the loader in src/Font.cpp:
+//
+//   0  char[4]  "IFNT"
+//   4  uint32   version (2)
+//   8  uint16   line height
+//  10  uint16   base height
+//  12  uint32   channel packing
+//  16  uint32   flags (bit 0: signed distance field)
+//  20  uint32   character count
+//  24  uint32   character table offset
+//  28  uint32   kerning count
+//  32  uint32   kerning table offset
+//  36  uint32   atlas width
+//  40  uint32   atlas height
+//  44  uint32   atlas pixel offset
+//  48  uint8[4] glyph padding in texels: up, right, down, left
+//
+// Character records (32 bytes each) are sorted by id:
+//   uint32 id, uint16 u0, v0, u1, v1, float left, top, right, bottom, xadvance
+//
+// Kerning records (12 bytes each) are sorted by (first, second):
+//   uint32 first, uint32 second, float amount
+//
+// Atlas pixels are width * height bytes, one GL_RED texel each.
+
+#if defined(_MSC_VER)
+#define _CRT_SECURE_NO_WARNINGS
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../3rdparty/stb/stb_image.h"
+
+#define HEADER_SIZE 52
+#define CHAR_RECORD_SIZE 32
+#define KERN_RECORD_SIZE 12
+
+struct char_record
+{
+	unsigned int id;
+	unsigned short u0, v0, u1, v1;
+	float left, top, right, bottom, xadvance;
+};
+
+struct kern_record
+{
+	unsigned int first;
+	unsigned int second;
+	float amount;
+};
+
+static unsigned int read_u32(const unsigned char** p)
+{
+	unsigned int r = (*p)[0] | ((*p)[1] << 8) | ((*p)[2] << 16) | ((unsigned int)(*p)[3] << 24);
+	*p += 4;
+	return r;
+}
+
+static unsigned int read_u16(const unsigned char** p)
+{
+	unsigned int r = (*p)[0] | ((*p)[1] << 8);
+	*p += 2;
+	return r;
+}
+
+static int read_s16(const unsigned char** p)
+{
+	return (short)read_u16(p);
+}
+
+static void write_u32(FILE* f, unsigned int v)
+{
+	unsigned char b[4];
+	b[0] = (unsigned char)v;
+	b[1] = (unsigned char)(v >> 8);
+	b[2] = (unsigned char)(v >> 16);
+	b[3] = (unsigned char)(v >> 24);
+	fwrite(b,4,1,f);
+}
+
+static void write_u16(FILE* f, unsigned int v)
+{
+	unsigned char b[2];
+	b[0] = (unsigned char)v;
+	b[1] = (unsigned char)(v >> 8);
+	fwrite(b,2,1,f);
+}
+
+static void write_f32(FILE* f, float v)
+{
+	unsigned int u;
+	memcpy(&u,&v,4);
+	write_u32(f,u);
+}
+
+static int compare_chars(const void* p1, const void* p2)
+{
+	const struct char_record* c1 = (const struct char_record*)p1;
+	const struct char_record* c2 = (const struct char_record*)p2;
+	return (c1->id < c2->id ? -1 : (c1->id > c2->id ? 1 : 0));
+}
+
+static int compare_kerns(const void* p1, const void* p2)
+{
+	const struct kern_record* k1 = (const struct kern_record*)p1;
+	const struct kern_record* k2 = (const struct kern_record*)p2;
+	if (k1->first != k2->first)
+		return (k1->first < k2->first ? -1 : 1);
+	return (k1->second < k2->second ? -1 : (k1->second > k2->second ? 1 : 0));
+}
+
+static unsigned char* read_file(const char* name, unsigned int* len)
+{
+	unsigned char* buf;
+	FILE* f = fopen(name,"rb");
+	if (!f)
+		return NULL;
+
+	fseek(f,0,SEEK_END);
+	*len = ftell(f);
+	fseek(f,0,SEEK_SET);
+
+	buf = (unsigned char*)malloc(*len);
+	if (buf && fread(buf,*len,1,f) != 1)
+	{
+		free(buf);
+		buf = NULL;
+	}
+	fclose(f);
+	return buf;
+}
+
+int main(int argc, char* argv[])
+{
+	unsigned char* buf;
+	const unsigned char* p;
+	const unsigned char* end;
+	unsigned int file_size, i;
+	unsigned int flags = 0, packing = 0, pages = 0;
+	unsigned int line_height = 0, base_height = 0, tex_width = 0, tex_height = 0;
+	unsigned char padding[4] = {0};
+	char page_name[1024] = {0};
+	struct char_record* chars = NULL;
+	unsigned int char_count = 0;
+	struct kern_record* kerns = NULL;
+	unsigned int kern_count = 0;
+	unsigned char* image;
+	int w, h, c;
+	FILE* f_output;
+
+	if (argc < 3 || argc > 4 || (argc == 4 && strcmp(argv[3],"-d") != 0))
+	{
+		fprintf(stderr,"Usage: %s font.fnt output.ifnt [-d]\n",argv[0]);
+		return -1;
+	}
+
+	if (argc == 4)
+		flags |= 1;
+
+	buf = read_file(argv[1],&file_size);
+	if (!buf)
+	{
+		fprintf(stderr,"%s: can't read %s\n",argv[0],argv[1]);
+		return -1;
+	}
+
+	if (file_size < 4 || memcmp(buf,"BMF\x03",4) != 0)
+	{
+		fprintf(stderr,"%s: %s is not a binary BMFont file\n",argv[0],argv[1]);
+		return -1;
+	}
+
+	end = buf + file_size;
+	for (p = buf + 4;p + 5 <= end;)
+	{
+		unsigned int type = *p++;
+		unsigned int len = read_u32(&p);
+		const unsigned char* block = p;
+		if (p + len > end)
+		{
+			fprintf(stderr,"%s: truncated block in %s\n",argv[0],argv[1]);
+			return -1;
+		}
+
+		switch (type)
+		{
+		case 1:
+			// Reserved bit 5 of bitField marks a signed distance field atlas
+			if (block[2] & 0x20)
+				flags |= 1;
+			memcpy(padding,block + 7,4);
+			break;
+
+		case 2:
+			line_height = read_u16(&block);
+			base_height = read_u16(&block);
+			tex_width = read_u16(&block);
+			tex_height = read_u16(&block);
+			pages = read_u16(&block);
+			if (*block++ != 0x80)
+				packing = read_u32(&block);
+			break;
+
+		case 3:
+			if (pages != 1)
+			{
+				fprintf(stderr,"%s: only single page fonts can be cooked\n",argv[0]);
+				return -1;
+			}
+			strncpy(page_name,(const char*)block,sizeof(page_name) - 1);
+			break;
+
+		case 4:
+			char_count = len / 20;
+			chars = (struct char_record*)calloc(char_count ? char_count : 1,sizeof(struct char_record));
+			if (!chars || !line_height || !tex_width || !tex_height)
+			{
+				fprintf(stderr,"%s: bad character block in %s\n",argv[0],argv[1]);
+				return -1;
+			}
+			for (i = 0;i < char_count;++i)
+			{
+				float lh = (float)line_height;
+				unsigned int u, v;
+				int width, height, x, y;
+
+				chars[i].id = read_u32(&block);
+				u = read_u16(&block);
+				v = read_u16(&block);
+				width = read_u16(&block);
+				height = read_u16(&block);
+				x = read_s16(&block);
+				y = read_s16(&block);
+
+				chars[i].u0 = (unsigned short)(u / (float)tex_width * 0xFFFF);
+				chars[i].v0 = (unsigned short)(v / (float)tex_height * 0xFFFF);
+				chars[i].u1 = (unsigned short)((u + width) / (float)tex_width * 0xFFFF);
+				chars[i].v1 = (unsigned short)((v + height) / (float)tex_height * 0xFFFF);
+				chars[i].left = x / lh;
+				chars[i].top = (lh - y) / lh;
+				chars[i].right = (x + width) / lh;
+				chars[i].bottom = (lh - y - height) / lh;
+				chars[i].xadvance = read_s16(&block) / lh;
+				block += 2;
+			}
+			qsort(chars,char_count,sizeof(struct char_record),&compare_chars);
+			break;
+
+		case 5:
+			kern_count = len / 10;
+			kerns = (struct kern_record*)calloc(kern_count ? kern_count : 1,sizeof(struct kern_record));
+			if (!kerns || !line_height)
+			{
+				fprintf(stderr,"%s: bad kerning block in %s\n",argv[0],argv[1]);
+				return -1;
+			}
+			for (i = 0;i < kern_count;++i)
+			{
+				kerns[i].first = read_u32(&block);
+				kerns[i].second = read_u32(&block);
+				kerns[i].amount = read_s16(&block) / (float)line_height;
+			}
+			qsort(kerns,kern_count,sizeof(struct kern_record),&compare_kerns);
+			break;
+
+		default:
+			fprintf(stderr,"%s: unknown block type %u in %s\n",argv[0],type,argv[1]);
+			return -1;
+		}
+
+		p += len;
+	}
+
+	if (!page_name[0] || !chars)
+	{
+		fprintf(stderr,"%s: %s has no pages or characters\n",argv[0],argv[1]);
+		return -1;
+	}
+
+	// Page names are relative to the font file
+	{
+		char path[2048];
+		const char* sep = strrchr(argv[1],'/');
+		const char* sep2 = strrchr(argv[1],'\\');
+		size_t dir_len;
+		if (sep2 > sep)
+			sep = sep2;
+		dir_len = (sep ? (size_t)(sep - argv[1]) + 1 : 0);
+		if (dir_len + strlen(page_name) >= sizeof(path))
+		{
+			fprintf(stderr,"%s: page path too long\n",argv[0]);
+			return -1;
+		}
+		memcpy(path,argv[1],dir_len);
+		strcpy(path + dir_len,page_name);
+
+		image = stbi_load(path,&w,&h,&c,0);
+		if (!image)
+		{
+			fprintf(stderr,"%s: can't load %s: %s\n",argv[0],path,stbi_failure_reason());
+			return -1;
+		}
+	}
+
+	if ((unsigned int)w != tex_width || (unsigned int)h != tex_height)
+	{
+		fprintf(stderr,"%s: page size does not match font\n",argv[0]);
+		return -1;
+	}
+
+	// Keep the first channel only, as the runtime uploads pages as GL_R8
+	for (i = 0;i < (unsigned int)(w * h);++i)
+		image[i] = image[i * c];
+
+	f_output = fopen(argv[2],"wb");
+	if (!f_output)
+	{
+		fprintf(stderr,"%s: can't open %s for writing\n",argv[0],argv[2]);
+		return -1;
+	}
+
+	fwrite("IFNT",4,1,f_output);
+	write_u32(f_output,2);
+	write_u16(f_output,line_height);
+	write_u16(f_output,base_height);
+	write_u32(f_output,packing);
+	write_u32(f_output,flags);
+	write_u32(f_output,char_count);
+	write_u32(f_output,HEADER_SIZE);
+	write_u32(f_output,kern_count);
+	write_u32(f_output,HEADER_SIZE + char_count * CHAR_RECORD_SIZE);
+	write_u32(f_output,tex_width);
+	write_u32(f_output,tex_height);
+	write_u32(f_output,HEADER_SIZE + char_count * CHAR_RECORD_SIZE + kern_count * KERN_RECORD_SIZE);
+	fwrite(padding,4,1,f_output);
+
+	for (i = 0;i < char_count;++i)
+	{
+		write_u32(f_output,chars[i].id);
+		write_u16(f_output,chars[i].u0);
+		write_u16(f_output,chars[i].v0);
+		write_u16(f_output,chars[i].u1);
+		write_u16(f_output,chars[i].v1);
+		write_f32(f_output,chars[i].left);
+		write_f32(f_output,chars[i].top);
+		write_f32(f_output,chars[i].right);
+		write_f32(f_output,chars[i].bottom);
+		write_f32(f_output,chars[i].xadvance);
+	}
+
+	for (i = 0;i < kern_count;++i)
+	{
+		write_u32(f_output,kerns[i].first);
+		write_u32(f_output,kerns[i].second);
+		write_f32(f_output,kerns[i].amount);
+	}
+
+	fwrite(image,w * h,1,f_output);
+	fclose(f_output);
+
+	stbi_image_free(image);
+	free(kerns);
+	free(chars);
+	free(buf);
+
+	return 0;
+}
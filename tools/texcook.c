@@ -0,0 +1,182 @@
+///////////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2015 Rick Taylor
+//
+// This file is part of the Indigo boardgame engine.
+//
+// Indigo is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Indigo is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Indigo.  If not, see <http://www.gnu.org/licenses/>.
+//
+///////////////////////////////////////////////////////////////////////////////////
+
+// Cooks an image into an Indigo raw texture (.itex), tightly packed in its final
+// GL upload format, so it can be uploaded straight from a stored zip entry.
+//
+// Blob layout, all little-endian, must match the loader in src/CompressedImage.cpp:
+//
+//   0  char[4]  "ITEX"
+//   4  uint32   version (1)
+//   8  uint32   width
+//  12  uint32   height
+//  16  uint32   GL internal format
+//  20  uint32   GL pixel format
+//  24  uint32   GL pixel type (GL_UNSIGNED_BYTE)
+//  28  uint32   mip level count
+//  32  uint32   flags (reserved)
+//  36  uint32   offset of the first level
+//
+// Levels follow largest first, each width * height * components bytes.
+//
+// Store the output uncompressed in the resource zip (zip -0), or it gets inflated on load.
+
+#if defined(_MSC_VER)
+#define _CRT_SECURE_NO_WARNINGS
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../3rdparty/stb/stb_image.h"
+
+#define HEADER_SIZE 40
+
+#define GL_UNSIGNED_BYTE 0x1401
+#define GL_RED           0x1903
+#define GL_RGB           0x1907
+#define GL_RGBA          0x1908
+#define GL_RG            0x8227
+#define GL_R8            0x8229
+#define GL_RG8           0x822B
+#define GL_RGB8          0x8051
+#define GL_RGBA8         0x8058
+
+static void write_u32(FILE* f, unsigned int v)
+{
+	unsigned char b[4];
+	b[0] = (unsigned char)v;
+	b[1] = (unsigned char)(v >> 8);
+	b[2] = (unsigned char)(v >> 16);
+	b[3] = (unsigned char)(v >> 24);
+	fwrite(b,4,1,f);
+}
+
+// 2x2 box filter, clamping at odd edges
+static unsigned char* downsample(const unsigned char* src, int w, int h, int c, int* nw, int* nh)
+{
+	int x, y, i;
+	unsigned char* dest;
+
+	*nw = (w > 1 ? w / 2 : 1);
+	*nh = (h > 1 ? h / 2 : 1);
+	dest = (unsigned char*)malloc((size_t)*nw * *nh * c);
+	if (!dest)
+		return NULL;
+
+	for (y = 0;y < *nh;++y)
+	{
+		int y0 = y * 2;
+		int y1 = (y0 + 1 < h ? y0 + 1 : y0);
+		for (x = 0;x < *nw;++x)
+		{
+			int x0 = x * 2;
+			int x1 = (x0 + 1 < w ? x0 + 1 : x0);
+			for (i = 0;i < c;++i)
+			{
+				unsigned int sum = src[(y0 * w + x0) * c + i] + src[(y0 * w + x1) * c + i] +
+						src[(y1 * w + x0) * c + i] + src[(y1 * w + x1) * c + i];
+				dest[(y * *nw + x) * c + i] = (unsigned char)((sum + 2) / 4);
+			}
+		}
+	}
+	return dest;
+}
+
+int main(int argc, char* argv[])
+{
+	static const unsigned int formats[5][2] = { {0,0}, {GL_R8,GL_RED}, {GL_RG8,GL_RG}, {GL_RGB8,GL_RGB}, {GL_RGBA8,GL_RGBA} };
+
+	unsigned char* image;
+	int w, h, c, mips = 0, levels = 1, lw, lh;
+	FILE* f_output;
+
+	if (argc < 3 || argc > 4 || (argc == 4 && strcmp(argv[3],"-m") != 0))
+	{
+		fprintf(stderr,"Usage: %s image output.itex [-m]\n",argv[0]);
+		return -1;
+	}
+
+	if (argc == 4)
+		mips = 1;
+
+	image = stbi_load(argv[1],&w,&h,&c,0);
+	if (!image)
+	{
+		fprintf(stderr,"%s: can't load %s: %s\n",argv[0],argv[1],stbi_failure_reason());
+		return -1;
+	}
+
+	if (mips)
+	{
+		for (lw = w, lh = h;lw > 1 || lh > 1;++levels)
+		{
+			lw = (lw > 1 ? lw / 2 : 1);
+			lh = (lh > 1 ? lh / 2 : 1);
+		}
+	}
+
+	f_output = fopen(argv[2],"wb");
+	if (!f_output)
+	{
+		fprintf(stderr,"%s: can't open %s for writing\n",argv[0],argv[2]);
+		return -1;
+	}
+
+	fwrite("ITEX",4,1,f_output);
+	write_u32(f_output,1);
+	write_u32(f_output,w);
+	write_u32(f_output,h);
+	write_u32(f_output,formats[c][0]);
+	write_u32(f_output,formats[c][1]);
+	write_u32(f_output,GL_UNSIGNED_BYTE);
+	write_u32(f_output,levels);
+	write_u32(f_output,0);
+	write_u32(f_output,HEADER_SIZE);
+
+	fwrite(image,(size_t)w * h * c,1,f_output);
+
+	for (lw = w, lh = h;--levels > 0;)
+	{
+		int nw, nh;
+		unsigned char* next = downsample(image,lw,lh,c,&nw,&nh);
+		if (!next)
+		{
+			fprintf(stderr,"%s: out of memory\n",argv[0]);
+			fclose(f_output);
+			return -1;
+		}
+
+		fwrite(next,(size_t)nw * nh * c,1,f_output);
+
+		free(image);
+		image = next;
+		lw = nw;
+		lh = nh;
+	}
+
+	fclose(f_output);
+	free(image);
+
+	return 0;
+}